@@ -41,12 +41,14 @@ distribution.
 #include "Core.h"
 #include "DataDefs.h"
 #include "Debug.h"
+#include "DebugLogSink.h"
 #include "Console.h"
 #include "MiscUtils.h"
 #include "Module.h"
 #include "VersionInfoFactory.h"
 #include "VersionInfo.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "ModuleFactory.h"
 #include "modules/DFSDL.h"
 #include "modules/DFSteam.h"
@@ -58,6 +60,7 @@ distribution.
 #include "modules/Persistence.h"
 #include "RemoteServer.h"
 #include "RemoteTools.h"
+#include "ScriptIndex.h"
 #include "LuaTools.h"
 #include "DFHackVersion.h"
 
@@ -77,6 +80,7 @@ using namespace DFHack;
 
 #include <stdio.h>
 #include <iomanip>
+#include <chrono>
 #include <stdlib.h>
 #include <fstream>
 #include <thread>
@@ -146,6 +150,8 @@ struct Core::Private
     bool last_autosave_request{false};
     bool last_manual_save_request{false};
     bool was_load_save{false};
+
+    std::unique_ptr<ScriptIndex> script_index;
 };
 
 struct CommandDepthCounter
@@ -438,12 +444,14 @@ bool Core::addScriptPath(std::string path, bool search_before)
     if (!Filesystem::isdir(path))
         return false;
     vec.push_back(path);
+    d->script_index->invalidate();
     return true;
 }
 
 bool Core::setModScriptPaths(const std::vector<std::string> &mod_script_paths) {
     std::lock_guard<std::mutex> lock(script_path_mutex);
     script_paths[2] = mod_script_paths;
+    d->script_index->invalidate();
     return true;
 }
 
@@ -463,6 +471,8 @@ bool Core::removeScriptPath(std::string path)
             found = true;
         }
     }
+    if (found)
+        d->script_index->invalidate();
     return found;
 }
 
@@ -488,15 +498,12 @@ void Core::getScriptPaths(std::vector<std::string> *dest)
 
 std::string Core::findScript(std::string name)
 {
-    std::vector<std::string> paths;
-    getScriptPaths(&paths);
-    for (auto it = paths.begin(); it != paths.end(); ++it)
-    {
-        std::string path = *it + "/" + name;
-        if (Filesystem::isfile(path))
-            return path;
-    }
-    return "";
+    return d->script_index->find(name);
+}
+
+uint64_t Core::getScriptsVersion()
+{
+    return d->script_index->isWatching() ? d->script_index->getVersion() : 0;
 }
 
 bool loadScriptPaths(color_ostream &out, bool silent = false)
@@ -1021,6 +1028,84 @@ command_result Core::runCommand(color_ostream &con, const std::string &first_, s
 */
         con.print("The game was forced to pause!\n");
     }
+    else if (first == "profile")
+    {
+        std::string subcmd = parts.size() ? toLower(parts[0]) : "report";
+        if (subcmd == "enable" || subcmd == "start")
+        {
+            Profiler::setEnabled(true);
+            con.print("Profiling enabled.\n");
+        }
+        else if (subcmd == "disable" || subcmd == "stop")
+        {
+            Profiler::setEnabled(false);
+            con.print("Profiling disabled.\n");
+        }
+        else if (subcmd == "reset")
+        {
+            CoreSuspender suspend;
+            Profiler::reset();
+            con.print("Profiling data cleared.\n");
+        }
+        else if (subcmd == "report")
+        {
+            con.print("Profiling is %s.\n", Profiler::isEnabled() ? "enabled" : "disabled");
+
+            CoreSuspender suspend;
+            std::vector<const Profiler::Stats *> stats;
+            Profiler::listStats(&stats);
+            if (stats.empty())
+            {
+                con.print("No profiling data collected.\n");
+                return CR_OK;
+            }
+
+            const char *header_format = "%-36s %10s %10s %9s %9s %9s %9s %9s\n";
+            const char *row_format =    "%-36s %10llu %10.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n";
+            con.print(header_format, "Callback", "Calls", "Total ms",
+                "Avg us", "p50 us", "p99 us", "Max us", "Recent us");
+            for (auto stat : stats)
+            {
+                if (parts.size() > 1 && stat->name.find(parts[1]) == std::string::npos)
+                    continue;
+                con.print(row_format, stat->name.c_str(), (unsigned long long)stat->calls,
+                    stat->totalNs() / 1e6,
+                    stat->totalNs() / 1e3 / stat->calls,
+                    stat->percentileNs(0.5) / 1e3,
+                    stat->percentileNs(0.99) / 1e3,
+                    stat->maxNs() / 1e3,
+                    stat->windowAverageNs() / 1e3);
+            }
+        }
+        else if (subcmd == "startup")
+        {
+            std::vector<PluginManager::PluginLoadTime> timeline;
+            double total_ms;
+            plug_mgr->getLoadTimeline(&timeline, &total_ms);
+            if (timeline.empty())
+            {
+                con.print("No plugins were loaded by the last full plugin load.\n");
+                return CR_OK;
+            }
+
+            double open_ms = 0, init_ms = 0;
+            con.print("%-30s %10s %10s  %s\n", "Plugin", "Open ms", "Init ms", "State");
+            for (auto &entry : timeline)
+            {
+                open_ms += entry.open_ms;
+                init_ms += entry.init_ms;
+                con.print("%-30s %10.2f %10.2f  %s\n", entry.name.c_str(),
+                    entry.open_ms, entry.init_ms, entry.loaded ? "loaded" : "failed");
+            }
+            con.print("%zu plugins in %.1f ms: %.1f ms opening (on worker threads), %.1f ms in plugin_init\n",
+                timeline.size(), total_ms, open_ms, init_ms);
+        }
+        else
+        {
+            con << "Usage: profile [report [<filter>]|startup|enable|disable|reset]" << std::endl;
+            return CR_WRONG_USAGE;
+        }
+    }
     else if (first == "cls" || first == "clear")
     {
         if (con.is_console())
@@ -1429,6 +1514,8 @@ Core::Core() :
 {
     // init the console. This must be always the first step!
     plug_mgr = 0;
+    d->script_index = std::make_unique<ScriptIndex>(
+        [this](std::vector<std::string> *dest) { getScriptPaths(dest); });
     errorstate = false;
     vinfo = 0;
     memset(&(s_mods), 0, sizeof(s_mods));
@@ -1577,6 +1664,41 @@ bool Core::InitMainThread() {
     return true;
 }
 
+// Measures the steps of InitSimulationThread. The report is written to
+// stderr.log when initialization is complete.
+struct StartupTimer
+{
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start = clock::now();
+    clock::time_point last = start;
+    std::vector<std::pair<const char *, double>> steps;
+
+    void step(const char *name)
+    {
+        auto now = clock::now();
+        steps.emplace_back(name, std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+    }
+
+    void report(std::ostream &out)
+    {
+        out << "Startup timings:\n";
+        for (auto &step : steps)
+            out << "  " << std::left << std::setw(24) << step.first << std::right
+                << std::fixed << std::setprecision(1) << std::setw(9) << step.second << " ms\n";
+        double total = std::chrono::duration<double, std::milli>(last - start).count();
+        out << "  " << std::left << std::setw(24) << "total" << std::right
+            << std::fixed << std::setprecision(1) << std::setw(9) << total << " ms\n";
+
+        size_t hits, misses;
+        Lua::GetBytecodeCacheStats(&hits, &misses);
+        out << "  lua files loaded from bytecode cache: " << hits
+            << ", compiled: " << misses << "\n";
+        out.unsetf(std::ios_base::floatfield);
+    }
+};
+
 bool Core::InitSimulationThread()
 {
     if(started)
@@ -1588,6 +1710,8 @@ bool Core::InitSimulationThread()
     // Core::Update will temporary unlock when there is any commands queued
     MainThread::suspend().lock();
 
+    StartupTimer startup;
+
     std::cerr << "Initializing Console.\n";
     // init the console.
     bool is_text_mode = (init && init->display.flag.is_set(init_display_flags::TEXT));
@@ -1627,6 +1751,7 @@ bool Core::InitSimulationThread()
         std::cerr << "Console is running.\n";
     else
         std::cerr << "Console has failed to initialize!\n";
+    startup.step("console");
 /*
     // dump offsets to a file
     std::ofstream dump("offsets.log");
@@ -1638,6 +1763,7 @@ bool Core::InitSimulationThread()
     */
     // initialize data defs
     virtual_identity::Init(this);
+    startup.step("data definitions");
 
     // create config directory if it doesn't already exist
     if (!Filesystem::mkdir_recursive(CONFIG_PATH))
@@ -1687,6 +1813,7 @@ bool Core::InitSimulationThread()
     }
 
     loadScriptPaths(con);
+    startup.step("config and script paths");
 
     // initialize common lua context
     if (!Lua::Core::Init(con))
@@ -1694,18 +1821,22 @@ bool Core::InitSimulationThread()
         fatal("Lua failed to initialize");
         return false;
     }
+    startup.step("lua");
 
     if (DFSteam::init(con)) {
         std::cerr << "Found Steam.\n";
         DFSteam::launchSteamDFHackIfNecessary(con);
     }
+    startup.step("steam");
     std::cerr << "Initializing textures.\n";
     Textures::init(con);
+    startup.step("textures");
     // create mutex for syncing with interactive tasks
     std::cerr << "Initializing plugins.\n";
     // create plugin manager
     plug_mgr = new PluginManager(this);
     plug_mgr->init();
+    startup.step("plugins");
     std::cerr << "Starting the TCP listener.\n";
     auto listen = ServerMain::listen(RemoteClient::GetDefaultPort());
     IODATA *temp = new IODATA;
@@ -1727,6 +1858,7 @@ bool Core::InitSimulationThread()
     std::cerr << "Starting DF input capture thread.\n";
     // set up hotkey capture
     d->hotkeythread = std::thread(fHKthread, (void *) temp);
+    startup.step("threads");
     started = true;
     modstate = 0;
 
@@ -1794,9 +1926,13 @@ bool Core::InitSimulationThread()
         }
     }
 
+    startup.step("command line");
+
     std::cerr << "DFHack is running.\n";
 
     onStateChange(con, SC_CORE_INITIALIZED);
+    startup.step("core initialized event");
+    startup.report(std::cerr);
 
     return true;
 }
@@ -1932,6 +2068,8 @@ void Core::doUpdate(color_ostream &out)
         bool had_map = isMapLoaded();
         last_world_data_ptr = new_wdata;
         last_local_map_ptr = new_mapdata;
+        // the save folder is one of the script paths
+        d->script_index->invalidate();
 
         // and if the world is going away, we report the map change first
         if(had_map)
@@ -2007,6 +2145,13 @@ int Core::Update()
 };
 
 extern bool buildings_do_onupdate;
+extern bool buildings_index_dirty;
+extern uint32_t burrows_index_generation;
+extern uint32_t item_sweep_generation;
+extern uint32_t job_registry_generation;
+extern uint32_t walkable_groups_generation;
+extern uint32_t stockpile_contents_generation;
+void itemsweep_onStateChange(color_ostream &out, state_change_event event);
 void buildings_onStateChange(color_ostream &out, state_change_event event);
 void buildings_onUpdate(color_ostream &out);
 
@@ -2014,17 +2159,53 @@ static int buildings_timer = 0;
 
 void Core::onUpdate(color_ostream &out)
 {
-    EventManager::manageEvents(out);
+    static Profiler::Stats *update_stats = Profiler::getStats("core/onupdate");
+    static Profiler::Stats *events_stats = Profiler::getStats("core/EventManager");
+    static Profiler::Stats *buildings_stats = Profiler::getStats("core/buildings");
+    static Profiler::Stats *plugins_stats = Profiler::getStats("core/plugins");
+    static Profiler::Stats *lua_stats = Profiler::getStats("core/lua-timers");
+
+    Profiler::ScopedTimer update_timer(update_stats);
+
+    // DF or DFHack tools may have changed the world since the last update, so
+    // earlier item sweeps, stockpile contents, job counts and walkability
+    // groups are stale. the player may also have repainted burrows, and DF
+    // may have freed the block masks the burrow index points to.
+    burrows_index_generation++;
+    item_sweep_generation++;
+    stockpile_contents_generation++;
+    job_registry_generation++;
+    walkable_groups_generation++;
+
+    {
+        Profiler::ScopedTimer timer(events_stats);
+        EventManager::manageEvents(out);
+    }
+
+    // push the changes of this tick to subscribed remote clients
+    ServerNotifier::onUpdate(out);
+
+    // the player may have repainted zones and stockpiles since the last frame
+    buildings_index_dirty = true;
 
     // convert building reagents
     if (buildings_do_onupdate && (++buildings_timer & 1))
+    {
+        Profiler::ScopedTimer timer(buildings_stats);
         buildings_onUpdate(out);
+    }
 
     // notify all the plugins that a game tick is finished
-    plug_mgr->OnUpdate(out);
+    {
+        Profiler::ScopedTimer timer(plugins_stats);
+        plug_mgr->OnUpdate(out);
+    }
 
     // process timers in lua
-    Lua::Core::onUpdate(out);
+    {
+        Profiler::ScopedTimer timer(lua_stats);
+        Lua::Core::onUpdate(out);
+    }
 }
 
 void getFilesWithPrefixAndSuffix(const std::string& folder, const std::string& prefix, const std::string& suffix, std::vector<std::string>& result) {
@@ -2150,6 +2331,12 @@ void Core::onStateChange(color_ostream &out, state_change_event event)
     static md5wrapper md5w;
     static std::string ostype = "";
 
+    // maps, burrows and jobs may have been freed or replaced
+    burrows_index_generation++;
+    job_registry_generation++;
+    walkable_groups_generation++;
+    itemsweep_onStateChange(out, event);
+
     if (!ostype.size())
     {
         ostype = "unknown OS";
@@ -2283,6 +2470,10 @@ int Core::Shutdown ( void )
     if (MainThread::suspend().owns_lock())
         MainThread::suspend().unlock();
 
+    // Write queued debug messages while the console is still usable. Later
+    // messages are printed synchronously.
+    DebugLogSink::getInstance().stop();
+
     // Make sure the console thread shutdowns before clean up to avoid any
     // unlikely data races.
     if (d->iothread.joinable()) {
@@ -2300,6 +2491,8 @@ int Core::Shutdown ( void )
     d->hotkeythread.join();
     d->iothread.join();
 
+    d->script_index->stop();
+
     CoreSuspendClaimer suspend;
     if(plug_mgr)
     {
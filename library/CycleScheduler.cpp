@@ -0,0 +1,205 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#include "CycleScheduler.h"
+
+#include <algorithm>
+
+using namespace DFHack;
+
+static int32_t get_period(PluginCycle *cycle)
+{
+    return std::max<int32_t>(1, cycle->period);
+}
+
+CycleScheduler::CycleScheduler(double budget_us)
+    : last_tick(-1), budget_us(std::max(0.0, budget_us))
+{
+}
+
+CycleScheduler::Task *CycleScheduler::find(Client *client)
+{
+    for (auto &task : tasks)
+        if (task.client == client)
+            return &task;
+    return NULL;
+}
+
+void CycleScheduler::add(Client *client)
+{
+    PluginCycle *cycle = client->getCycle();
+    if (!cycle)
+        return;
+
+    Task *task = find(client);
+    if (!task)
+    {
+        tasks.push_back(Task());
+        task = &tasks.back();
+        task->client = client;
+    }
+    task->period = get_period(cycle);
+    task->cost_us = std::max<int32_t>(0, cycle->cost_us);
+    task->placed = false;
+}
+
+void CycleScheduler::reset()
+{
+    last_tick = -1;
+    for (auto &task : tasks)
+        task.placed = false;
+}
+
+// estimated time spent in the other cycles that run on the given tick
+double CycleScheduler::load(const Task *self, int32_t tick) const
+{
+    double sum = 0;
+    for (auto &task : tasks)
+    {
+        if (&task == self || !task.placed || tick < task.next_due)
+            continue;
+        if ((tick - task.next_due) % task.period == 0)
+            sum += task.cost_us;
+    }
+    return sum;
+}
+
+// run the task first on the least loaded tick in [earliest, earliest+window)
+void CycleScheduler::place(Task *task, int32_t earliest, int32_t window)
+{
+    const int32_t MAX_CANDIDATES = 256;
+    int32_t step = std::max<int32_t>(1, window / MAX_CANDIDATES);
+
+    int32_t best = earliest;
+    double best_load = load(task, earliest);
+    for (int32_t offset = step; offset < window && best_load > 0; offset += step)
+    {
+        double cur = load(task, earliest + offset);
+        if (cur < best_load)
+        {
+            best = earliest + offset;
+            best_load = cur;
+        }
+    }
+
+    task->next_due = best;
+    task->placed = true;
+}
+
+void CycleScheduler::collect(int32_t now, std::vector<Client *> *due)
+{
+    // the frame counter went back: a different world was loaded
+    if (now < last_tick)
+        reset();
+    last_tick = now;
+
+    for (size_t i = 0; i < tasks.size(); )
+    {
+        Task &task = tasks[i];
+        PluginCycle *cycle = task.client->getCycle();
+        if (!cycle)
+        {
+            // unloaded
+            tasks.erase(tasks.begin() + i);
+            continue;
+        }
+        i++;
+
+        int32_t period = get_period(cycle);
+        if (period != task.period)
+        {
+            task.period = period;
+            task.placed = false;
+        }
+        if (!task.placed)
+            place(&task, now, task.period);
+    }
+
+    std::vector<Task *> ready;
+    for (auto &task : tasks)
+    {
+        PluginCycle *cycle = task.client->getCycle();
+        if (!cycle->requested && task.next_due > now)
+            continue;
+
+        // keep the phase of disabled cycles without running them
+        if (!task.client->isCycleEnabled())
+        {
+            cycle->requested = false;
+            if (task.next_due <= now)
+                task.next_due += task.period * ((now - task.next_due) / task.period + 1);
+            continue;
+        }
+
+        ready.push_back(&task);
+    }
+
+    // most overdue first
+    std::stable_sort(ready.begin(), ready.end(), [](const Task *a, const Task *b) {
+        return a->next_due < b->next_due;
+    });
+
+    due->clear();
+    for (auto task : ready)
+        due->push_back(task->client);
+}
+
+void CycleScheduler::finish(Client *client, int32_t now, double cost_us)
+{
+    Task *task = find(client);
+    if (!task)
+        return;
+
+    PluginCycle *cycle = client->getCycle();
+    bool requested = cycle && cycle->requested;
+    if (cycle)
+        cycle->requested = false;
+
+    task->cost_us = task->cost_us * 0.75 + cost_us * 0.25;
+
+    // out of schedule runs do not move the phase
+    if (requested && task->next_due > now)
+        return;
+
+    task->next_due += task->period;
+    if (task->next_due <= now)
+        task->next_due = now + task->period;
+
+    if (cost_us > budget_us && load(task, task->next_due) > 0)
+        place(task, task->next_due, std::max<int32_t>(1, task->period / 2));
+}
+
+bool CycleScheduler::getNextDue(Client *client, int32_t *tick) const
+{
+    for (auto &task : tasks)
+    {
+        if (task.client == client && task.placed)
+        {
+            *tick = task.next_due;
+            return true;
+        }
+    }
+    return false;
+}
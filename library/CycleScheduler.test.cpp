@@ -0,0 +1,169 @@
+#include "CycleScheduler.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    struct FakeClient : CycleScheduler::Client {
+        PluginCycle cycle;
+        bool enabled = true;
+        bool loaded = true;
+        int runs = 0;
+
+        FakeClient(int32_t period, int32_t cost_us) : cycle{period, cost_us, false} {}
+
+        PluginCycle *getCycle() override { return loaded ? &cycle : NULL; }
+        bool isCycleEnabled() override { return enabled; }
+    };
+
+    // one update as PluginManager::runCycles does it, with every cycle taking
+    // its declared cost. returns the clients that ran, in order.
+    std::vector<FakeClient *> run_tick(CycleScheduler &sched, int32_t now) {
+        std::vector<CycleScheduler::Client *> due;
+        sched.collect(now, &due);
+
+        std::vector<FakeClient *> ran;
+        double spent = 0;
+        for (size_t i = 0; i < due.size(); i++) {
+            if (sched.isOverBudget(i, spent))
+                break;
+            auto client = static_cast<FakeClient *>(due[i]);
+            client->runs++;
+            ran.push_back(client);
+            spent += client->cycle.cost_us;
+            sched.finish(client, now, client->cycle.cost_us);
+        }
+        return ran;
+    }
+}
+
+TEST(CycleScheduler, spreads_placement) {
+    CycleScheduler sched(2000);
+    std::vector<FakeClient> clients(8, FakeClient(100, 500));
+    for (auto &client : clients)
+        sched.add(&client);
+
+    for (int32_t tick = 0; tick < 1000; tick++)
+        ASSERT_LE(run_tick(sched, tick).size(), 1);
+
+    for (auto &client : clients)
+        ASSERT_EQ(client.runs, 10);
+}
+
+TEST(CycleScheduler, budget_overflow_runs_next_tick) {
+    CycleScheduler sched(1000);
+    // a period of one leaves no choice of tick
+    FakeClient a(1, 800), b(1, 800), c(1, 800);
+    sched.add(&a);
+    sched.add(&b);
+    sched.add(&c);
+
+    auto ran = run_tick(sched, 0);
+    ASSERT_EQ(ran.size(), 2);
+    ASSERT_EQ(ran[0], &a);
+    ASSERT_EQ(ran[1], &b);
+
+    // the cycle that did not fit is the most overdue one now
+    ran = run_tick(sched, 1);
+    ASSERT_EQ(ran.size(), 2);
+    ASSERT_EQ(ran[0], &c);
+}
+
+TEST(CycleScheduler, first_cycle_always_runs) {
+    CycleScheduler sched(100);
+    FakeClient slow(10, 5000);
+    sched.add(&slow);
+    ASSERT_EQ(run_tick(sched, 0).size(), 1);
+}
+
+TEST(CycleScheduler, period_change) {
+    CycleScheduler sched(2000);
+    FakeClient client(100, 100);
+    sched.add(&client);
+    run_tick(sched, 0);
+
+    int32_t next = 0;
+    ASSERT_TRUE(sched.getNextDue(&client, &next));
+    ASSERT_EQ(next, 100);
+
+    // changed by the plugin between runs: placed again within the new
+    // period, here right away since nothing else is scheduled
+    client.cycle.period = 30;
+    ASSERT_EQ(run_tick(sched, 10).size(), 1);
+    ASSERT_TRUE(sched.getNextDue(&client, &next));
+    ASSERT_EQ(next, 40);
+
+    // re-registered with a new period, e.g. on reload
+    client.cycle.period = 200;
+    sched.add(&client);
+    ASSERT_FALSE(sched.getNextDue(&client, &next));
+    client.runs = 0;
+    for (int32_t tick = 50; tick < 1050; tick++)
+        run_tick(sched, tick);
+    ASSERT_EQ(client.runs, 5);
+}
+
+TEST(CycleScheduler, requested_runs) {
+    CycleScheduler sched(2000);
+    FakeClient client(1000, 100);
+    sched.add(&client);
+    run_tick(sched, 0);
+    ASSERT_EQ(client.runs, 1);
+
+    client.cycle.requested = true;
+    ASSERT_EQ(run_tick(sched, 10).size(), 1);
+    ASSERT_FALSE(client.cycle.requested);
+
+    // out of schedule runs keep the phase
+    int32_t next = 0;
+    ASSERT_TRUE(sched.getNextDue(&client, &next));
+    ASSERT_EQ(next, 1000);
+    ASSERT_EQ(run_tick(sched, 11).size(), 0);
+
+    // disabled cycles drop the request without running
+    client.enabled = false;
+    client.cycle.requested = true;
+    ASSERT_EQ(run_tick(sched, 12).size(), 0);
+    ASSERT_FALSE(client.cycle.requested);
+}
+
+TEST(CycleScheduler, disabled_keeps_phase) {
+    CycleScheduler sched(2000);
+    FakeClient client(100, 100);
+    sched.add(&client);
+    run_tick(sched, 0);
+
+    client.enabled = false;
+    ASSERT_EQ(run_tick(sched, 100).size(), 0);
+    int32_t next = 0;
+    ASSERT_TRUE(sched.getNextDue(&client, &next));
+    ASSERT_EQ(next, 200);
+
+    client.enabled = true;
+    ASSERT_EQ(run_tick(sched, 200).size(), 1);
+}
+
+TEST(CycleScheduler, unloaded_clients_are_dropped) {
+    CycleScheduler sched(2000);
+    FakeClient client(10, 100);
+    sched.add(&client);
+    client.loaded = false;
+    ASSERT_EQ(run_tick(sched, 0).size(), 0);
+    int32_t next = 0;
+    ASSERT_FALSE(sched.getNextDue(&client, &next));
+}
+
+TEST(CycleScheduler, new_world_resets_phases) {
+    CycleScheduler sched(2000);
+    FakeClient client(100, 100);
+    sched.add(&client);
+    run_tick(sched, 5000);
+
+    // the frame counter went back
+    ASSERT_EQ(run_tick(sched, 10).size(), 1);
+    int32_t next = 0;
+    ASSERT_TRUE(sched.getNextDue(&client, &next));
+    ASSERT_EQ(next, 110);
+}
@@ -24,6 +24,8 @@ distribution.
 
 #include "Internal.h"
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
@@ -259,6 +261,103 @@ static std::map<std::string, virtual_identity*> name_lookup;
 /* Vtable pointer to identity lookup. */
 std::map<void*, virtual_identity*> virtual_identity::known;
 
+/*
+ * Lock-free copy of the known table for readers.
+ *
+ * Every virtual_cast ends up in virtual_identity::find, so lookups must not
+ * take known_mutex. The copy is an open addressed hash table of atomic slots
+ * that is kept at most half full. Writers hold known_mutex; they fill empty
+ * slots in place, or publish a rebuilt table when the current one gets too
+ * full or an entry has to be removed. Replaced tables are never freed since
+ * a reader may still be probing them, but this only happens a handful of
+ * times per session.
+ */
+namespace {
+    struct vtable_slot {
+        std::atomic<void*> vtable;
+        std::atomic<virtual_identity*> identity;
+    };
+
+    struct vtable_table {
+        size_t mask;
+        size_t used = 0;
+        std::unique_ptr<vtable_slot[]> slots;
+
+        explicit vtable_table(size_t size) : mask(size-1), slots(new vtable_slot[size]) {}
+    };
+}
+
+static std::atomic<vtable_table*> vtable_cache{NULL};
+static std::vector<std::unique_ptr<vtable_table>> vtable_cache_tables;
+
+static inline size_t vtable_hash(void *vtable)
+{
+    uint64_t h = uintptr_t(vtable);
+    h ^= h >> 17;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return size_t(h ^ (h >> 29));
+}
+
+static bool vtable_cache_lookup(void *vtable, virtual_identity **out)
+{
+    vtable_table *table = vtable_cache.load(std::memory_order_acquire);
+    if (!table)
+        return false;
+
+    for (size_t i = vtable_hash(vtable) & table->mask;; i = (i+1) & table->mask)
+    {
+        void *key = table->slots[i].vtable.load(std::memory_order_acquire);
+        if (key == vtable) {
+            *out = table->slots[i].identity.load(std::memory_order_relaxed);
+            return true;
+        }
+        if (!key)
+            return false;
+    }
+}
+
+static void vtable_table_put(vtable_table *table, void *vtable, virtual_identity *identity)
+{
+    for (size_t i = vtable_hash(vtable) & table->mask;; i = (i+1) & table->mask)
+    {
+        auto &slot = table->slots[i];
+        void *key = slot.vtable.load(std::memory_order_relaxed);
+        if (key == vtable || !key) {
+            slot.identity.store(identity, std::memory_order_relaxed);
+            if (!key) {
+                slot.vtable.store(vtable, std::memory_order_release);
+                table->used++;
+            }
+            return;
+        }
+    }
+}
+
+// Called with known_mutex held, after virtual_identity::known has been modified.
+static void vtable_cache_rebuild(const std::map<void*, virtual_identity*> &known)
+{
+    size_t size = 64;
+    while (size < known.size() * 4)
+        size *= 2;
+
+    auto table = new vtable_table(size);
+    for (auto &entry : known)
+        vtable_table_put(table, entry.first, entry.second);
+
+    vtable_cache_tables.emplace_back(table);
+    vtable_cache.store(table, std::memory_order_release);
+}
+
+static void vtable_cache_put(const std::map<void*, virtual_identity*> &known,
+                             void *vtable, virtual_identity *identity)
+{
+    vtable_table *table = vtable_cache.load(std::memory_order_relaxed);
+    if (!table || (table->used + 1) * 2 > table->mask + 1)
+        vtable_cache_rebuild(known);
+    else
+        vtable_table_put(table, vtable, identity);
+}
+
 virtual_identity::~virtual_identity()
 {
     // Remove interpose entries, so that they don't try accessing this object later
@@ -273,7 +372,11 @@ virtual_identity::~virtual_identity()
         name_lookup.erase(getOriginalName());
 
         if (vtable_ptr)
+        {
+            tthread::lock_guard<tthread::mutex> lock(*known_mutex);
             known.erase(vtable_ptr);
+            vtable_cache_rebuild(known);
+        }
     }
 }
 
@@ -286,7 +389,11 @@ void virtual_identity::doInit(Core *core)
 
     vtable_ptr = core->vinfo->getVTable(vtname);
     if (vtable_ptr)
+    {
+        tthread::lock_guard<tthread::mutex> lock(*known_mutex);
         known[vtable_ptr] = this;
+        vtable_cache_put(known, vtable_ptr, this);
+    }
 }
 
 virtual_identity *virtual_identity::find(const std::string &name)
@@ -308,16 +415,20 @@ virtual_identity *virtual_identity::find(void *vtable)
     if (!vtable)
         return NULL;
 
-    // Actually, a reader/writer lock would be sufficient,
-    // since the table is only written once per class.
+    // Fast path: each vtable is only resolved once, after that
+    // the lookup does not need to take the lock.
+    virtual_identity *cached;
+    if (vtable_cache_lookup(vtable, &cached))
+        return cached;
+
     tthread::lock_guard<tthread::mutex> lock(*known_mutex);
 
+    // Another thread may have resolved it while we waited for the lock
     std::map<void*, virtual_identity*>::iterator it = known.find(vtable);
 
     if (it != known.end())
         return it->second;
 
-    // If using a reader/writer lock, re-grab as write here, and recheck
     Core &core = Core::getInstance();
     std::string name = core.p->doReadClassName(vtable);
 
@@ -338,6 +449,7 @@ virtual_identity *virtual_identity::find(void *vtable)
         }
 
         known[vtable] = p;
+        vtable_cache_put(known, vtable, p);
         p->vtable_ptr = vtable;
         return p;
     }
@@ -346,6 +458,7 @@ virtual_identity *virtual_identity::find(void *vtable)
               << std::hex << uintptr_t(vtable) << std::dec << std::endl;
 
     known[vtable] = NULL;
+    vtable_cache_put(known, vtable, NULL);
     return NULL;
 }
 
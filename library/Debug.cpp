@@ -24,21 +24,14 @@ redistribute it freely, subject to the following restrictions:
 #include "Core.h"
 
 #include "Debug.h"
+#include "DebugLogSink.h"
 #include "DebugManager.h"
 
 #include <algorithm>
 #include <chrono>
-#include <iomanip>
+#include <sstream>
 #include <thread>
 
-#ifdef _MSC_VER
-static tm* localtime_r(const time_t* time, tm* result)
-{
-    localtime_s(result, time);
-    return result;
-}
-#endif
-
 namespace DFHack {
 DBG_DECLARE(core,debug);
 
@@ -108,62 +101,76 @@ static std::atomic<uint32_t> nextId{0};
 static EXEC_ATTR thread_local uint32_t thread_id{nextId.fetch_add(1)+1};
 }
 
+//! Debug streams that end up in the console can use the asynchronous sink
+static bool writesToConsole(color_ostream& target)
+{
+    color_ostream* out = &target;
+    while (!out->is_console()) {
+        out = out->proxy_target();
+        if (!out)
+            return false;
+    }
+    return true;
+}
+
 DebugCategory::ostream_proxy_prefix::ostream_proxy_prefix(
         const DebugCategory& cat,
         color_ostream& target,
         const DebugCategory::level msgLevel) :
-    color_ostream_proxy(target)
+    color_ostream_proxy(target),
+    cat_(cat),
+    level_(msgLevel),
+    async_(false),
+    headerPending_(false),
+    time_(std::chrono::system_clock::now())
 {
     DebugManager &dm = DebugManager::getInstance();
     const DebugManager::HeaderConfig &config = dm.getHeaderConfig();
 
     color(selectColor(msgLevel));
 
-    bool has_header = false;
-    if (config.timestamp) {
-        has_header = true;
-        auto now = std::chrono::system_clock::now();
-        tm local{};
-        //! \todo c++ 2020 will have std::chrono::to_stream(fmt, system_clock::now())
-        //! but none implements it yet.
-        std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-        // Output time in format %02H:%02M:%02S.%03ms
-#if __GNUC__ < 5
-        // Fallback for gcc 4
-        char buffer[32];
-        size_t sz = strftime(buffer, sizeof(buffer)/sizeof(buffer[0]),
-                             "%T", localtime_r(&now_c, &local));
-        *this << (sz > 0 ? buffer : "HH:MM:SS");
-#else
-        *this << std::put_time(localtime_r(&now_c, &local),"%T");
-#endif
-        if (config.timestamp_ms) {
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now.time_since_epoch()) % 1000;
-            *this << '.' << std::setfill('0') << std::setw(3) << ms.count();
-        }
-        *this << ':';
-    }
-    if (config.thread_id) {
-        has_header = true;
-        // Thread id is allocated in the thread creation order to a thread_local
-        // variable
-        *this << 't' << thread_id << ':';
-    }
-    if (config.plugin) {
-        has_header = true;
-        *this << cat.plugin() << ':';
+    if (DebugLogSink::getInstance().isActive() && writesToConsole(target)) {
+        // Header is formatted by the writer thread with the first chunk
+        async_ = true;
+        headerPending_ = true;
+        return;
     }
-    if (config.category) {
-        has_header = true;
-        *this << cat.category() << ':';
+
+    DebugLogSink::formatHeader(*this, config, time_, thread_id,
+            cat.plugin(), cat.category());
+}
+
+void DebugCategory::ostream_proxy_prefix::flush_proxy()
+{
+    if (!async_) {
+        color_ostream_proxy::flush_proxy();
+        return;
     }
-    // It would be easy to pass __FILE__ and __LINE__ from the logging macros
-    // and include that information as well, if we want to.
+    if (buffer.empty())
+        return;
 
-    if (has_header) {
-        *this << ' ';
+    DebugManager &dm = DebugManager::getInstance();
+    const DebugManager::HeaderConfig &config = dm.getHeaderConfig();
+    const DebugManager::HeaderConfig *header = headerPending_ ? &config : nullptr;
+    bool queued = DebugLogSink::getInstance().push(header,
+                selectColor(level_), time_, thread_id,
+                cat_.plugin(), cat_.category(), buffer);
+    headerPending_ = header != nullptr;
+    if (!queued) {
+        // Writer was stopped. Output the rest of the message directly.
+        async_ = false;
+        if (headerPending_) {
+            std::ostringstream header;
+            DebugLogSink::formatHeader(header, config, time_, thread_id,
+                    cat_.plugin(), cat_.category());
+            buffer.emplace_front(selectColor(level_), header.str());
+        }
+        headerPending_ = false;
+        color_ostream_proxy::flush_proxy();
+        return;
     }
+    headerPending_ = false;
+    buffer.clear();
 }
 
 
@@ -0,0 +1,595 @@
+/**
+Copyright © 2018 Pauli <suokkos@gmail.com>
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+   not claim that you wrote the original software. If you use this
+   software in a product, an acknowledgment in the product
+   documentation would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+   must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+   distribution.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "Core.h"
+
+#include "DebugLogSink.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+static tm* localtime_r(const time_t* time, tm* result)
+{
+    localtime_s(result, time);
+    return result;
+}
+#endif
+
+namespace DFHack {
+
+namespace {
+// Ring size per printing thread. Must be a power of two.
+constexpr size_t ringSize = 1 << 18;
+// Largest record stored in a ring. Longer text is split over several records.
+constexpr size_t maxChunk = ringSize / 4;
+
+enum RecordFlags : uint8_t {
+    FLAG_TIMESTAMP = 1 << 0,
+    FLAG_TIMESTAMP_MS = 1 << 1,
+    FLAG_THREAD_ID = 1 << 2,
+    FLAG_PLUGIN = 1 << 3,
+    FLAG_CATEGORY = 1 << 4,
+    // First chunk of a message which gets the header
+    FLAG_HEADER = 1 << 5,
+    // Padding to the end of the ring. Only size is valid.
+    FLAG_WRAP = 1 << 7,
+};
+
+// Fixed part of a record. Followed by plugin and category names and
+// fragments stored as color byte, 32 bit length and text.
+struct RecordHeader {
+    uint32_t size;
+    uint8_t flags;
+    int8_t headerColor;
+    uint16_t fragments;
+    uint32_t threadId;
+    uint16_t pluginLen;
+    uint16_t categoryLen;
+    int64_t time;
+};
+static_assert(sizeof(RecordHeader) % 8 == 0,
+        "Records are 8 byte aligned in the ring");
+
+constexpr size_t align8(size_t v) { return (v + 7) & ~size_t(7); }
+
+// Single producer, single consumer byte ring. head and tail grow
+// monotonically and are masked when indexing data.
+struct Ring {
+    std::unique_ptr<char[]> data{new char[ringSize]};
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    //! Set when the producer thread exits
+    std::atomic<bool> orphaned{false};
+};
+
+// Marks the ring orphaned when the thread exits so the writer can release it
+// after draining.
+struct RingHolder {
+    std::shared_ptr<Ring> ring;
+    ~RingHolder() {
+        if (ring)
+            ring->orphaned.store(true, std::memory_order_release);
+    }
+};
+thread_local RingHolder localRing;
+
+// A record to be queued: the first count fragments of a list, of which the
+// last one is cut to lastLen bytes
+struct Record {
+    const DebugManager::HeaderConfig* header;
+    color_value headerColor;
+    std::chrono::system_clock::time_point time;
+    uint32_t threadId;
+    const char* plugin;
+    size_t pluginLen;
+    const char* category;
+    size_t categoryLen;
+    uint16_t count;
+    size_t lastLen;
+    size_t size;
+};
+
+struct Message {
+    int64_t time;
+    uint8_t flags;
+    color_value headerColor;
+    uint32_t threadId;
+    std::string plugin;
+    std::string category;
+    std::vector<buffered_color_ostream::fragment_type> fragments;
+};
+}
+
+struct DebugLogSink::Private {
+    //! Protects everything below except file state owned by the writer
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    Config config;
+    std::thread writer;
+    bool stopping = false;
+    //! Incremented after every drain pass
+    uint64_t passes = 0;
+    std::condition_variable wakeup;
+    std::condition_variable drained;
+    //! Producers only notify the writer when it is waiting
+    std::atomic<bool> sleeping{false};
+    //! Cleared when stopping so new messages are written synchronously
+    std::atomic<bool> running{false};
+
+    // Owned by the writer thread
+    std::ofstream file;
+    std::string filePath;
+    size_t fileSize = 0;
+
+    Ring& ring();
+    bool pushRecord(const Record& rec,
+            const std::list<buffered_color_ostream::fragment_type>& fragments);
+    bool drain();
+    void write(std::vector<Message>& messages);
+    void openFile(const Config& config);
+    void rotateFile(const Config& config);
+    void run();
+};
+
+Ring& DebugLogSink::Private::ring()
+{
+    if (!localRing.ring) {
+        localRing.ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(localRing.ring);
+    }
+    return *localRing.ring;
+}
+
+DebugLogSink& DebugLogSink::getInstance()
+{
+    static DebugLogSink instance;
+    return instance;
+}
+
+DebugLogSink::DebugLogSink() :
+    d(new Private),
+    active_(false)
+{}
+
+DebugLogSink::~DebugLogSink()
+{
+    stop();
+}
+
+DebugLogSink::Config DebugLogSink::getConfig()
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->config;
+}
+
+void DebugLogSink::setConfig(const Config& config)
+{
+    bool enable = config.async || !config.file.empty();
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->config = config;
+        if (enable && !d->writer.joinable()) {
+            d->stopping = false;
+            d->running.store(true, std::memory_order_relaxed);
+            d->writer = std::thread(&Private::run, d.get());
+        }
+    }
+    if (enable) {
+        active_.store(true, std::memory_order_relaxed);
+        d->wakeup.notify_one();
+    } else {
+        stop();
+    }
+}
+
+bool DebugLogSink::push(const DebugManager::HeaderConfig*& header,
+        color_value headerColor,
+        std::chrono::system_clock::time_point time,
+        uint32_t threadId,
+        const char* plugin,
+        const char* category,
+        std::list<buffered_color_ostream::fragment_type>& fragments)
+{
+    if (!d->running.load(std::memory_order_acquire))
+        return false;
+    if (fragments.empty() && !header)
+        return true;
+
+    Record rec;
+    rec.header = header;
+    rec.headerColor = headerColor;
+    rec.time = time;
+    rec.threadId = threadId;
+    rec.plugin = plugin;
+    rec.pluginLen = std::min<size_t>(strlen(plugin), UINT8_MAX);
+    rec.category = category;
+    rec.categoryLen = std::min<size_t>(strlen(category), UINT8_MAX);
+    const size_t fixed = sizeof(RecordHeader) + rec.pluginLen + rec.categoryLen;
+    constexpr size_t fragmentHeader = 1 + sizeof(uint32_t);
+
+    // Text that does not fit into one record is split over several records.
+    // Only the first one carries the header.
+    do {
+        size_t size = fixed;
+        rec.count = 0;
+        rec.lastLen = 0;
+        for (auto& fragment : fragments) {
+            if (rec.count == UINT16_MAX || size + fragmentHeader >= maxChunk)
+                break;
+            rec.lastLen = std::min(fragment.second.size(),
+                    maxChunk - size - fragmentHeader);
+            size += fragmentHeader + rec.lastLen;
+            ++rec.count;
+        }
+        rec.size = align8(size);
+        if (!d->pushRecord(rec, fragments))
+            return false;
+        rec.header = header = nullptr;
+
+        // Remove the queued text so a caller that has to fall back to
+        // synchronous output only writes the rest
+        for (uint16_t i = 1; i < rec.count; ++i)
+            fragments.pop_front();
+        if (rec.count) {
+            auto& last = fragments.front().second;
+            if (rec.lastLen == last.size())
+                fragments.pop_front();
+            else
+                last.erase(0, rec.lastLen);
+        }
+    } while (!fragments.empty());
+    return true;
+}
+
+bool DebugLogSink::Private::pushRecord(const Record& rec,
+        const std::list<buffered_color_ostream::fragment_type>& fragments)
+{
+    Ring& r = ring();
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    size_t pos = head & (ringSize - 1);
+    size_t contiguous = ringSize - pos;
+    size_t needed = rec.size + (rec.size > contiguous ? contiguous : 0);
+    // Wait for the writer to make room. Messages are never dropped.
+    while (ringSize - (head - r.tail.load(std::memory_order_acquire)) < needed) {
+        if (!running.load(std::memory_order_acquire))
+            return false;
+        if (sleeping.load(std::memory_order_relaxed))
+            wakeup.notify_one();
+        std::this_thread::yield();
+    }
+
+    if (rec.size > contiguous) {
+        RecordHeader wrap{};
+        wrap.size = contiguous;
+        wrap.flags = FLAG_WRAP;
+        memcpy(&r.data[pos], &wrap, std::min(contiguous, sizeof(wrap)));
+        head += contiguous;
+        pos = 0;
+    }
+
+    char* out = &r.data[pos];
+    RecordHeader hdr{};
+    hdr.size = rec.size;
+    if (rec.header) {
+        hdr.flags = FLAG_HEADER |
+            (rec.header->timestamp ? FLAG_TIMESTAMP : 0) |
+            (rec.header->timestamp_ms ? FLAG_TIMESTAMP_MS : 0) |
+            (rec.header->thread_id ? FLAG_THREAD_ID : 0) |
+            (rec.header->plugin ? FLAG_PLUGIN : 0) |
+            (rec.header->category ? FLAG_CATEGORY : 0);
+    }
+    hdr.headerColor = rec.headerColor;
+    hdr.fragments = rec.count;
+    hdr.threadId = rec.threadId;
+    hdr.pluginLen = rec.pluginLen;
+    hdr.categoryLen = rec.categoryLen;
+    hdr.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            rec.time.time_since_epoch()).count();
+    memcpy(out, &hdr, sizeof(hdr));
+    out += sizeof(hdr);
+    memcpy(out, rec.plugin, rec.pluginLen);
+    out += rec.pluginLen;
+    memcpy(out, rec.category, rec.categoryLen);
+    out += rec.categoryLen;
+    auto fragment = fragments.begin();
+    for (uint16_t i = 0; i < rec.count; ++i, ++fragment) {
+        uint32_t len = i + 1 == rec.count ? rec.lastLen : fragment->second.size();
+        *out++ = (char)fragment->first;
+        memcpy(out, &len, sizeof(len));
+        out += sizeof(len);
+        memcpy(out, fragment->second.data(), len);
+        out += len;
+    }
+
+    r.head.store(head + rec.size, std::memory_order_release);
+    if (sleeping.load(std::memory_order_relaxed))
+        wakeup.notify_one();
+    return true;
+}
+
+bool DebugLogSink::Private::drain()
+{
+    std::vector<std::shared_ptr<Ring>> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = rings;
+    }
+
+    std::vector<Message> messages;
+    for (auto& r : current) {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            const char* in = &r->data[tail & (ringSize - 1)];
+            RecordHeader rec;
+            memcpy(&rec, in, sizeof(rec.size) + sizeof(rec.flags));
+            if (rec.flags & FLAG_WRAP) {
+                tail += rec.size;
+                continue;
+            }
+            memcpy(&rec, in, sizeof(rec));
+            in += sizeof(rec);
+            Message msg;
+            msg.time = rec.time;
+            msg.flags = rec.flags;
+            msg.headerColor = (color_value)rec.headerColor;
+            msg.threadId = rec.threadId;
+            msg.plugin.assign(in, rec.pluginLen);
+            in += rec.pluginLen;
+            msg.category.assign(in, rec.categoryLen);
+            in += rec.categoryLen;
+            msg.fragments.reserve(rec.fragments);
+            for (uint16_t i = 0; i < rec.fragments; ++i) {
+                color_value color = (color_value)(int8_t)*in++;
+                uint32_t len;
+                memcpy(&len, in, sizeof(len));
+                in += sizeof(len);
+                msg.fragments.emplace_back(color, std::string(in, len));
+                in += len;
+            }
+            messages.emplace_back(std::move(msg));
+            tail += rec.size;
+        }
+        r->tail.store(tail, std::memory_order_release);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.erase(std::remove_if(rings.begin(), rings.end(),
+                    [](const std::shared_ptr<Ring>& r) {
+                        return r->orphaned.load(std::memory_order_acquire) &&
+                            r->tail.load(std::memory_order_relaxed) ==
+                            r->head.load(std::memory_order_acquire);
+                    }),
+                rings.end());
+    }
+
+    if (messages.empty())
+        return false;
+    // Rings are drained one after another. Sorting keeps output from
+    // different threads in the order the messages were started.
+    std::stable_sort(messages.begin(), messages.end(),
+            [](const Message& a, const Message& b) { return a.time < b.time; });
+    write(messages);
+    return true;
+}
+
+void DebugLogSink::Private::openFile(const Config& config)
+{
+    if (file.is_open())
+        file.close();
+    filePath = config.file;
+    fileSize = 0;
+    if (filePath.empty())
+        return;
+    file.open(filePath, std::ios::out | std::ios::app | std::ios::binary);
+    if (file.is_open())
+        fileSize = file.tellp();
+}
+
+void DebugLogSink::Private::rotateFile(const Config& config)
+{
+    file.close();
+    if (config.file_count > 0) {
+        std::string last = filePath + "." + std::to_string(config.file_count);
+        std::remove(last.c_str());
+        for (unsigned i = config.file_count; i > 1; --i) {
+            std::string from = filePath + "." + std::to_string(i - 1);
+            std::string to = filePath + "." + std::to_string(i);
+            std::rename(from.c_str(), to.c_str());
+        }
+        std::string first = filePath + ".1";
+        std::rename(filePath.c_str(), first.c_str());
+    }
+    file.open(filePath, std::ios::out | std::ios::trunc | std::ios::binary);
+    fileSize = 0;
+}
+
+void DebugLogSink::Private::write(std::vector<Message>& messages)
+{
+    Config current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = config;
+    }
+    if (current.file != filePath)
+        openFile(current);
+
+    color_ostream_proxy out(Core::getInstance().getConsole());
+    std::ostringstream text;
+    for (auto& msg : messages) {
+        std::ostringstream header;
+        if (msg.flags & FLAG_HEADER) {
+            DebugManager::HeaderConfig config;
+            config.timestamp = msg.flags & FLAG_TIMESTAMP;
+            config.timestamp_ms = msg.flags & FLAG_TIMESTAMP_MS;
+            config.thread_id = msg.flags & FLAG_THREAD_ID;
+            config.plugin = msg.flags & FLAG_PLUGIN;
+            config.category = msg.flags & FLAG_CATEGORY;
+            std::chrono::system_clock::time_point time{
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::nanoseconds(msg.time))};
+            DebugLogSink::formatHeader(header, config, time, msg.threadId,
+                    msg.plugin.c_str(), msg.category.c_str());
+            out.color(msg.headerColor);
+            out << header.str();
+            text << header.str();
+        }
+        for (auto& fragment : msg.fragments) {
+            out.color(fragment.first);
+            out << fragment.second;
+            text << fragment.second;
+        }
+    }
+    out.reset_color();
+    out.flush();
+
+    if (!file.is_open())
+        return;
+    std::string data = text.str();
+    if (fileSize > 0 && fileSize + data.size() > current.file_max_size)
+        rotateFile(current);
+    file.write(data.data(), data.size());
+    file.flush();
+    fileSize += data.size();
+}
+
+void DebugLogSink::Private::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        bool stop = stopping;
+        lock.unlock();
+        bool worked = drain();
+        lock.lock();
+        ++passes;
+        drained.notify_all();
+        if (worked)
+            continue;
+        if (stop)
+            break;
+        sleeping.store(true, std::memory_order_relaxed);
+        wakeup.wait_for(lock, std::chrono::milliseconds(50));
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+    if (file.is_open())
+        file.close();
+    filePath.clear();
+}
+
+void DebugLogSink::flush()
+{
+    std::unique_lock<std::mutex> lock(d->mutex);
+    if (!d->running.load(std::memory_order_relaxed))
+        return;
+    // Two complete passes guarantee that everything queued before this call
+    // has been drained.
+    uint64_t target = d->passes + 2;
+    d->wakeup.notify_one();
+    d->drained.wait(lock, [this, target]() {
+        return d->passes >= target || !d->running.load(std::memory_order_relaxed);
+    });
+}
+
+void DebugLogSink::stop()
+{
+    active_.store(false, std::memory_order_relaxed);
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        if (!d->writer.joinable())
+            return;
+        d->stopping = true;
+        // Later messages fall back to synchronous output
+        d->running.store(false, std::memory_order_release);
+        writer = std::move(d->writer);
+    }
+    d->wakeup.notify_one();
+    writer.join();
+}
+
+void DebugLogSink::formatHeader(std::ostream& out,
+        const DebugManager::HeaderConfig& config,
+        std::chrono::system_clock::time_point time,
+        uint32_t threadId,
+        const char* plugin,
+        const char* category)
+{
+    bool has_header = false;
+    if (config.timestamp) {
+        has_header = true;
+        tm local{};
+        //! \todo c++ 2020 will have std::chrono::to_stream(fmt, system_clock::now())
+        //! but none implements it yet.
+        std::time_t time_c = std::chrono::system_clock::to_time_t(time);
+        // Output time in format %02H:%02M:%02S.%03ms
+#if __GNUC__ < 5
+        // Fallback for gcc 4
+        char buffer[32];
+        size_t sz = strftime(buffer, sizeof(buffer)/sizeof(buffer[0]),
+                             "%T", localtime_r(&time_c, &local));
+        out << (sz > 0 ? buffer : "HH:MM:SS");
+#else
+        out << std::put_time(localtime_r(&time_c, &local),"%T");
+#endif
+        if (config.timestamp_ms) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    time.time_since_epoch()) % 1000;
+            out << '.' << std::setfill('0') << std::setw(3) << ms.count();
+        }
+        out << ':';
+    }
+    if (config.thread_id) {
+        has_header = true;
+        // Thread id is allocated in the thread creation order to a thread_local
+        // variable
+        out << 't' << threadId << ':';
+    }
+    if (config.plugin) {
+        has_header = true;
+        out << plugin << ':';
+    }
+    if (config.category) {
+        has_header = true;
+        out << category << ':';
+    }
+    // It would be easy to pass __FILE__ and __LINE__ from the logging macros
+    // and include that information as well, if we want to.
+
+    if (has_header) {
+        out << ' ';
+    }
+}
+
+}
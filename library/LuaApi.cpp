@@ -1131,7 +1131,8 @@ static int dfhack_penarray_draw(lua_State *L)
     unsigned int h = (unsigned int)luaL_checkint(L, 5);
     unsigned int bufx = (unsigned int)luaL_optint(L, 6, 0);
     unsigned int bufy = (unsigned int)luaL_optint(L, 7, 0);
-    parr->draw(x, y, w, h, bufx, bufy);
+    bool map = lua_toboolean(L, 8);
+    parr->draw(x, y, w, h, bufx, bufy, map);
     return 0;
 }
 
@@ -1735,6 +1736,7 @@ static const LuaWrapper::FunctionReg dfhack_job_module[] = {
     WRAPM(Job,disconnectJobItem),
     WRAPM(Job,disconnectJobGeneralRef),
     WRAPM(Job,removeJob),
+    WRAPM(Job,countJobs),
     WRAPN(is_equal, jobEqual),
     WRAPN(is_item_equal, jobItemEqual),
     { NULL, NULL }
@@ -1757,8 +1759,15 @@ static int job_listNewlyCreated(lua_State *state)
         return 1;
 }
 
+static int job_getJobs(lua_State *state)
+{
+    Lua::PushVector(state, Job::getJobs());
+    return 1;
+}
+
 static const luaL_Reg dfhack_job_funcs[] = {
     { "listNewlyCreated", job_listNewlyCreated },
+    { "getJobs", job_getJobs },
     { NULL, NULL }
 };
 
@@ -2110,6 +2119,11 @@ static df::proj_itemst *items_makeProjectile(df::item *item)
     return Items::makeProjectile(mc, item);
 }
 
+static bool items_canTradeAnyWithContents(df::item *item)
+{
+    return Items::canTradeAnyWithContents(item);
+}
+
 static int16_t items_findType(std::string token)
 {
     DFHack::ItemTypeInfo result;
@@ -2144,7 +2158,7 @@ static const LuaWrapper::FunctionReg dfhack_items_module[] = {
     WRAPM(Items, checkMandates),
     WRAPM(Items, canTrade),
     WRAPM(Items, canTradeWithContents),
-    WRAPM(Items, canTradeAnyWithContents),
+    WRAPN(canTradeAnyWithContents, items_canTradeAnyWithContents),
     WRAPM(Items, markForTrade),
     WRAPM(Items, isRouteVehicle),
     WRAPM(Items, isSquadEquipment),
@@ -2235,6 +2249,13 @@ static void resetTileAssignment(df::tile_bitmask *bm, bool val) {
     else bm->clear();
 }
 
+static bool isReachableByCitizens(df::coord pos) {
+    return Maps::getCitizenWalkableGroups().isReachableFromAny(pos);
+}
+static bool isAdjacentReachableByCitizens(df::coord pos) {
+    return Maps::getCitizenWalkableGroups().isAdjacentReachable(pos);
+}
+
 static const LuaWrapper::FunctionReg dfhack_maps_module[] = {
     WRAPN(getBlock, (df::map_block* (*)(int32_t,int32_t,int32_t))Maps::getBlock),
     WRAPM(Maps, enableBlockUpdates),
@@ -2242,6 +2263,8 @@ static const LuaWrapper::FunctionReg dfhack_maps_module[] = {
     WRAPM(Maps, getLocalInitFeature),
     WRAPM(Maps, getWalkableGroup),
     WRAPM(Maps, canWalkBetween),
+    WRAPN(isReachableByCitizens, isReachableByCitizens),
+    WRAPN(isAdjacentReachableByCitizens, isAdjacentReachableByCitizens),
     WRAPM(Maps, spawnFlow),
     WRAPN(hasTileAssignment, hasTileAssignment),
     WRAPN(getTileAssignment, getTileAssignment),
@@ -2615,6 +2638,28 @@ static int screen_paintTile(lua_State *L)
     return 1;
 }
 
+static int screen_paintSpan(lua_State *L)
+{
+    int x = luaL_checkint(L, 1);
+    int y = luaL_checkint(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    bool map = lua_toboolean(L, 4);
+
+    std::vector<Pen> pens(lua_rawlen(L, 3));
+    for (size_t i = 0; i < pens.size(); i++)
+    {
+        lua_rawgeti(L, 3, i+1);
+        if (lua_toboolean(L, -1))
+            Lua::CheckPen(L, &pens[i], lua_gettop(L));
+        else
+            pens[i].tile = -1; // skip this tile
+        lua_pop(L, 1);
+    }
+
+    lua_pushboolean(L, Screen::paintSpan(pens.data(), pens.size(), x, y, map));
+    return 1;
+}
+
 static int screen_readTile(lua_State *L)
 {
     int x = luaL_checkint(L, 1);
@@ -2811,6 +2856,7 @@ static const luaL_Reg dfhack_screen_funcs[] = {
     { "getMousePixels", screen_getMousePixels },
     { "getWindowSize", screen_getWindowSize },
     { "paintTile", screen_paintTile },
+    { "paintSpan", screen_paintSpan },
     { "readTile", screen_readTile },
     { "paintString", screen_paintString },
     { "fillRect", screen_fillRect },
@@ -3606,6 +3652,16 @@ static int internal_findScript(lua_State *L)
     return 1;
 }
 
+static int internal_getScriptsVersion(lua_State *L)
+{
+    uint64_t version = Core::getInstance().getScriptsVersion();
+    if (version)
+        lua_pushinteger(L, version);
+    else
+        lua_pushnil(L);
+    return 1;
+}
+
 static int internal_listPlugins(lua_State *L)
 {
     auto plugins = Core::getInstance().getPluginManager();
@@ -3782,6 +3838,7 @@ static const luaL_Reg dfhack_internal_funcs[] = {
     { "removeScriptPath", internal_removeScriptPath },
     { "getScriptPaths", internal_getScriptPaths },
     { "findScript", internal_findScript },
+    { "getScriptsVersion", internal_getScriptsVersion },
     { "listPlugins", internal_listPlugins },
     { "listCommands", internal_listCommands },
     { "getCommandHelp", internal_getCommandHelp },
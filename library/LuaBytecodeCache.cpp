@@ -0,0 +1,302 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+// Cache of compiled Lua chunks. Files loaded through loadfile() and require()
+// are compiled once and the lua_dump() output is stored in hack/cache/lua,
+// keyed by the source path, size and modification time. Later loads read the
+// bytecode instead of parsing the source again.
+
+#include "Core.h"
+#include "LuaTools.h"
+#include "modules/Filesystem.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DFHack;
+
+namespace {
+    const char CACHE_MAGIC[8] = { 'D', 'F', 'H', 'L', 'U', 'A', 'C', 1 };
+
+    struct CacheHeader
+    {
+        char magic[8];
+        char lua_release[16];
+        int64_t source_size;
+        int64_t source_mtime;
+        uint32_t path_size;
+        uint32_t code_size;
+    };
+
+    std::atomic<size_t> cache_hits{0};
+    std::atomic<size_t> cache_misses{0};
+    std::atomic<uint32_t> tmp_counter{0};
+
+    std::once_flag init_flag;
+    bool cache_enabled = false;
+    std::string cache_dir;
+
+    void init_cache()
+    {
+        if (getenv("DFHACK_NO_LUA_CACHE"))
+            return;
+        cache_dir = Core::getInstance().getHackPath() + "cache/lua/";
+        cache_enabled = Filesystem::mkdir_recursive(cache_dir);
+    }
+
+    // nanosecond resolution where available, so edits within the same second
+    // are still noticed
+    int64_t stat_mtime(const STAT_STRUCT &info)
+    {
+#ifdef LINUX_BUILD
+        return int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#else
+        return int64_t(info.st_mtime);
+#endif
+    }
+
+    std::string cache_file(const std::string &path)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : path)
+        {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.luac", (unsigned long long)hash);
+        return cache_dir + name;
+    }
+
+    void fill_header(CacheHeader *header, const std::string &path,
+                     const STAT_STRUCT &info, size_t code_size)
+    {
+        memset(header, 0, sizeof(*header));
+        memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+        strncpy(header->lua_release, LUA_RELEASE, sizeof(header->lua_release) - 1);
+        header->source_size = int64_t(info.st_size);
+        header->source_mtime = stat_mtime(info);
+        header->path_size = uint32_t(path.size());
+        header->code_size = uint32_t(code_size);
+    }
+
+    bool read_cache(const std::string &cfile, const std::string &path,
+                    const STAT_STRUCT &info, std::vector<char> *code)
+    {
+        FILE *f = fopen(cfile.c_str(), "rb");
+        if (!f)
+            return false;
+
+        CacheHeader header, expected;
+        fill_header(&expected, path, info, 0);
+
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+            !memcmp(&header, &expected, offsetof(CacheHeader, code_size));
+        if (ok)
+        {
+            std::string stored_path(header.path_size, '\0');
+            code->resize(header.code_size);
+            ok = fread(&stored_path[0], 1, stored_path.size(), f) == stored_path.size() &&
+                stored_path == path &&
+                fread(code->data(), 1, code->size(), f) == code->size();
+        }
+
+        fclose(f);
+        return ok;
+    }
+
+    int dump_writer(lua_State *, const void *p, size_t sz, void *ud)
+    {
+        auto buf = (std::vector<char> *)ud;
+        buf->insert(buf->end(), (const char *)p, (const char *)p + sz);
+        return 0;
+    }
+
+    void write_cache(lua_State *L, const std::string &cfile,
+                     const std::string &path, const STAT_STRUCT &info)
+    {
+        std::vector<char> code;
+        if (lua_dump(L, dump_writer, &code, 0) != 0 || code.empty())
+            return;
+
+        CacheHeader header;
+        fill_header(&header, path, info, code.size());
+
+        // write to a private file and rename it into place, so other lua
+        // states never see a partially written cache file
+        char suffix[48];
+        snprintf(suffix, sizeof(suffix), ".%zx.%u.tmp",
+                 std::hash<std::thread::id>()(std::this_thread::get_id()),
+                 unsigned(tmp_counter++));
+        std::string tmp = cfile + suffix;
+
+        FILE *f = fopen(tmp.c_str(), "wb");
+        if (!f)
+            return;
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(path.data(), 1, path.size(), f) == path.size() &&
+            fwrite(code.data(), 1, code.size(), f) == code.size();
+        ok = (fclose(f) == 0) && ok;
+
+#ifndef LINUX_BUILD
+        if (ok)
+            remove(cfile.c_str());
+#endif
+        if (!ok || rename(tmp.c_str(), cfile.c_str()) != 0)
+            remove(tmp.c_str());
+    }
+
+    // precompiled files are not cached again
+    bool is_source_file(const char *filename)
+    {
+        FILE *f = fopen(filename, "rb");
+        if (!f)
+            return false;
+        int c = fgetc(f);
+        fclose(f);
+        return c != LUA_SIGNATURE[0];
+    }
+}
+
+int DFHack::Lua::LoadFileCached(lua_State *L, const char *filename, const char *mode)
+{
+    std::call_once(init_flag, init_cache);
+
+    // stdin, binary only loads, or the cache is unavailable
+    if (!cache_enabled || !filename || (mode && !strchr(mode, 't')))
+        return luaL_loadfilex(L, filename, mode);
+
+    // a text only mode (e.g. dfhack.run_script) refuses precompiled files.
+    // cached bytecode is only ever compiled from the source file it is keyed
+    // on, so it can still be used once the file itself is known to be source.
+    bool text_only = mode && !strchr(mode, 'b');
+    if (text_only && !is_source_file(filename))
+        return luaL_loadfilex(L, filename, mode);
+
+    STAT_STRUCT info;
+    if (!Filesystem::stat(filename, info))
+        return luaL_loadfilex(L, filename, mode);
+
+    std::string path(filename);
+    std::string cfile = cache_file(path);
+
+    std::vector<char> code;
+    if (read_cache(cfile, path, info, &code))
+    {
+        std::string chunkname = "@" + path;
+        if (luaL_loadbufferx(L, code.data(), code.size(), chunkname.c_str(), "b") == LUA_OK)
+        {
+            cache_hits++;
+            return LUA_OK;
+        }
+        // written by an incompatible lua build; replaced below
+        lua_pop(L, 1);
+    }
+
+    int status = luaL_loadfilex(L, filename, mode);
+    if (status != LUA_OK)
+        return status;
+
+    cache_misses++;
+    if (text_only || is_source_file(filename))
+        write_cache(L, cfile, path, info);
+    return LUA_OK;
+}
+
+void DFHack::Lua::GetBytecodeCacheStats(size_t *hits, size_t *misses)
+{
+    *hits = cache_hits.load();
+    *misses = cache_misses.load();
+}
+
+// loadfile([filename [, mode [, env]]]) using the cache
+static int lua_cached_loadfile(lua_State *L)
+{
+    const char *fname = luaL_optstring(L, 1, NULL);
+    const char *mode = luaL_optstring(L, 2, NULL);
+    int env = (!lua_isnone(L, 3) ? 3 : 0);
+
+    if (Lua::LoadFileCached(L, fname, mode) != LUA_OK)
+    {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+
+    if (env)
+    {
+        lua_pushvalue(L, env);
+        if (!lua_setupvalue(L, -2, 1))
+            lua_pop(L, 1);
+    }
+    return 1;
+}
+
+// replacement for the package.searchers entry that loads lua files
+static int lua_cached_searcher(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getfield(L, lua_upvalueindex(1), "searchpath");
+    lua_pushvalue(L, 1);
+    lua_getfield(L, lua_upvalueindex(1), "path");
+    if (!lua_isstring(L, -1))
+        luaL_error(L, "'package.path' must be a string");
+    lua_call(L, 2, 2);
+
+    // not found: return the list of tried files
+    if (lua_isnil(L, -2))
+        return 1;
+
+    lua_pop(L, 1);
+    const char *filename = lua_tostring(L, -1);
+    if (Lua::LoadFileCached(L, filename, NULL) != LUA_OK)
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                          name, filename, lua_tostring(L, -1));
+
+    lua_pushvalue(L, -2);
+    return 2;
+}
+
+void DFHack::Lua::InstallBytecodeCache(lua_State *L)
+{
+    lua_pushcfunction(L, lua_cached_loadfile);
+    lua_setglobal(L, "loadfile");
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, lua_cached_searcher, 1);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 2);
+}
@@ -1806,6 +1806,7 @@ lua_State *DFHack::Lua::Open(color_ostream &out, lua_State *state)
     interrupt_init(state);
 
     luaL_openlibs(state);
+    InstallBytecodeCache(state);
     AttachDFGlobals(state);
 
     // Table of query coroutines
@@ -24,11 +24,13 @@ distribution.
 
 #include "modules/EventManager.h"
 #include "modules/Filesystem.h"
+#include "modules/ItemSweep.h"
 #include "modules/Screen.h"
 #include "Internal.h"
 #include "Core.h"
 #include "MemAccess.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "RemoteServer.h"
 #include "Console.h"
 #include "Types.h"
@@ -41,9 +43,17 @@ distribution.
 #include "LuaWrapper.h"
 #include "LuaTools.h"
 
+#include "df/world.h"
+
 using namespace DFHack;
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
 using namespace std;
@@ -188,19 +198,28 @@ Plugin::Plugin(Core * core, const std::string & path,
      parent(pm)
 {
     plugin_lib = 0;
+    opened_lib = 0;
     plugin_init = 0;
     plugin_globals = 0;
     plugin_shutdown = 0;
     plugin_status = 0;
     plugin_onupdate = 0;
+    plugin_oncycle = 0;
+    plugin_cycle = 0;
     plugin_onstatechange = 0;
     plugin_rpcconnect = 0;
     plugin_enable = 0;
     plugin_is_enabled = 0;
     plugin_save_data = 0;
     plugin_load_data = 0;
+    plugin_export_state = 0;
+    plugin_import_state = 0;
+    update_stats = Profiler::getStats("onupdate/" + name);
+    cycle_stats = Profiler::getStats("oncycle/" + name);
+    state_change_stats = Profiler::getStats("onstatechange/" + name);
     state = PS_UNLOADED;
     access = new RefLock();
+    open_ms = init_ms = 0;
 }
 
 Plugin::~Plugin()
@@ -248,6 +267,15 @@ bool Plugin::load(color_ostream &con)
     }
     // enter suspend
     CoreSuspender suspend;
+    return open(con) && init(con);
+}
+
+// Opens the library and checks that it was built for this DFHack. Touches
+// nothing but this plugin, so loadAll runs it on several threads at once.
+bool Plugin::open(color_ostream &con)
+{
+    auto start = std::chrono::steady_clock::now();
+    open_ms = init_ms = 0;
     // open the library, etc
     fprintf(stderr, "loading plugin %s\n", name.c_str());
     DFLibrary * plug = OpenPlugin(path.c_str());
@@ -349,6 +377,10 @@ bool Plugin::load(color_ostream &con)
     }
     plugin_status = (command_result (*)(color_ostream &, std::string &)) LookupPlugin(plug, "plugin_status");
     plugin_onupdate = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_onupdate");
+    plugin_oncycle = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_oncycle");
+    plugin_cycle = (PluginCycle*) LookupPlugin(plug, "plugin_cycle");
+    if (!plugin_cycle)
+        plugin_oncycle = 0;
     plugin_shutdown = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_shutdown");
     plugin_onstatechange = (command_result (*)(color_ostream &, state_change_event)) LookupPlugin(plug, "plugin_onstatechange");
     plugin_rpcconnect = (RPCService* (*)(color_ostream &)) LookupPlugin(plug, "plugin_rpcconnect");
@@ -356,17 +388,45 @@ bool Plugin::load(color_ostream &con)
     plugin_is_enabled = (bool*) LookupPlugin(plug, "plugin_is_enabled");
     plugin_save_data = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_save_data");
     plugin_load_data = (command_result (*)(color_ostream &)) LookupPlugin(plug, "plugin_load_data");
+    plugin_export_state = (command_result (*)(color_ostream &, int32_t &, std::string &)) LookupPlugin(plug, "plugin_export_state");
+    plugin_import_state = (command_result (*)(color_ostream &, int32_t, const std::string &)) LookupPlugin(plug, "plugin_import_state");
+    opened_lib = plug;
+    open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// Runs plugin_init on a library prepared by open. Called with the core
+// suspended.
+bool Plugin::init(color_ostream &con)
+{
+    auto start = std::chrono::steady_clock::now();
+    DFLibrary *plug = opened_lib;
+    opened_lib = 0;
+    // Lua events that are still bound from a previous load are rebound to
+    // Lua::Core::State here, so this must not happen in open
     index_lua(plug);
     plugin_lib = plug;
+    const char ** plug_git_desc_ptr = (const char**) LookupPlugin(plug, "plugin_git_description");
+    const char *plug_git_desc = plug_git_desc_ptr ? *plug_git_desc_ptr : "unknown";
     commands.clear();
-    if(plugin_init(con,commands) == CR_OK)
+    command_result cr = plugin_init(con,commands);
+    init_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(cr == CR_OK)
     {
         RefAutolock lock(access);
         state = PS_LOADED;
         parent->registerCommands(this);
-        if ((plugin_onupdate || plugin_enable) && !plugin_is_enabled)
+        if ((plugin_onupdate || plugin_oncycle || plugin_enable) && !plugin_is_enabled)
             con.printerr("Plugin %s has no enabled var!\n", name.c_str());
-        if (Core::getInstance().isWorldLoaded() && plugin_load_data && plugin_load_data(con) != CR_OK)
+        if (plugin_oncycle)
+            parent->registerCycle(this);
+        // state handed over by the previous instance replaces the saved data,
+        // unless the plugin cannot use it
+        bool imported = false;
+        if (handoff.valid && plugin_import_state)
+            imported = plugin_import_state(con, handoff.version, handoff.data) == CR_OK;
+        handoff = StateHandoff();
+        if (!imported && Core::getInstance().isWorldLoaded() && plugin_load_data && plugin_load_data(con) != CR_OK)
             con.printerr("Plugin %s has failed to load saved data.\n", name.c_str());
         fprintf(stderr, "loaded plugin %s; DFHack build %s\n", name.c_str(), plug_git_desc);
         fflush(stderr);
@@ -377,13 +437,23 @@ bool Plugin::load(color_ostream &con)
         con.printerr("Plugin %s has failed to initialize properly.\n", name.c_str());
         plugin_is_enabled = 0;
         plugin_onupdate = 0;
+        plugin_oncycle = 0;
+        plugin_cycle = 0;
         reset_lua();
+        plugin_lib = 0;
         plugin_abort_load;
         return false;
     }
 }
 
 bool Plugin::unload(color_ostream &con)
+{
+    return unload_library(con, false);
+}
+
+// With handoff_state set, the plugin may export state for the instance that
+// replaces it; see Plugin::reload.
+bool Plugin::unload_library(color_ostream &con, bool handoff_state)
 {
     // get the mutex
     access->lock();
@@ -397,6 +467,7 @@ bool Plugin::unload(color_ostream &con)
             return false;
         }
         EventManager::unregisterAll(this);
+        ItemSweep::unsubscribeAll(this);
         // notify the plugin about an attempt to shutdown
         if (plugin_onstatechange &&
             plugin_onstatechange(con, SC_BEGIN_UNLOAD) != CR_OK)
@@ -414,6 +485,13 @@ bool Plugin::unload(color_ostream &con)
         access->lock();
         if (Core::getInstance().isWorldLoaded() && plugin_save_data && plugin_save_data(con) != CR_OK)
             con.printerr("Plugin %s has failed to save data.\n", name.c_str());
+        handoff = StateHandoff();
+        if (handoff_state && plugin_export_state)
+        {
+            handoff.valid = plugin_export_state(con, handoff.version, handoff.data) == CR_OK;
+            if (!handoff.valid)
+                handoff = StateHandoff();
+        }
         // notify plugin about shutdown, if it has a shutdown function
         command_result cr = CR_OK;
         if(plugin_shutdown)
@@ -421,8 +499,12 @@ bool Plugin::unload(color_ostream &con)
         // cleanup...
         plugin_is_enabled = 0;
         plugin_onupdate = 0;
+        plugin_oncycle = 0;
+        plugin_cycle = 0;
         plugin_save_data = 0;
         plugin_load_data = 0;
+        plugin_export_state = 0;
+        plugin_import_state = 0;
         reset_lua();
         parent->unregisterCommands(this);
         commands.clear();
@@ -456,11 +538,10 @@ bool Plugin::reload(color_ostream &out)
 {
     if(state != PS_LOADED)
         return false;
-    if(!unload(out))
-        return false;
-    if(!load(out))
-        return false;
-    return true;
+    bool ok = unload_library(out, true) && load(out);
+    // never offered to a later, unrelated load
+    handoff = StateHandoff();
+    return ok;
 }
 
 command_result Plugin::invoke(color_ostream &out, const std::string & command, std::vector <std::string> & parameters)
@@ -546,6 +627,7 @@ command_result Plugin::on_update(color_ostream &out)
     access->lock_add();
     if(state == PS_LOADED && plugin_onupdate)
     {
+        Profiler::ScopedTimer timer(update_stats);
         cr = plugin_onupdate(out);
         Lua::Core::Reset(out, "plugin_onupdate");
     }
@@ -553,6 +635,24 @@ command_result Plugin::on_update(color_ostream &out)
     return cr;
 }
 
+command_result Plugin::on_cycle(color_ostream &out)
+{
+    if (!plugin_oncycle)
+        return CR_NOT_IMPLEMENTED;
+    if (plugin_is_enabled && !*plugin_is_enabled)
+        return CR_OK;
+    command_result cr = CR_NOT_IMPLEMENTED;
+    access->lock_add();
+    if(state == PS_LOADED && plugin_oncycle)
+    {
+        Profiler::ScopedTimer timer(cycle_stats);
+        cr = plugin_oncycle(out);
+        Lua::Core::Reset(out, "plugin_oncycle");
+    }
+    access->lock_sub();
+    return cr;
+}
+
 command_result Plugin::set_enabled(color_ostream &out, bool enable)
 {
     command_result cr = CR_NOT_IMPLEMENTED;
@@ -574,6 +674,7 @@ command_result Plugin::on_state_change(color_ostream &out, state_change_event ev
     access->lock_add();
     if(state == PS_LOADED && plugin_onstatechange)
     {
+        Profiler::ScopedTimer timer(state_change_stats);
         cr = plugin_onstatechange(out, event);
         Lua::Core::Reset(out, "plugin_onstatechange");
     }
@@ -824,6 +925,10 @@ PluginManager::PluginManager(Core * core) : core(core)
 {
     plugin_mutex = new tthread::recursive_mutex();
     cmdlist_mutex = new tthread::mutex();
+    const char *budget = getenv("DFHACK_CYCLE_BUDGET_US");
+    cycles = new CycleScheduler(budget ? atof(budget) : 2000.0);
+    cycles_mutex = new tthread::mutex();
+    load_total_ms = 0;
 }
 
 PluginManager::~PluginManager()
@@ -836,6 +941,8 @@ PluginManager::~PluginManager()
     all_plugins.clear();
     delete plugin_mutex;
     delete cmdlist_mutex;
+    delete cycles;
+    delete cycles_mutex;
 }
 
 void PluginManager::init()
@@ -921,20 +1028,91 @@ bool PluginManager::load (const string &name)
     return p->load(core->getConsole());
 }
 
+static size_t getLoadThreads()
+{
+    if (const char *env = getenv("DFHACK_PLUGIN_LOAD_THREADS"))
+        return std::max(1, atoi(env));
+    return std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+}
+
 bool PluginManager::loadAll()
 {
     MUTEX_GUARD(plugin_mutex);
+    auto start = std::chrono::steady_clock::now();
     auto files = listPlugins();
     bool ok = true;
-    // load all plugins in hack/plugins
+    color_ostream &con = core->getConsole();
+
+    // claim the plugins in hack/plugins that are not loaded yet
+    std::vector<Plugin *> pending;
     for (auto f = files.begin(); f != files.end(); ++f)
     {
-        if (!load(*f))
+        if (!(*this)[*f] && !addPlugin(*f))
+        {
+            ok = false;
+            continue;
+        }
+        Plugin *p = (*this)[*f];
+        {
+            Plugin::RefAutolock lock(p->access);
+            if (p->state == Plugin::PS_UNLOADED || p->state == Plugin::PS_DELETED)
+            {
+                p->state = Plugin::PS_LOADING;
+                pending.push_back(p);
+                continue;
+            }
+        }
+        // already loaded, or broken
+        if (!p->load(con))
             ok = false;
     }
+
+    // open the libraries on several threads; their messages are buffered and
+    // printed in load order below
+    std::vector<buffered_color_ostream> output(pending.size());
+    std::vector<char> opened(pending.size(), 0);
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < pending.size(); )
+        {
+            opened[i] = pending[i]->open(output[i]);
+            output[i].flush();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < std::min(getLoadThreads(), pending.size()); i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+
+    // plugin_init runs on this thread, one plugin at a time
+    CoreSuspender suspend;
+    load_timeline.clear();
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        for (auto &fragment : output[i].fragments())
+        {
+            con.color(fragment.first);
+            con << fragment.second;
+        }
+        con.reset_color();
+        if (!opened[i] || !pending[i]->init(con))
+            ok = false;
+        load_timeline.push_back({ pending[i]->name, pending[i]->open_ms,
+            pending[i]->init_ms, pending[i]->getState() == Plugin::PS_LOADED });
+    }
+    load_total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     return ok;
 }
 
+void PluginManager::getLoadTimeline(std::vector<PluginLoadTime> *timeline, double *total_ms)
+{
+    MUTEX_GUARD(plugin_mutex);
+    *timeline = load_timeline;
+    *total_ms = load_total_ms;
+}
+
 bool PluginManager::unload (const string &name)
 {
     MUTEX_GUARD(plugin_mutex);
@@ -964,8 +1142,11 @@ bool PluginManager::reload (const string &name)
     // equivalent to "unload(name); load(name);" if plugin is recognized,
     // "load(name);" otherwise
     MUTEX_GUARD(plugin_mutex);
-    if (!(*this)[name])
+    Plugin *p = (*this)[name];
+    if (!p)
         return load(name);
+    if (p->getState() == Plugin::PS_LOADED)
+        return p->reload(core->getConsole());
     if (!unload(name))
         return false;
     return load(name);
@@ -975,10 +1156,15 @@ bool PluginManager::reloadAll()
 {
     MUTEX_GUARD(plugin_mutex);
     bool ok = true;
-    if (!unloadAll())
-        ok = false;
+    for (auto it = begin(); it != end(); ++it)
+    {
+        if (!it->second->unload_library(core->getConsole(), true))
+            ok = false;
+    }
     if (!loadAll())
         ok = false;
+    for (auto it = begin(); it != end(); ++it)
+        it->second->handoff = Plugin::StateHandoff();
     return ok;
 }
 
@@ -1009,14 +1195,61 @@ void PluginManager::OnUpdate(color_ostream &out)
 {
     for (auto it = begin(); it != end(); ++it)
         it->second->on_update(out);
+
+    runCycles(out);
 }
 
 void PluginManager::OnStateChange(color_ostream &out, state_change_event event)
 {
+    if (event == SC_WORLD_LOADED || event == SC_WORLD_UNLOADED)
+    {
+        tthread::lock_guard<tthread::mutex> lock(*cycles_mutex);
+        cycles->reset();
+    }
+
     for (auto it = begin(); it != end(); ++it)
         it->second->on_state_change(out, event);
 }
 
+void PluginManager::registerCycle(Plugin *p)
+{
+    tthread::lock_guard<tthread::mutex> lock(*cycles_mutex);
+    cycles->add(p);
+}
+
+void PluginManager::runCycles(color_ostream &out)
+{
+    using df::global::world;
+    if (!Core::getInstance().isWorldLoaded() || !world)
+        return;
+
+    typedef std::chrono::steady_clock clock;
+    auto elapsed_us = [](clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    };
+
+    int32_t now = world->frame_counter;
+    std::vector<CycleScheduler::Client *> due;
+    {
+        tthread::lock_guard<tthread::mutex> lock(*cycles_mutex);
+        cycles->collect(now, &due);
+    }
+
+    auto start = clock::now();
+    for (size_t i = 0; i < due.size(); i++)
+    {
+        if (cycles->isOverBudget(i, elapsed_us(start)))
+            break;
+
+        auto run_start = clock::now();
+        static_cast<Plugin *>(due[i])->on_cycle(out);
+        double cost = elapsed_us(run_start);
+
+        tthread::lock_guard<tthread::mutex> lock(*cycles_mutex);
+        cycles->finish(due[i], now, cost);
+    }
+}
+
 void PluginManager::registerCommands( Plugin * p )
 {
     cmdlist_mutex->lock();
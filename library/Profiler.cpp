@@ -0,0 +1,190 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace DFHack;
+using namespace DFHack::Profiler;
+
+std::atomic<bool> Profiler::enabled{false};
+
+static std::mutex registry_mutex;
+static std::once_flag calibrate_once;
+static double ns_per_tick = 1.0;
+
+static std::map<std::string, std::unique_ptr<Stats>> &registry()
+{
+    static std::map<std::string, std::unique_ptr<Stats>> stats;
+    return stats;
+}
+
+static inline int floor_log2(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return (int)idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static size_t bucket_index(uint64_t ticks)
+{
+    if (ticks < 8)
+        return (size_t)ticks;
+    int msb = floor_log2(ticks);
+    size_t idx = (msb - 2) * 8 + ((ticks >> (msb - 3)) & 7);
+    return std::min(idx, Stats::HISTOGRAM_BUCKETS - 1);
+}
+
+static void calibrate()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    auto clock_start = std::chrono::steady_clock::now();
+    uint64_t tick_start = ticks();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto clock_end = std::chrono::steady_clock::now();
+    uint64_t tick_end = ticks();
+    auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_end - clock_start).count();
+    if (tick_end > tick_start && elapsed_ns > 0)
+        ns_per_tick = double(elapsed_ns) / double(tick_end - tick_start);
+#endif
+}
+
+uint64_t Profiler::toNs(uint64_t ticks)
+{
+    return uint64_t(ticks * ns_per_tick);
+}
+
+static uint64_t bucket_lower_bound(size_t idx)
+{
+    if (idx < 8)
+        return idx;
+    int msb = idx / 8 + 2;
+    return (uint64_t)(8 + idx % 8) << (msb - 3);
+}
+
+Stats::Stats(const std::string &name) : name(name)
+{
+    reset();
+}
+
+void Stats::reset()
+{
+    calls = 0;
+    total_ticks = 0;
+    max_ticks = 0;
+    std::fill(std::begin(histogram), std::end(histogram), 0);
+    std::fill(std::begin(window), std::end(window), 0);
+    window_pos = 0;
+}
+
+void Stats::add(uint64_t ticks)
+{
+    calls++;
+    total_ticks += ticks;
+    if (ticks > max_ticks)
+        max_ticks = ticks;
+    histogram[bucket_index(ticks)]++;
+    window[window_pos] = (uint32_t)std::min<uint64_t>(ticks, UINT32_MAX);
+    window_pos = (window_pos + 1) % WINDOW_SIZE;
+}
+
+uint64_t Stats::percentileNs(double fraction) const
+{
+    if (!calls)
+        return 0;
+    uint64_t target = std::max<uint64_t>(1, (uint64_t)(fraction * calls));
+    uint64_t seen = 0;
+    for (size_t i = 0; i + 1 < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram[i];
+        if (seen >= target)
+            return toNs(std::min(max_ticks, bucket_lower_bound(i + 1) - 1));
+    }
+    return toNs(max_ticks);
+}
+
+uint64_t Stats::windowAverageNs() const
+{
+    size_t count = std::min<uint64_t>(calls, WINDOW_SIZE);
+    if (!count)
+        return 0;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += window[i];
+    return toNs(sum / count);
+}
+
+uint64_t Stats::windowMaxNs() const
+{
+    size_t count = std::min<uint64_t>(calls, WINDOW_SIZE);
+    return count ? toNs(*std::max_element(window, window + count)) : 0;
+}
+
+void Profiler::setEnabled(bool enable)
+{
+    if (enable)
+        std::call_once(calibrate_once, calibrate);
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &entry : registry())
+        entry.second->reset();
+}
+
+Stats *Profiler::getStats(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto &stats = registry()[name];
+    if (!stats)
+        stats.reset(new Stats(name));
+    return stats.get();
+}
+
+void Profiler::listStats(std::vector<const Stats *> *out)
+{
+    out->clear();
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &entry : registry())
+        {
+            if (entry.second->calls)
+                out->push_back(entry.second.get());
+        }
+    }
+    std::stable_sort(out->begin(), out->end(),
+        [](const Stats *a, const Stats *b) { return a->total_ticks > b->total_ticks; });
+}
@@ -0,0 +1,33 @@
+#include "Profiler.h"
+#include <gtest/gtest.h>
+
+using namespace DFHack;
+
+TEST(Profiler, stats) {
+    Profiler::Stats stats("test");
+    ASSERT_EQ(stats.calls, 0);
+    ASSERT_EQ(stats.percentileNs(0.5), 0);
+    ASSERT_EQ(stats.windowAverageNs(), 0);
+
+    for (uint64_t i = 1; i <= 1000; i++)
+        stats.add(i);
+
+    ASSERT_EQ(stats.calls, 1000);
+    ASSERT_EQ(stats.total_ticks, 500500);
+    ASSERT_EQ(stats.max_ticks, 1000);
+
+    uint64_t p50 = stats.percentileNs(0.5);
+    uint64_t p99 = stats.percentileNs(0.99);
+    ASSERT_LE(p50, p99);
+    ASSERT_LE(p99, stats.maxNs());
+
+    stats.reset();
+    ASSERT_EQ(stats.calls, 0);
+    ASSERT_EQ(stats.total_ticks, 0);
+}
+
+TEST(Profiler, registry) {
+    Profiler::Stats *a = Profiler::getStats("test/a");
+    ASSERT_EQ(a, Profiler::getStats("test/a"));
+    ASSERT_NE(a, Profiler::getStats("test/b"));
+}
@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 
+#include <algorithm>
 #include <stdarg.h>
 #include <errno.h>
 #include <stdio.h>
@@ -94,6 +95,7 @@ RemoteClient::RemoteClient(color_ostream *default_output)
     active = false;
     socket = new CActiveSocket();
     suspend_ready = false;
+    batch_ready = false;
 
     if (!p_default_output)
     {
@@ -312,6 +314,184 @@ int RemoteClient::resume_game()
         return -1;
 }
 
+command_result RemoteClient::subscribe(color_ostream &out, const dfproto::CoreSubscribeRequest &request)
+{
+    if (!active || !socket->IsSocketValid())
+    {
+        out.printerr("In Subscribe: client connection not valid.\n");
+        return CR_LINK_FAILURE;
+    }
+
+    if (!subscribe_call.isValid() && !subscribe_call.bind(out, this, "Subscribe"))
+        return CR_NOT_IMPLEMENTED;
+
+    return subscribe_call(out, &request);
+}
+
+static bool waitReadable(CSimpleSocket *socket, int timeout_ms)
+{
+    SOCKET fd = socket->GetSocketDescriptor();
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(fd, &read_set);
+
+    timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    return select(int(fd) + 1, &read_set, NULL, NULL, &timeout) > 0;
+}
+
+bool RemoteClient::read_notification(dfproto::CoreChangeNotification *notification, int timeout_ms)
+{
+    if (!active)
+        return false;
+
+    while (notifications.empty())
+    {
+        if (!socket->IsSocketValid() || !waitReadable(socket, std::max(timeout_ms, 0)))
+            return false;
+
+        RPCMessageHeader header;
+        if (!readFullBuffer(socket, &header, sizeof(header)))
+            return false;
+
+        if (header.size < 0 || header.size > RPCMessageHeader::MAX_MESSAGE_SIZE)
+        {
+            default_output().printerr("In notification: invalid received size %d.\n", header.size);
+            socket->Close();
+            return false;
+        }
+
+        // RPC_REPLY_FAIL stores the error code in size
+        int size = (DFHack::DFHackReplyCode)header.id == RPC_REPLY_FAIL ? 0 : header.size;
+        std::string data(size, '\0');
+        if (size > 0 && !readFullBuffer(socket, &data[0], size))
+            return false;
+
+        // Only notifications are sent without a call in progress
+        if ((DFHack::DFHackReplyCode)header.id == RPC_REPLY_NOTIFY)
+            notifications.push_back(std::move(data));
+    }
+
+    bool ok = notification->ParseFromString(notifications.front());
+    notifications.pop_front();
+    return ok;
+}
+
+void RemoteBatch::add(RemoteFunctionBase *function,
+                      const message_type *input, message_type *output)
+{
+    Call call;
+    call.function = function;
+    call.input = input ? input : function->in();
+    call.output = output ? output : function->out();
+    call.result = CR_NOT_IMPLEMENTED;
+    calls.push_back(call);
+}
+
+command_result RemoteBatch::execute()
+{
+    if (!client)
+        return CR_NOT_IMPLEMENTED;
+    return execute(client->default_output());
+}
+
+command_result RemoteBatch::execute(color_ostream &out)
+{
+    if (!client || !client->active)
+    {
+        out.printerr("In RunBatch: client connection not valid.\n");
+        return CR_LINK_FAILURE;
+    }
+
+    if (!client->batch_ready)
+    {
+        client->batch_ready = true;
+        // Older servers don't have RunBatch; calls are made one by one then
+        buffered_color_ostream discard;
+        client->batch_call.bind(discard, client, "RunBatch");
+    }
+
+    command_result rv = CR_OK;
+
+    if (!client->batch_call.isValid())
+    {
+        for (auto &call : calls)
+        {
+            call.result = call.function->execute(out, call.input, call.output);
+            if (rv == CR_OK)
+                rv = call.result;
+        }
+        return rv;
+    }
+
+    auto &batch_call = client->batch_call;
+    batch_call.reset();
+
+    std::vector<Call*> sent;
+    for (auto &call : calls)
+    {
+        call.output->Clear();
+
+        if (!call.function->isValid())
+        {
+            out.printerr("Calling an unbound RPC function %s::%s.\n",
+                         call.function->plugin.c_str(), call.function->name.c_str());
+            call.result = CR_NOT_IMPLEMENTED;
+            continue;
+        }
+
+        auto in = batch_call.in()->add_calls();
+        in->set_id(call.function->id);
+        call.input->SerializeToString(in->mutable_input());
+        sent.push_back(&call);
+    }
+
+    command_result res = batch_call(out);
+
+    auto reply = batch_call.out();
+    if (res == CR_OK && reply->results_size() != (int)sent.size())
+    {
+        out.printerr("In RunBatch: expected %zu results but received %d.\n",
+                     sent.size(), reply->results_size());
+        res = CR_LINK_FAILURE;
+    }
+
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        Call *call = sent[i];
+
+        if (res != CR_OK)
+        {
+            call->result = res;
+            continue;
+        }
+
+        auto &result = reply->results(i);
+        call->result = command_result(result.result());
+
+        if (call->result == CR_OK && !call->output->ParseFromString(result.output()))
+        {
+            out.printerr("In call to %s::%s: error parsing received result.\n",
+                         call->function->plugin.c_str(), call->function->name.c_str());
+            call->result = CR_LINK_FAILURE;
+        }
+    }
+
+    // Don't keep large batches around
+    batch_call.reset(batch_call.in()->ByteSize() > 32*1024 ||
+                     reply->ByteSize() > 128*1024);
+
+    for (auto &call : calls)
+    {
+        if (call.result != CR_OK)
+            return call.result;
+    }
+
+    return CR_OK;
+}
+
 void RPCFunctionBase::reset(bool free)
 {
     if (free)
@@ -451,6 +631,10 @@ command_result RemoteFunctionBase::execute(color_ostream &out,
             delete[] buf;
             return CR_OK;
 
+        case RPC_REPLY_NOTIFY:
+            p_client->notifications.emplace_back((const char*)buf, header.size);
+            break;
+
         case RPC_REPLY_TEXT:
             text_data.Clear();
             if (text_data.ParseFromArray(buf, header.size))
@@ -53,12 +53,29 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "MiscUtils.h"
 #include "Debug.h"
 
+#include "modules/EventManager.h"
+#include "modules/Items.h"
+#include "modules/Maps.h"
+
+#include "df/building.h"
+#include "df/construction.h"
+#include "df/item.h"
+#include "df/job.h"
+#include "df/map_block.h"
+#include "df/report.h"
+#include "df/unit.h"
+#include "df/world.h"
+
 #include <cstdio>
 #include <cstdlib>
 #include <sstream>
 
+#include <algorithm>
+#include <bitset>
+#include <condition_variable>
 #include <memory>
 #include <thread>
+#include <unordered_map>
 
 #include "json/json.h"
 
@@ -164,7 +181,13 @@ ServerConnection::ServerConnection(CActiveSocket *socket)
 
 ServerConnection::~ServerConnection()
 {
+    // the notification sender may be blocked sending to a client that has
+    // stopped reading; shutting the socket down makes that send fail, so
+    // unsubscribe() can join the sender thread
     in_error = true;
+    socket->Shutdown(CSimpleSocket::Both);
+    unsubscribe();
+
     socket->Close();
     delete socket;
 
@@ -208,6 +231,494 @@ ServerFunctionBase *ServerConnection::findFunction(color_ostream &out, const std
     return svc->getFunction(name);
 }
 
+bool ServerConnection::isAllowed(ServerFunctionBase *fn)
+{
+    return (fn->flags & SF_ALLOW_REMOTE) == SF_ALLOW_REMOTE ||
+           strcmp(socket->GetClientAddr(), "127.0.0.1") == 0;
+}
+
+command_result ServerConnection::runBatch(color_ostream &stream,
+                                          const dfproto::CoreBatchRequest *in,
+                                          dfproto::CoreBatchReply *out)
+{
+    std::unique_ptr<CoreSuspender> suspend;
+
+    for (int i = 0; i < in->calls_size(); i++)
+    {
+        auto &call = in->calls(i);
+        auto result = out->add_results();
+
+        ServerFunctionBase *fn = vector_get(functions, call.id());
+        command_result res = CR_FAILURE;
+
+        if (!fn)
+        {
+            stream.printerr("RPC call of invalid id %d\n", call.id());
+        }
+        else if (fn->p_in_template == &dfproto::CoreBatchRequest::default_instance())
+        {
+            stream.printerr("In call to %s: batches cannot be nested.\n", fn->name);
+        }
+        else if (!isAllowed(fn))
+        {
+            stream.printerr("In call to %s: forbidden host: %s\n", fn->name, socket->GetClientAddr());
+        }
+        else if (!fn->in()->ParseFromString(call.input()))
+        {
+            stream.printerr("In call to %s: could not decode input args.\n", fn->name);
+        }
+        else
+        {
+            if (fn->flags & SF_DONT_SUSPEND)
+            {
+                // These manage locking themselves, like they do outside a batch
+                suspend.reset();
+            }
+            else if (!suspend)
+            {
+                suspend.reset(new CoreSuspender());
+            }
+
+            res = fn->execute(stream);
+
+            if (res == CR_OK)
+                fn->out()->SerializeToString(result->mutable_output());
+        }
+
+        result->set_result(res);
+
+        if (fn)
+        {
+            fn->reset((fn->flags & SF_CALLED_ONCE) ||
+                      (result->output().size() > 128*1024 || call.input().size() > 32*1024));
+        }
+    }
+
+    return CR_OK;
+}
+
+/* Change notifications */
+
+namespace {
+    // Subscribed block regions are scanned every tick, so keep them small
+    const size_t MAX_SUBSCRIBED_BLOCKS = 4096;
+    // Pending events kept for a client that does not read them
+    const int MAX_PENDING_EVENTS = 65536;
+
+    typedef std::bitset<EventManager::EventType::EVENT_MAX> event_set;
+}
+
+struct ServerConnection::Subscription {
+    ServerConnection *owner;
+
+    // Guarded by subscriptions_mutex
+    event_set events;
+    bool blocks = false;
+    bool has_region = false;
+    df::coord region_min, region_max;
+    dfproto::CoreChangeNotification collecting;
+    bool collected = false;
+    // Block coordinate key -> last seen block and tile state hash
+    std::unordered_map<uint64_t, std::pair<df::map_block*, uint64_t>> block_hashes;
+
+    // Hand-off to the sender thread
+    std::mutex mutex;
+    std::condition_variable cond;
+    dfproto::CoreChangeNotification pending;
+    bool has_pending = false;
+    bool closing = false;
+    std::thread sender;
+
+    bool inRegion(const df::coord &pos) const
+    {
+        return !has_region || !pos.isValid() ||
+            (pos.x >= region_min.x && pos.x <= region_max.x &&
+             pos.y >= region_min.y && pos.y <= region_max.y &&
+             pos.z >= region_min.z && pos.z <= region_max.z);
+    }
+
+    void run();
+};
+
+static std::mutex subscriptions_mutex;
+static std::vector<ServerConnection::Subscription*> subscriptions;
+static std::atomic<int> subscription_count{0};
+
+void ServerConnection::Subscription::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        cond.wait(lock, [this] { return has_pending || closing; });
+        if (closing)
+            break;
+
+        dfproto::CoreChangeNotification msg;
+        msg.Swap(&pending);
+        has_pending = false;
+
+        lock.unlock();
+        bool ok = owner->sendNotification(msg);
+        lock.lock();
+
+        if (!ok)
+            break;
+    }
+}
+
+static void describeEvent(EventManager::EventType::EventType type, void *data,
+                          int32_t *id, df::coord *pos)
+{
+    using namespace EventManager;
+
+    auto unit_pos = [pos](int32_t unit_id) {
+        if (auto unit = df::unit::find(unit_id))
+            *pos = unit->pos;
+    };
+    auto report_pos = [pos](int32_t report_id) {
+        if (auto report = df::report::find(report_id))
+            *pos = report->pos;
+    };
+
+    switch (type)
+    {
+    case EventType::JOB_INITIATED:
+    case EventType::JOB_STARTED:
+    case EventType::JOB_COMPLETED:
+    {
+        auto job = (df::job*)data;
+        *id = job->id;
+        *pos = job->pos;
+        break;
+    }
+    case EventType::UNIT_NEW_ACTIVE:
+    case EventType::UNIT_DEATH:
+        *id = (int32_t)(intptr_t)data;
+        unit_pos(*id);
+        break;
+    case EventType::ITEM_CREATED:
+        *id = (int32_t)(intptr_t)data;
+        if (auto item = df::item::find(*id))
+            *pos = Items::getPosition(item);
+        break;
+    case EventType::BUILDING:
+        *id = (int32_t)(intptr_t)data;
+        if (auto bld = df::building::find(*id))
+            *pos = df::coord(bld->centerx, bld->centery, bld->z);
+        break;
+    case EventType::CONSTRUCTION:
+        *pos = ((df::construction*)data)->pos;
+        break;
+    case EventType::SYNDROME:
+        *id = ((SyndromeData*)data)->unitId;
+        unit_pos(*id);
+        break;
+    case EventType::INVASION:
+        *id = (int32_t)(intptr_t)data;
+        break;
+    case EventType::INVENTORY_CHANGE:
+        *id = ((InventoryChangeData*)data)->unitId;
+        unit_pos(*id);
+        break;
+    case EventType::REPORT:
+        *id = (int32_t)(intptr_t)data;
+        report_pos(*id);
+        break;
+    case EventType::UNIT_ATTACK:
+        *id = ((UnitAttackData*)data)->report_id;
+        report_pos(*id);
+        break;
+    case EventType::INTERACTION:
+        *id = ((InteractionData*)data)->attackReport;
+        report_pos(*id);
+        break;
+    case EventType::TICK:
+    case EventType::UNLOAD:
+    case EventType::EVENT_MAX:
+        break;
+    }
+}
+
+template<EventManager::EventType::EventType type>
+static void onSubscribedEvent(color_ostream &out, void *data)
+{
+    int32_t id = -1;
+    df::coord pos;
+    describeEvent(type, data, &id, &pos);
+
+    std::lock_guard<std::mutex> lock(subscriptions_mutex);
+    for (auto sub : subscriptions)
+    {
+        if (!sub->events[type] || !sub->inRegion(pos))
+            continue;
+
+        auto event = sub->collecting.add_events();
+        event->set_type(type);
+        if (id >= 0)
+            event->set_id(id);
+        if (pos.isValid())
+        {
+            event->set_x(pos.x);
+            event->set_y(pos.y);
+            event->set_z(pos.z);
+        }
+        sub->collected = true;
+    }
+}
+
+static EventManager::EventHandler::callback_t getEventCallback(EventManager::EventType::EventType type)
+{
+    using namespace EventManager;
+
+    switch (type)
+    {
+    case EventType::JOB_INITIATED: return onSubscribedEvent<EventType::JOB_INITIATED>;
+    case EventType::JOB_STARTED: return onSubscribedEvent<EventType::JOB_STARTED>;
+    case EventType::JOB_COMPLETED: return onSubscribedEvent<EventType::JOB_COMPLETED>;
+    case EventType::UNIT_NEW_ACTIVE: return onSubscribedEvent<EventType::UNIT_NEW_ACTIVE>;
+    case EventType::UNIT_DEATH: return onSubscribedEvent<EventType::UNIT_DEATH>;
+    case EventType::ITEM_CREATED: return onSubscribedEvent<EventType::ITEM_CREATED>;
+    case EventType::BUILDING: return onSubscribedEvent<EventType::BUILDING>;
+    case EventType::CONSTRUCTION: return onSubscribedEvent<EventType::CONSTRUCTION>;
+    case EventType::SYNDROME: return onSubscribedEvent<EventType::SYNDROME>;
+    case EventType::INVASION: return onSubscribedEvent<EventType::INVASION>;
+    case EventType::INVENTORY_CHANGE: return onSubscribedEvent<EventType::INVENTORY_CHANGE>;
+    case EventType::REPORT: return onSubscribedEvent<EventType::REPORT>;
+    case EventType::UNIT_ATTACK: return onSubscribedEvent<EventType::UNIT_ATTACK>;
+    case EventType::UNLOAD: return onSubscribedEvent<EventType::UNLOAD>;
+    case EventType::INTERACTION: return onSubscribedEvent<EventType::INTERACTION>;
+    case EventType::TICK:
+    case EventType::EVENT_MAX:
+        break;
+    }
+    return nullptr;
+}
+
+static uint64_t hashBlock(const df::map_block *block)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void *data, size_t size) {
+        const uint8_t *ptr = (const uint8_t*)data;
+        for (size_t i = 0; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, ptr + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ULL;
+            hash ^= hash >> 29;
+        }
+    };
+    mix(block->tiletype, sizeof(block->tiletype));
+    mix(block->designation, sizeof(block->designation));
+    mix(block->occupancy, sizeof(block->occupancy));
+    return hash;
+}
+
+static void scanBlocks(ServerConnection::Subscription *sub)
+{
+    int32_t size_x, size_y, size_z;
+    Maps::getSize(size_x, size_y, size_z);
+
+    int32_t min_x = std::max(0, sub->region_min.x >> 4);
+    int32_t min_y = std::max(0, sub->region_min.y >> 4);
+    int32_t min_z = std::max(0, (int32_t)sub->region_min.z);
+    int32_t max_x = std::min(size_x - 1, sub->region_max.x >> 4);
+    int32_t max_y = std::min(size_y - 1, sub->region_max.y >> 4);
+    int32_t max_z = std::min(size_z - 1, (int32_t)sub->region_max.z);
+
+    for (int32_t z = min_z; z <= max_z; z++)
+    for (int32_t y = min_y; y <= max_y; y++)
+    for (int32_t x = min_x; x <= max_x; x++)
+    {
+        df::map_block *block = Maps::getBlock(x, y, z);
+        uint64_t hash = block ? hashBlock(block) : 0;
+        uint64_t key = (uint64_t(x) << 42) | (uint64_t(y) << 21) | uint64_t(z);
+
+        auto it = sub->block_hashes.find(key);
+        if (it == sub->block_hashes.end())
+        {
+            // First scan after subscribing only records the state
+            sub->block_hashes.emplace(key, std::make_pair(block, hash));
+            continue;
+        }
+        if (it->second.first == block && it->second.second == hash)
+            continue;
+
+        it->second = std::make_pair(block, hash);
+        sub->collecting.add_blocks(x);
+        sub->collecting.add_blocks(y);
+        sub->collecting.add_blocks(z);
+        sub->collected = true;
+    }
+}
+
+void ServerNotifier::onUpdate(color_ostream &out)
+{
+    // EventManager listeners registered for the current subscriptions.
+    // Only touched on the simulation thread.
+    static event_set registered;
+
+    if (!subscription_count.load(std::memory_order_relaxed) && registered.none())
+        return;
+
+    std::lock_guard<std::mutex> lock(subscriptions_mutex);
+
+    event_set wanted;
+    for (auto sub : subscriptions)
+        wanted |= sub->events;
+
+    for (int i = 0; i < EventManager::EventType::EVENT_MAX; i++)
+    {
+        if (wanted[i] == registered[i])
+            continue;
+
+        auto type = (EventManager::EventType::EventType)i;
+        EventManager::EventHandler handler(getEventCallback(type), 0);
+        if (wanted[i])
+            EventManager::registerListener(type, handler, nullptr);
+        else
+            EventManager::unregister(type, handler, nullptr);
+    }
+    registered = wanted;
+
+    bool map_valid = Maps::IsValid();
+    int32_t tick = df::global::world ? df::global::world->frame_counter : 0;
+
+    for (auto sub : subscriptions)
+    {
+        if (sub->blocks && map_valid)
+            scanBlocks(sub);
+
+        if (!sub->collected)
+            continue;
+
+        sub->collecting.set_tick(tick);
+        {
+            std::lock_guard<std::mutex> sub_lock(sub->mutex);
+            if (sub->pending.events_size() + sub->collecting.events_size() > MAX_PENDING_EVENTS)
+            {
+                sub->pending.Clear();
+                sub->pending.set_tick(tick);
+                sub->pending.set_overflow(true);
+            }
+            else
+            {
+                sub->pending.MergeFrom(sub->collecting);
+            }
+            sub->has_pending = true;
+        }
+        sub->cond.notify_one();
+
+        sub->collecting.Clear();
+        sub->collected = false;
+    }
+}
+
+command_result ServerConnection::subscribe(color_ostream &stream,
+                                           const dfproto::CoreSubscribeRequest *in)
+{
+    event_set events;
+    for (int i = 0; i < in->events_size(); i++)
+    {
+        int type = in->events(i);
+        if (type <= EventManager::EventType::TICK || type >= EventManager::EventType::EVENT_MAX)
+        {
+            stream.printerr("Cannot subscribe to event type %d.\n", type);
+            return CR_WRONG_USAGE;
+        }
+        events.set(type);
+    }
+
+    df::coord region_min, region_max;
+    if (in->has_region())
+    {
+        auto &region = in->region();
+        region_min = df::coord(region.min_x(), region.min_y(), region.min_z());
+        region_max = df::coord(region.max_x(), region.max_y(), region.max_z());
+    }
+
+    if (in->blocks())
+    {
+        if (!in->has_region())
+        {
+            stream.printerr("Subscribing to block changes requires a region.\n");
+            return CR_WRONG_USAGE;
+        }
+
+        int64_t count = int64_t((region_max.x >> 4) - (region_min.x >> 4) + 1) *
+                        int64_t((region_max.y >> 4) - (region_min.y >> 4) + 1) *
+                        int64_t(region_max.z - region_min.z + 1);
+        if (count <= 0 || count > int64_t(MAX_SUBSCRIBED_BLOCKS))
+        {
+            stream.printerr("Block change region must cover 1 to %zu blocks.\n",
+                            MAX_SUBSCRIBED_BLOCKS);
+            return CR_WRONG_USAGE;
+        }
+    }
+
+    if (events.none() && !in->blocks())
+    {
+        unsubscribe();
+        return CR_OK;
+    }
+
+    std::lock_guard<std::mutex> lock(subscriptions_mutex);
+
+    if (!subscription)
+    {
+        subscription.reset(new Subscription());
+        subscription->owner = this;
+        subscription->sender = std::thread(&Subscription::run, subscription.get());
+        subscriptions.push_back(subscription.get());
+        subscription_count++;
+    }
+
+    subscription->events = events;
+    subscription->blocks = in->blocks();
+    subscription->has_region = in->has_region();
+    subscription->region_min = region_min;
+    subscription->region_max = region_max;
+    subscription->block_hashes.clear();
+
+    return CR_OK;
+}
+
+void ServerConnection::unsubscribe()
+{
+    {
+        std::lock_guard<std::mutex> lock(subscriptions_mutex);
+        if (!subscription)
+            return;
+
+        auto it = std::find(subscriptions.begin(), subscriptions.end(), subscription.get());
+        if (it != subscriptions.end())
+            subscriptions.erase(it);
+        subscription_count--;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(subscription->mutex);
+        subscription->closing = true;
+    }
+    subscription->cond.notify_one();
+    subscription->sender.join();
+    subscription.reset();
+}
+
+bool ServerConnection::sendNotification(const dfproto::CoreChangeNotification &msg)
+{
+    std::lock_guard<std::mutex> lock(send_mutex);
+
+    if (in_error)
+        return false;
+
+    if (!sendRemoteMessage(socket, RPC_REPLY_NOTIFY, &msg, false))
+    {
+        in_error = true;
+        return false;
+    }
+    return true;
+}
+
 void ServerConnection::connection_ostream::flush_proxy()
 {
     if (owner->in_error)
@@ -231,6 +742,7 @@ void ServerConnection::connection_ostream::flush_proxy()
 
     buffer.clear();
 
+    std::lock_guard<std::mutex> lock(owner->send_mutex);
     if (!sendRemoteMessage(owner->socket, RPC_REPLY_TEXT, &msg, false))
     {
         owner->in_error = true;
@@ -327,7 +839,7 @@ void ServerConnection::threadFn()
         }
         else
         {
-            if (((fn->flags & SF_ALLOW_REMOTE) != SF_ALLOW_REMOTE) && strcmp(socket->GetClientAddr(), "127.0.0.1") != 0)
+            if (!isAllowed(fn))
             {
                 stream.printerr("In call to %s: forbidden host: %s\n", fn->name, socket->GetClientAddr());
             }
@@ -371,6 +883,8 @@ void ServerConnection::threadFn()
 
         stream.flush();
 
+        std::unique_lock<std::mutex> send_lock(send_mutex);
+
         if (res == CR_OK && reply)
         {
             if (!sendRemoteMessage(socket, RPC_REPLY_RESULT, reply, true))
@@ -391,6 +905,8 @@ void ServerConnection::threadFn()
             }
         }
 
+        send_lock.unlock();
+
         // Cleanup
         if (fn)
         {
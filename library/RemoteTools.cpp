@@ -47,6 +47,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "RemoteTools.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "MiscUtils.h"
 #include "VersionInfo.h"
 #include "DFHackVersion.h"
@@ -652,6 +653,30 @@ static command_result SetUnitLabors(color_ostream &stream, const SetUnitLaborsIn
     return CR_OK;
 }
 
+static command_result GetProfileStats(color_ostream &stream,
+                                      const EmptyMessage *, GetProfileStatsOut *out)
+{
+    out->set_enabled(Profiler::isEnabled());
+
+    std::vector<const Profiler::Stats *> stats;
+    Profiler::listStats(&stats);
+    for (auto stat : stats)
+    {
+        auto item = out->add_stats();
+        item->set_name(stat->name);
+        item->set_calls(stat->calls);
+        item->set_total_ns(stat->totalNs());
+        item->set_max_ns(stat->maxNs());
+        item->set_p50_ns(stat->percentileNs(0.5));
+        item->set_p95_ns(stat->percentileNs(0.95));
+        item->set_p99_ns(stat->percentileNs(0.99));
+        item->set_recent_avg_ns(stat->windowAverageNs());
+        item->set_recent_max_ns(stat->windowMaxNs());
+    }
+
+    return CR_OK;
+}
+
 CoreService::CoreService() :
     suspend_depth{0},
     coreSuspender{nullptr}
@@ -666,6 +691,8 @@ CoreService::CoreService() :
     addMethod("CoreResume", &CoreService::CoreResume, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
 
     addMethod("RunLua", &CoreService::RunLua);
+    addMethod("RunBatch", &CoreService::RunBatch, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
+    addMethod("Subscribe", &CoreService::Subscribe, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
 
     // Functions:
     addFunction("GetVersion", GetVersion, SF_DONT_SUSPEND | SF_ALLOW_REMOTE);
@@ -681,6 +708,8 @@ CoreService::CoreService() :
     addFunction("ListSquads", ListSquads, SF_ALLOW_REMOTE);
 
     addFunction("SetUnitLabors", SetUnitLabors, SF_ALLOW_REMOTE);
+
+    addFunction("GetProfileStats", GetProfileStats, SF_ALLOW_REMOTE);
 }
 
 CoreService::~CoreService()
@@ -724,6 +753,19 @@ command_result CoreService::RunCommand(color_ostream &stream,
     return Core::getInstance().runCommand(stream, cmd, args);
 }
 
+command_result CoreService::RunBatch(color_ostream &stream,
+                                     const dfproto::CoreBatchRequest *in,
+                                     dfproto::CoreBatchReply *out)
+{
+    return connection()->runBatch(stream, in, out);
+}
+
+command_result CoreService::Subscribe(color_ostream &stream,
+                                      const dfproto::CoreSubscribeRequest *in)
+{
+    return connection()->subscribe(stream, in);
+}
+
 command_result CoreService::CoreSuspend(color_ostream &stream, const EmptyMessage*, IntMessage *cnt)
 {
     if (suspend_depth == 0)
@@ -0,0 +1,303 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "ScriptIndex.h"
+
+#include "modules/Filesystem.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef LINUX_BUILD
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace DFHack;
+
+// without change notification, rebuild the index when it is older than this
+static const std::chrono::seconds RESCAN_INTERVAL(2);
+
+struct ScriptIndex::Private
+{
+    paths_fn paths;
+    std::atomic<uint64_t> &version;
+
+    std::mutex lock;
+    std::atomic<bool> stale{true};
+    std::vector<std::string> roots;
+    // file name relative to the search path -> full path of the first match
+    std::unordered_map<std::string, std::string> names;
+    std::chrono::steady_clock::time_point built;
+
+    std::atomic<bool> watching{false};
+#ifdef LINUX_BUILD
+    int notify_fd = -1;
+    int wake_fd[2] = {-1, -1};
+    std::vector<int> watches;
+    std::thread watcher;
+    bool watcher_failed = false;
+#endif
+
+    Private(paths_fn paths, std::atomic<uint64_t> &version)
+        : paths(std::move(paths)), version(version) {}
+
+    bool needsRebuild() const;
+    void rebuild(std::vector<std::string> roots);
+    std::string scan(const std::string &name);
+
+    void startWatcher();
+    void stopWatcher();
+    void watch(const std::string &dir);
+    void clearWatches();
+#ifdef LINUX_BUILD
+    void watcherLoop();
+#endif
+};
+
+bool ScriptIndex::Private::needsRebuild() const
+{
+    return stale || (!watching &&
+            std::chrono::steady_clock::now() - built > RESCAN_INTERVAL);
+}
+
+void ScriptIndex::Private::rebuild(std::vector<std::string> new_roots)
+{
+    roots = std::move(new_roots);
+
+    startWatcher();
+    clearWatches();
+
+    names.clear();
+    for (auto &root : roots)
+    {
+        std::map<std::string, bool> files;
+        if (!Filesystem::isdir(root))
+            continue;
+        watch(root);
+        // returns nonzero for trees deeper than the limit, but still lists
+        // everything above it
+        Filesystem::listdir_recursive(root, files, 10, false);
+        for (auto &file : files)
+        {
+            if (file.second)
+                watch(root + "/" + file.first);
+            else
+                names.emplace(file.first, root + "/" + file.first);
+        }
+    }
+
+    built = std::chrono::steady_clock::now();
+    version.fetch_add(1, std::memory_order_release);
+}
+
+std::string ScriptIndex::Private::scan(const std::string &name)
+{
+    for (auto &root : roots)
+    {
+        std::string path = root + "/" + name;
+        if (Filesystem::isfile(path))
+            return path;
+    }
+    return "";
+}
+
+#ifdef LINUX_BUILD
+
+void ScriptIndex::Private::startWatcher()
+{
+    if (watcher.joinable() || watcher_failed)
+        return;
+
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0 || pipe(wake_fd) != 0)
+    {
+        if (notify_fd >= 0)
+            close(notify_fd);
+        notify_fd = -1;
+        watcher_failed = true;
+        return;
+    }
+    fcntl(wake_fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_fd[1], F_SETFD, FD_CLOEXEC);
+
+    watching = true;
+    watcher = std::thread([this] { watcherLoop(); });
+}
+
+void ScriptIndex::Private::stopWatcher()
+{
+    if (!watcher.joinable())
+        return;
+
+    char c = 0;
+    if (write(wake_fd[1], &c, 1) != 1)
+        perror("ScriptIndex: write");
+    watcher.join();
+
+    watching = false;
+    watcher_failed = true;
+    watches.clear();
+    close(notify_fd);
+    close(wake_fd[0]);
+    close(wake_fd[1]);
+    notify_fd = wake_fd[0] = wake_fd[1] = -1;
+}
+
+void ScriptIndex::Private::watch(const std::string &dir)
+{
+    if (notify_fd < 0)
+        return;
+
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF |
+        IN_ONLYDIR;
+    int wd = inotify_add_watch(notify_fd, dir.c_str(), mask);
+    if (wd >= 0)
+        watches.push_back(wd);
+}
+
+void ScriptIndex::Private::clearWatches()
+{
+    for (int wd : watches)
+        inotify_rm_watch(notify_fd, wd);
+    watches.clear();
+}
+
+void ScriptIndex::Private::watcherLoop()
+{
+    alignas(struct inotify_event) char buf[4096];
+
+    while (true)
+    {
+        struct pollfd fds[2] = {
+            { notify_fd, POLLIN, 0 },
+            { wake_fd[0], POLLIN, 0 },
+        };
+        if (poll(fds, 2, -1) < 0)
+            continue;
+        if (fds[1].revents)
+            return;
+
+        bool changed = false;
+        ssize_t len;
+        while ((len = read(notify_fd, buf, sizeof(buf))) > 0)
+        {
+            for (char *ptr = buf; ptr < buf + len; )
+            {
+                auto event = (const struct inotify_event *)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                // generated for the watches removed by clearWatches
+                if (event->mask & IN_IGNORED)
+                    continue;
+
+                changed = true;
+                if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                        IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_Q_OVERFLOW))
+                    stale = true;
+            }
+        }
+
+        if (changed)
+            version.fetch_add(1, std::memory_order_release);
+    }
+}
+
+#else
+
+void ScriptIndex::Private::startWatcher() {}
+void ScriptIndex::Private::stopWatcher() {}
+void ScriptIndex::Private::watch(const std::string &) {}
+void ScriptIndex::Private::clearWatches() {}
+
+#endif
+
+ScriptIndex::ScriptIndex(paths_fn paths)
+    : d(new Private(std::move(paths), version)), version(0)
+{
+}
+
+ScriptIndex::~ScriptIndex()
+{
+    stop();
+}
+
+std::string ScriptIndex::find(const std::string &name)
+{
+    std::unique_lock<std::mutex> lock(d->lock);
+
+    if (d->needsRebuild())
+    {
+        // cleared before fetching the paths so invalidations and changes
+        // that happen while we are listing are not lost
+        d->stale = false;
+
+        // the paths callback takes the caller's own locks, so it must not be
+        // nested inside ours
+        lock.unlock();
+        std::vector<std::string> roots;
+        d->paths(&roots);
+        lock.lock();
+
+        d->rebuild(std::move(roots));
+    }
+
+    bool watching = d->watching;
+
+    auto it = d->names.find(name);
+    // without notifications, the file may have been removed since the last
+    // rescan
+    if (it != d->names.end() && (watching || Filesystem::isfile(it->second)))
+        return it->second;
+
+    // names that are not in the index are usually not scripts at all, but
+    // could be in a search path that was created after the index was built
+    // and is not watched yet
+    std::string path = d->scan(name);
+    if (!path.empty() || it != d->names.end())
+        d->stale = true;
+    return path;
+}
+
+void ScriptIndex::invalidate()
+{
+    d->stale = true;
+}
+
+void ScriptIndex::stop()
+{
+    std::lock_guard<std::mutex> lock(d->lock);
+    d->stopWatcher();
+}
+
+bool ScriptIndex::isWatching() const
+{
+    return d->watching;
+}
@@ -0,0 +1,120 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+// Measures the round trip latency of a typical polling client against a
+// running DFHack instance, calling the same functions one by one and as a
+// single RunBatch request.
+//
+// Usage: dfhack-rpc-bench [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "RemoteClient.h"
+#include "BasicApi.pb.h"
+
+using namespace DFHack;
+using namespace dfproto;
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void report(const char *name, std::vector<double> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double s : samples)
+        total += s;
+    printf("%-12s avg %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+           name, total / samples.size(),
+           samples[samples.size() / 2],
+           samples[std::min(samples.size() - 1, samples.size() * 99 / 100)],
+           samples.back());
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "Usage: dfhack-rpc-bench [iterations]\n");
+        return 2;
+    }
+
+    RemoteClient client;
+    if (!client.connect())
+        return 2;
+
+    RemoteFunction<EmptyMessage, StringMessage> get_version, get_df_version;
+    RemoteFunction<EmptyMessage, GetWorldInfoOut> get_world_info;
+    RemoteFunction<ListSquadsIn, ListSquadsOut> list_squads;
+
+    if (!get_version.bind(&client, "GetVersion") ||
+        !get_df_version.bind(&client, "GetDFVersion") ||
+        !get_world_info.bind(&client, "GetWorldInfo") ||
+        !list_squads.bind(&client, "ListSquads"))
+    {
+        fprintf(stderr, "Could not bind the benchmarked functions.\n");
+        return 3;
+    }
+
+    RemoteBatch batch(&client);
+    batch.add(&get_version);
+    batch.add(&get_df_version);
+    batch.add(&get_world_info);
+    batch.add(&list_squads);
+
+    std::vector<double> sequential, batched;
+    sequential.reserve(iterations);
+    batched.reserve(iterations);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = bench_clock::now();
+        if (get_version() != CR_OK || get_df_version() != CR_OK ||
+            get_world_info() != CR_OK || list_squads() != CR_OK)
+        {
+            fprintf(stderr, "Sequential call failed.\n");
+            return 1;
+        }
+        auto mid = bench_clock::now();
+        if (batch.execute() != CR_OK)
+        {
+            fprintf(stderr, "Batch call failed.\n");
+            return 1;
+        }
+        auto end = bench_clock::now();
+
+        sequential.push_back(std::chrono::duration<double, std::micro>(mid - start).count());
+        batched.push_back(std::chrono::duration<double, std::micro>(end - mid).count());
+    }
+
+    printf("%d iterations of %zu calls\n", iterations, batch.size());
+    report("sequential", sequential);
+    report("batched", batched);
+
+    return 0;
+}
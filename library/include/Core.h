@@ -157,6 +157,9 @@ namespace DFHack
         bool setModScriptPaths(const std::vector<std::string> &mod_script_paths);
         bool removeScriptPath(std::string path);
         std::string findScript(std::string name);
+        /// counter incremented when a file in the script paths changes, or 0
+        /// if changes are not reported on this platform
+        uint64_t getScriptsVersion();
         void getScriptPaths(std::vector<std::string> *dest);
 
         bool getSuppressDuplicateKeyboardEvents();
@@ -0,0 +1,118 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+
+#pragma once
+
+#include "Export.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DFHack
+{
+    /// Periodic work of a plugin, declared with DFHACK_PLUGIN_CYCLE and run by
+    /// calling plugin_oncycle. The core picks the tick each cycle runs on so
+    /// that cycles are spread out instead of firing on the same frame.
+    struct PluginCycle {
+        /// game ticks between runs; may be changed by the plugin at any time
+        int32_t period;
+        /// expected run time in microseconds, used until real timings exist
+        int32_t cost_us;
+        /// set to run the cycle on the next update, outside of the schedule
+        bool requested;
+    };
+
+    /*!
+     * Scheduler for the periodic work declared with DFHACK_PLUGIN_CYCLE.
+     * Instead of every plugin comparing world->frame_counter with its own
+     * timestamp, the core gives each cycle a phase on the least loaded tick,
+     * so that cycles with similar periods do not all fire on the same frame
+     * (e.g. right after a world is loaded). The cycles that are due are run
+     * until the per-tick time budget is spent; the rest stay due and run on
+     * the following updates. A cycle that alone takes longer than the budget
+     * is moved to a quieter tick.
+     *
+     * The scheduler only decides what runs when; the caller runs the cycles,
+     * measures them and serializes access.
+     */
+    class DFHACK_EXPORT CycleScheduler
+    {
+    public:
+        /// The owner of a cycle, i.e. a plugin
+        struct Client
+        {
+            virtual ~Client() {}
+            /// the declared cycle, or NULL once the owner has been unloaded
+            virtual PluginCycle *getCycle() = 0;
+            virtual bool isCycleEnabled() = 0;
+        };
+
+        explicit CycleScheduler(double budget_us);
+
+        /// Schedule the cycle of the client, or place it again with its
+        /// current period and cost if it is already scheduled
+        void add(Client *client);
+        /// Forget the phases, e.g. when a different world is loaded
+        void reset();
+
+        /// Clients whose cycle should run at frame counter now, most overdue
+        /// first. Clients that have been unloaded are dropped.
+        void collect(int32_t now, std::vector<Client *> *due);
+        /// Whether the next cycle collected for this tick should wait for a
+        /// later update, after ran cycles took spent_us. The first cycle
+        /// always runs, so one that alone exceeds the budget still makes
+        /// progress.
+        bool isOverBudget(size_t ran, double spent_us) const
+        {
+            return ran > 0 && spent_us >= budget_us;
+        }
+        /// Record that the cycle of the client ran at now and took cost_us
+        void finish(Client *client, int32_t now, double cost_us);
+
+        /// The tick of the next scheduled run of the client, if it is placed
+        bool getNextDue(Client *client, int32_t *tick) const;
+
+    private:
+        struct Task
+        {
+            Client *client;
+            int32_t period;
+            // running average of the measured run time
+            double cost_us;
+            // frame_counter value of the next run, valid if placed
+            int32_t next_due;
+            bool placed;
+        };
+
+        std::vector<Task> tasks;
+        int32_t last_tick;
+        double budget_us;
+
+        Task *find(Client *client);
+        double load(const Task *self, int32_t tick) const;
+        void place(Task *task, int32_t earliest, int32_t window);
+    };
+}
@@ -26,6 +26,7 @@ redistribute it freely, subject to the following restrictions:
 #include "ColorText.h"
 
 #include <atomic>
+#include <chrono>
 #include "Core.h"
 
 namespace DFHack {
@@ -180,6 +181,16 @@ public:
         ~ostream_proxy_prefix() {
             flush();
         }
+    protected:
+        //! Queues the text to DebugLogSink when asynchronous output is active
+        void flush_proxy() override;
+    private:
+        const DebugCategory& cat_;
+        DebugCategory::level level_;
+        //! Header is formatted by DebugLogSink writer thread
+        bool async_;
+        bool headerPending_;
+        std::chrono::system_clock::time_point time_;
     };
 
     /*!
@@ -0,0 +1,129 @@
+/**
+Copyright © 2018 Pauli <suokkos@gmail.com>
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+   not claim that you wrote the original software. If you use this
+   software in a product, an acknowledgment in the product
+   documentation would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+   must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+   distribution.
+ */
+
+#pragma once
+
+#include "ColorText.h"
+#include "DebugManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+
+namespace DFHack {
+
+/*! \file DebugLogSink.h
+ * Optional asynchronous output for debug messages written to the console.
+ *
+ * When enabled, each thread that prints debug messages copies them into its
+ * own single producer ring buffer. A writer thread drains the rings, orders
+ * the messages by their timestamps, formats the message headers and writes
+ * them to the console and to an optional size rotated log file. The printing
+ * thread never waits for console output; it only waits if its ring is full.
+ *
+ * Messages written to other streams than the console are not affected.
+ */
+class DFHACK_EXPORT DebugLogSink {
+public:
+    struct Config {
+        //! Queue console debug messages to the writer thread
+        bool async = false;
+        //! Copy debug messages to this file. Empty disables the file output.
+        //! Setting a file implies asynchronous output.
+        std::string file;
+        //! Rotate the log file when it would grow larger than this
+        size_t file_max_size = 4 << 20;
+        //! Number of rotated files to keep (file.1 ... file.N)
+        unsigned file_count = 3;
+    };
+
+    //! Get the singleton object
+    static DebugLogSink& getInstance();
+
+    //! True if debug messages written to the console should be queued
+    bool isActive() const noexcept {
+        return active_.load(std::memory_order_relaxed);
+    }
+
+    //! Query the current configuration
+    Config getConfig();
+    //! Apply new configuration and start or stop the writer thread as needed.
+    //! Stopping writes all queued messages first.
+    void setConfig(const Config& config);
+
+    /*!
+     * Queue a message chunk from the calling thread. Text that does not fit
+     * into one ring record is split over several records.
+     *
+     * \param header Header configuration if the header of the message has
+     *        not been queued yet or nullptr. Set to nullptr once the header
+     *        is queued.
+     * \param headerColor Color used for the header text
+     * \param time Time when the message was started
+     * \param threadId Identifier of the calling thread
+     * \param plugin Plugin name of the debug category
+     * \param category Name of the debug category
+     * \param fragments Colored text of the chunk. Queued text is removed,
+     *        so on failure only the text that still has to be written is left.
+     * \return false if the writer is not running and the caller should write
+     *         the header (if still set) and the remaining fragments itself
+     */
+    bool push(const DebugManager::HeaderConfig*& header,
+            color_value headerColor,
+            std::chrono::system_clock::time_point time,
+            uint32_t threadId,
+            const char* plugin,
+            const char* category,
+            std::list<buffered_color_ostream::fragment_type>& fragments);
+
+    //! Block until all messages queued before the call have been written
+    void flush();
+    //! Write all queued messages and stop the writer thread. Called from
+    //! Core::Shutdown.
+    void stop();
+
+    /*!
+     * Format the standard message header selected by config. Used both for
+     * synchronous output and by the writer thread.
+     */
+    static void formatHeader(std::ostream& out,
+            const DebugManager::HeaderConfig& config,
+            std::chrono::system_clock::time_point time,
+            uint32_t threadId,
+            const char* plugin,
+            const char* category);
+
+    DebugLogSink(const DebugLogSink&) = delete;
+    DebugLogSink& operator=(const DebugLogSink&) = delete;
+private:
+    DebugLogSink();
+    ~DebugLogSink();
+
+    struct Private;
+    std::unique_ptr<Private> d;
+    std::atomic<bool> active_;
+};
+
+}
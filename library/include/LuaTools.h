@@ -73,6 +73,24 @@ namespace DFHack {namespace Lua {
     DFHACK_EXPORT bool Require(color_ostream &out, lua_State *state,
                                const std::string &module, bool setglobal = false);
 
+    /**
+     * Load a Lua file like luaL_loadfilex, but reuse the compiled bytecode
+     * stored by an earlier load if the file has not changed since. Binary
+     * only loads bypass the cache. Text only loads refuse precompiled files,
+     * but use the bytecode cached for a source file.
+     */
+    DFHACK_EXPORT int LoadFileCached(lua_State *state, const char *filename, const char *mode = NULL);
+
+    /**
+     * Make loadfile() and require() in the state use LoadFileCached.
+     */
+    DFHACK_EXPORT void InstallBytecodeCache(lua_State *state);
+
+    /**
+     * Number of loads served from the bytecode cache and compiled from source.
+     */
+    DFHACK_EXPORT void GetBytecodeCacheStats(size_t *hits, size_t *misses);
+
     /**
      * Push the module table, loading it using require() if necessary.
      */
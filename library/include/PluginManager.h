@@ -27,6 +27,7 @@ distribution.
 #include "Export.h"
 #include "Hooks.h"
 #include "ColorText.h"
+#include "CycleScheduler.h"
 #include "MiscUtils.h"
 #include <map>
 #include <string>
@@ -56,6 +57,9 @@ namespace DFHack
     namespace Lua {
         class Notification;
     }
+    namespace Profiler {
+        struct Stats;
+    }
 
     namespace Version {
         const char *dfhack_version();
@@ -139,7 +143,7 @@ namespace DFHack
         command_hotkey_guard guard;
         std::string usage;
     };
-    class Plugin
+    class Plugin : private CycleScheduler::Client
     {
         struct RefLock;
         struct RefAutolock;
@@ -150,10 +154,14 @@ namespace DFHack
             const std::string &plug_name, PluginManager * pm);
         ~Plugin();
         command_result on_update(color_ostream &out);
+        command_result on_cycle(color_ostream &out);
         command_result on_state_change(color_ostream &out, state_change_event event);
         command_result save_data(color_ostream &out);
         command_result load_data(color_ostream &out);
         void detach_connection(RPCService *svc);
+        bool open(color_ostream &out);
+        bool init(color_ostream &out);
+        bool unload_library(color_ostream &out, bool handoff);
     public:
         enum plugin_state
         {
@@ -206,6 +214,8 @@ namespace DFHack
         std::string path;
         std::string name;
         DFLibrary * plugin_lib;
+        // set by open, published as plugin_lib by init
+        DFLibrary * opened_lib;
         PluginManager * parent;
         plugin_state state;
 
@@ -227,17 +237,40 @@ namespace DFHack
         void index_lua(DFLibrary *lib);
         void reset_lua();
 
+        PluginCycle *getCycle() override { return plugin_oncycle ? plugin_cycle : 0; }
+        bool isCycleEnabled() override { return is_enabled(); }
+
         bool *plugin_is_enabled;
         std::vector<std::string>* plugin_globals;
         command_result (*plugin_init)(color_ostream &, std::vector <PluginCommand> &);
         command_result (*plugin_status)(color_ostream &, std::string &);
         command_result (*plugin_shutdown)(color_ostream &);
         command_result (*plugin_onupdate)(color_ostream &);
+        command_result (*plugin_oncycle)(color_ostream &);
+        PluginCycle *plugin_cycle;
         command_result (*plugin_onstatechange)(color_ostream &, state_change_event);
         command_result (*plugin_enable)(color_ostream &, bool);
         RPCService* (*plugin_rpcconnect)(color_ostream &);
         command_result (*plugin_save_data)(color_ostream &);
         command_result (*plugin_load_data)(color_ostream &);
+        command_result (*plugin_export_state)(color_ostream &, int32_t &, std::string &);
+        command_result (*plugin_import_state)(color_ostream &, int32_t, const std::string &);
+
+        // state exported by the previous instance of the library during a
+        // reload, kept until the next instance is initialized
+        struct StateHandoff {
+            bool valid = false;
+            int32_t version = 0;
+            std::string data;
+        } handoff;
+
+        Profiler::Stats *update_stats;
+        Profiler::Stats *cycle_stats;
+        Profiler::Stats *state_change_stats;
+
+        // time spent in open() and init() by the last load
+        double open_ms;
+        double init_ms;
     };
     class DFHACK_EXPORT PluginManager
     {
@@ -249,6 +282,8 @@ namespace DFHack
         void init();
         void OnUpdate(color_ostream &out);
         void OnStateChange(color_ostream &out, state_change_event event);
+        void registerCycle(Plugin *p);
+        void runCycles(color_ostream &out);
         void registerCommands( Plugin * p );
         void unregisterCommands( Plugin * p );
         void doSaveData(color_ostream &out);
@@ -267,6 +302,18 @@ namespace DFHack
         bool reload (const std::string &name);
         bool reloadAll();
 
+        struct PluginLoadTime {
+            std::string name;
+            /// time spent opening the library and resolving its symbols
+            double open_ms;
+            /// time spent in plugin_init
+            double init_ms;
+            bool loaded;
+        };
+        /// Per plugin timings of the last loadAll, in load order, and the
+        /// wall clock time the whole load took
+        void getLoadTimeline(std::vector<PluginLoadTime> *timeline, double *total_ms);
+
         Plugin *getPluginByName (const std::string &name) { return (*this)[name]; }
         Plugin *getPluginByCommand (const std::string &command);
         command_result InvokeCommand(color_ostream &out, const std::string & command, std::vector <std::string> & parameters);
@@ -285,6 +332,10 @@ namespace DFHack
         std::map <std::string, Plugin*> command_map;
         std::map <std::string, Plugin*> all_plugins;
         std::string plugin_path;
+        CycleScheduler *cycles;
+        tthread::mutex * cycles_mutex;
+        std::vector<PluginLoadTime> load_timeline;
+        double load_total_ms;
     };
 
     namespace Gui
@@ -321,6 +372,12 @@ extern "C" { \
     DFhackDataExport bool plugin_is_enabled = false; \
     bool &varname = plugin_is_enabled;
 
+/// Declare periodic work run by plugin_oncycle every period game ticks while
+/// the plugin is enabled. cost_us is the expected run time in microseconds.
+#define DFHACK_PLUGIN_CYCLE(varname, period, cost_us) \
+    DFhackDataExport DFHack::PluginCycle plugin_cycle = { period, cost_us, false }; \
+    DFHack::PluginCycle &varname = plugin_cycle;
+
 #define DFHACK_PLUGIN_LUA_COMMANDS \
     DFhackCExport const DFHack::CommandReg plugin_lua_commands[] =
 #define DFHACK_PLUGIN_LUA_FUNCTIONS \
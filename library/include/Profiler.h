@@ -0,0 +1,136 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#include "Export.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace DFHack
+{
+/*! \file Profiler.h
+ * Low overhead timing of the callbacks that run on the simulation thread
+ * (plugin_onupdate, plugin_onstatechange and the core update steps). Timings
+ * are only collected while profiling is enabled with the ``profile`` command;
+ * when disabled, a ScopedTimer costs a single relaxed atomic load.
+ *
+ * Durations are measured in raw timestamp counter ticks where available (and
+ * in steady_clock nanoseconds otherwise) and converted to nanoseconds only when
+ * they are reported.
+ */
+namespace Profiler
+{
+    inline uint64_t ticks()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /// Convert a tick count to nanoseconds.
+    DFHACK_EXPORT uint64_t toNs(uint64_t ticks);
+
+    /// Accumulated timings for one profiled callback.
+    struct DFHACK_EXPORT Stats
+    {
+        // values below 8 ticks are stored exactly, larger values in log2
+        // ranges split into 8 linear sub-buckets (at most 12.5% error)
+        static constexpr size_t HISTOGRAM_BUCKETS = 320;
+        // number of most recent samples kept for the rolling window
+        static constexpr size_t WINDOW_SIZE = 256;
+
+        std::string name;
+        uint64_t calls;
+        uint64_t total_ticks;
+        uint64_t max_ticks;
+        uint32_t histogram[HISTOGRAM_BUCKETS];
+        uint32_t window[WINDOW_SIZE];
+        size_t window_pos;
+
+        explicit Stats(const std::string &name);
+
+        void reset();
+        void add(uint64_t ticks);
+
+        uint64_t totalNs() const { return toNs(total_ticks); }
+        uint64_t maxNs() const { return toNs(max_ticks); }
+        /// Approximate duration below which the given fraction of all calls fell.
+        uint64_t percentileNs(double fraction) const;
+        /// Average and maximum of the samples in the rolling window.
+        uint64_t windowAverageNs() const;
+        uint64_t windowMaxNs() const;
+    };
+
+    extern DFHACK_EXPORT std::atomic<bool> enabled;
+
+    inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    /// Enabling profiling for the first time calibrates the tick rate, which
+    /// blocks the calling thread for a few milliseconds.
+    DFHACK_EXPORT void setEnabled(bool enable);
+    /// Clear the collected timings of all registered stats.
+    DFHACK_EXPORT void reset();
+
+    /// Find or create the stats with the given name. The returned pointer stays
+    /// valid for the lifetime of the process.
+    DFHACK_EXPORT Stats *getStats(const std::string &name);
+    /// List all registered stats that have recorded at least one call,
+    /// ordered by total time spent, most expensive first.
+    DFHACK_EXPORT void listStats(std::vector<const Stats *> *out);
+
+    /// Times the enclosing scope into stats if profiling is enabled.
+    class ScopedTimer
+    {
+        Stats *stats;
+        uint64_t start;
+    public:
+        explicit ScopedTimer(Stats *stats)
+            : stats(isEnabled() ? stats : nullptr), start(0)
+        {
+            if (this->stats)
+                start = ticks();
+        }
+        ~ScopedTimer()
+        {
+            if (stats)
+                stats->add(ticks() - start);
+        }
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+    };
+}
+}
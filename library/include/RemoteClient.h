@@ -28,6 +28,8 @@ distribution.
 #include "ColorText.h"
 #include "Core.h"
 
+#include <deque>
+
 class CPassiveSocket;
 class CActiveSocket;
 class CSimpleSocket;
@@ -44,7 +46,8 @@ namespace  DFHack
         RPC_REPLY_RESULT = -1,
         RPC_REPLY_FAIL = -2,
         RPC_REPLY_TEXT = -3,
-        RPC_REQUEST_QUIT = -4
+        RPC_REQUEST_QUIT = -4,
+        RPC_REPLY_NOTIFY = -5
     };
 
     struct RPCHandshakeHeader {
@@ -92,6 +95,17 @@ namespace  DFHack
      *   of the function if it succeeded, or RPC_REPLY_FAIL with the
      *   error code if it did not.
      *
+     *   Several calls can be sent in one message with RunBatch, which
+     *   takes the ids and serialized inputs of the calls and returns
+     *   their result codes and serialized outputs in one reply. All
+     *   calls of a batch that need the core suspended share a single
+     *   suspend.
+     *
+     *   After a successful Subscribe call, the server also sends
+     *   RPC_REPLY_NOTIFY:CoreChangeNotification messages whenever
+     *   subscribed events happen. They can arrive at any time, including
+     *   between the messages of a reply to another call.
+     *
      * 3. Disconnect
      *
      *   The client terminates the connection by sending an
@@ -149,6 +163,7 @@ namespace  DFHack
 
     protected:
         friend class RemoteClient;
+        friend class RemoteBatch;
 
         RemoteFunctionBase(const message_type *in, const message_type *out)
             : RPCFunctionBase(in, out), p_client(NULL), id(-1)
@@ -215,6 +230,7 @@ namespace  DFHack
     class DFHACK_EXPORT RemoteClient
     {
         friend class RemoteFunctionBase;
+        friend class RemoteBatch;
 
         bool bind(color_ostream &out, RemoteFunctionBase *function,
                   const std::string &name, const std::string &plugin);
@@ -242,6 +258,18 @@ namespace  DFHack
         int suspend_game();
         int resume_game();
 
+        // Replace the change notification subscription. An empty request
+        // unsubscribes.
+        command_result subscribe(const dfproto::CoreSubscribeRequest &request) {
+            return subscribe(default_output(), request);
+        }
+        command_result subscribe(color_ostream &out, const dfproto::CoreSubscribeRequest &request);
+
+        // Get the next change notification, waiting up to timeout_ms
+        // milliseconds for one to arrive. Returns false on timeout.
+        bool read_notification(dfproto::CoreChangeNotification *notification,
+                               int timeout_ms = 0);
+
     private:
         bool active, delete_output;
         CActiveSocket *socket;
@@ -252,6 +280,61 @@ namespace  DFHack
 
         bool suspend_ready;
         RemoteFunction<EmptyMessage, IntMessage> suspend_call, resume_call;
+
+        bool batch_ready;
+        RemoteFunction<dfproto::CoreBatchRequest, dfproto::CoreBatchReply> batch_call;
+
+        RemoteFunction<dfproto::CoreSubscribeRequest> subscribe_call;
+        // Notifications received while waiting for a reply
+        std::deque<std::string> notifications;
+    };
+
+    /*
+     * Collects calls of bound functions and sends them to the server in
+     * a single RunBatch request, which costs one round trip and at most
+     * one core suspend instead of one per call. Falls back to calling the
+     * functions one by one if the server does not support batches.
+     *
+     *   RemoteBatch batch(&client);
+     *   batch.add(&get_version);
+     *   batch.add(&list_units, &units_in, &units_out);
+     *   if (batch.execute() == CR_OK) ...
+     */
+    class DFHACK_EXPORT RemoteBatch
+    {
+    public:
+        typedef RPCFunctionBase::message_type message_type;
+
+        RemoteBatch(RemoteClient *client) : client(client) {}
+
+        // Queue a call. Without explicit messages the in() and out()
+        // buffers of the function are used. The messages must stay
+        // valid until execute returns.
+        void add(RemoteFunctionBase *function,
+                 const message_type *input = NULL, message_type *output = NULL);
+
+        size_t size() const { return calls.size(); }
+        void clear() { calls.clear(); }
+
+        // Returns CR_OK if all calls succeeded, or the result of the
+        // first call that failed. Outputs of successful calls are filled
+        // in either case.
+        command_result execute();
+        command_result execute(color_ostream &out);
+
+        // Result of the call with the given index after execute.
+        command_result result(size_t idx) const { return calls[idx].result; }
+
+    private:
+        struct Call {
+            RemoteFunctionBase *function;
+            const message_type *input;
+            message_type *output;
+            command_result result;
+        };
+
+        RemoteClient *client;
+        std::vector<Call> calls;
     };
 
     inline color_ostream &RemoteFunctionBase::default_ostream() {
@@ -28,7 +28,10 @@ distribution.
 #include "RemoteClient.h"
 #include "Core.h"
 
+#include <atomic>
 #include <future>
+#include <memory>
+#include <mutex>
 
 class CPassiveSocket;
 class CActiveSocket;
@@ -226,9 +229,19 @@ namespace  DFHack
             connection_ostream(ServerConnection *owner) : owner(owner) {}
         };
 
-        bool in_error;
+        std::atomic<bool> in_error;
         CActiveSocket *socket;
         connection_ostream stream;
+        // Serializes replies and change notifications
+        std::mutex send_mutex;
+
+    public:
+        // Change notification state, defined in RemoteServer.cpp
+        struct Subscription;
+
+    private:
+        std::unique_ptr<Subscription> subscription;
+        void unsubscribe();
 
         std::vector<ServerFunctionBase*> functions;
 
@@ -239,11 +252,32 @@ namespace  DFHack
         ServerConnection(CActiveSocket* socket);
         ~ServerConnection();
 
+        bool isAllowed(ServerFunctionBase *fn);
+
     public:
 
         static void Accepted(CActiveSocket* socket);
 
         ServerFunctionBase *findFunction(color_ostream &out, const std::string &plugin, const std::string &name);
+
+        // Execute the calls of a RunBatch request, taking at most one
+        // CoreSuspender for all calls that need the core suspended.
+        command_result runBatch(color_ostream &stream,
+                                const dfproto::CoreBatchRequest *in,
+                                dfproto::CoreBatchReply *out);
+
+        // Replace the change notification subscription of the connection.
+        command_result subscribe(color_ostream &stream,
+                                 const dfproto::CoreSubscribeRequest *in);
+        bool sendNotification(const dfproto::CoreChangeNotification &msg);
+    };
+
+    // Collects the events and block changes subscribed by clients and
+    // hands them to the connections once per tick.
+    class ServerNotifier {
+    public:
+        // Called by Core::onUpdate after EventManager::manageEvents
+        static void onUpdate(color_ostream &out);
     };
 
     class ServerMain {
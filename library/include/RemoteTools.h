@@ -153,5 +153,11 @@ namespace DFHack
         command_result RunLua(color_ostream &stream,
                               const dfproto::CoreRunLuaRequest *in,
                               StringListMessage *out);
+
+        command_result RunBatch(color_ostream &stream,
+                                const dfproto::CoreBatchRequest *in,
+                                dfproto::CoreBatchReply *out);
+        command_result Subscribe(color_ostream &stream,
+                                 const dfproto::CoreSubscribeRequest *in);
     };
 }
@@ -0,0 +1,94 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+
+#include "Export.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace DFHack
+{
+/*! \file ScriptIndex.h
+ * Name to path index of the files in the script search paths, used by
+ * Core::findScript.
+ *
+ * The index is built by listing the script directories once. Where the
+ * platform supports change notification (inotify on Linux), a watcher thread
+ * marks the index stale when a file is created, removed or renamed and bumps
+ * the change version whenever any file in the watched directories changes.
+ * Elsewhere, the index is rebuilt when it is older than a few seconds and the
+ * change version is not tracked.
+ *
+ * Names that are not in the index are always looked up on disk, so scripts
+ * created in directories that did not exist when the index was built are
+ * still found.
+ */
+class DFHACK_EXPORT ScriptIndex
+{
+public:
+    typedef std::function<void(std::vector<std::string> *)> paths_fn;
+
+    //! paths is called to get the current search path list whenever the
+    //! index has to be rebuilt. The index does not hold its own lock during
+    //! the call, so paths may take locks that are also held around calls
+    //! into the index.
+    explicit ScriptIndex(paths_fn paths);
+    ~ScriptIndex();
+
+    //! Resolve a script file name relative to the search paths, returning
+    //! the full path of the first match or an empty string
+    std::string find(const std::string &name);
+
+    //! Mark the index stale, e.g. after the search paths changed
+    void invalidate();
+
+    //! Stop the watcher thread. Lookups keep working with periodic rescans.
+    void stop();
+
+    //! True if file changes are reported by the platform
+    bool isWatching() const;
+
+    /*!
+     * Counter incremented whenever a change to a watched script directory is
+     * reported, or when the index is rebuilt. While isWatching() is true, a
+     * script file whose version did not change since it was last checked
+     * does not need to be stat'ed again.
+     */
+    uint64_t getVersion() const { return version.load(std::memory_order_acquire); }
+
+    ScriptIndex(const ScriptIndex &) = delete;
+    ScriptIndex &operator=(const ScriptIndex &) = delete;
+
+private:
+    struct Private;
+    std::unique_ptr<Private> d;
+    std::atomic<uint64_t> version;
+};
+}
@@ -41,6 +41,9 @@ distribution.
 #include "df/trap_type.h"
 #include "df/workshop_type.h"
 
+#include <memory>
+#include <vector>
+
 namespace df
 {
     struct building_cagest;
@@ -232,15 +235,16 @@ DFHACK_EXPORT std::string getRoomDescription(df::building *building, df::unit *u
  *      df::item *item = *stored;
  *  }
  *
- * Implementation detail: Uses tile blocks for speed.
- * For each tile block that contains at least part of the stockpile,
- * starting at the top left and moving right, row by row,
- * the block's items are checked for anything on the ground within that stockpile.
+ * Implementation detail: the contents of each stockpile are cached until DF
+ * runs another tick or an item is moved through the Items module. Refreshing
+ * the cache walks the tile blocks under the stockpile, but only looks up the
+ * items that were added to a block since it was last seen.
+ * The item list is held by the iterator, so refreshes during the loop do not
+ * invalidate it.
  */
 class DFHACK_EXPORT StockpileIterator
 {
-    df::building_stockpilest* stockpile;
-    df::map_block* block;
+    std::shared_ptr<const std::vector<df::item*>> items;
     size_t current;
     df::item *item;
 
@@ -252,24 +256,20 @@ public:
     using reference = df::item*&;
 
     StockpileIterator() {
-        stockpile = NULL;
-        block = NULL;
+        current = 0;
         item = NULL;
     }
 
     StockpileIterator& operator++();
 
-    void begin(df::building_stockpilest* sp) {
-        stockpile = sp;
-        operator++();
-    }
+    void begin(df::building_stockpilest* sp);
 
     df::item* operator*() {
         return item;
     }
 
     bool done() {
-        return block == NULL;
+        return item == NULL;
     }
 };
 
@@ -0,0 +1,100 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#pragma once
+#include "Export.h"
+#include "DataDefs.h"
+
+#include "df/item_type.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \defgroup grp_itemsweep ItemSweep module
+ * @ingroup grp_modules
+ */
+
+namespace df
+{
+    struct item;
+}
+
+namespace DFHack
+{
+class Plugin;
+
+/*
+ * Shared scan of the items in play. Plugins that periodically count or
+ * collect items register a subscriber with a filter instead of walking
+ * world->items.other.IN_PLAY themselves. When a subscriber asks for a
+ * refresh, the items are walked once and every matching item is passed to
+ * it, and to the other subscribers whose next periodic refresh is close
+ * enough to accept the result, so plugins whose cycles run close together
+ * share a single pass.
+ *
+ * Subscribers keep whatever they need from visit() (usually counts); item
+ * pointers must not be kept beyond the current update. Sweeps are timed as
+ * core/itemsweep by the profile command.
+ */
+namespace ItemSweep
+{
+    struct Filter
+    {
+        /// only items of these types are visited; empty for all types
+        std::vector<df::item_type> types;
+        /// item->flags.whole bits that exclude an item
+        uint32_t bad_flags = 0;
+        /// item->flags.whole bits that must all be set
+        uint32_t good_flags = 0;
+    };
+
+    struct Subscriber
+    {
+        virtual ~Subscriber() {}
+        /// called before the items of a sweep are visited
+        virtual void begin() {}
+        virtual void visit(df::item *item) = 0;
+        /// called after all items of a sweep were visited
+        virtual void end() {}
+    };
+
+    /// Register a subscriber, returning its id. The subscriber is owned by the
+    /// caller and must stay valid until it is unsubscribed. Subscribers of a
+    /// disabled plugin are only fed when they request a refresh themselves.
+    /// Like unsubscribe, it must not be called from a subscriber during a
+    /// sweep.
+    DFHACK_EXPORT int subscribe(Plugin *owner, const Filter &filter, Subscriber *sub);
+    DFHACK_EXPORT void unsubscribe(int id);
+    /// Called when a plugin is unloaded.
+    DFHACK_EXPORT void unsubscribeAll(Plugin *owner);
+
+    /// Make sure that the subscriber has seen the items in play no more than
+    /// max_age game ticks ago (0: during the current update), sweeping the
+    /// items if it has not. Returns false if the id is unknown or no world is
+    /// loaded. Refreshes with a positive max_age are taken to be periodic:
+    /// their spacing decides when other sweeps feed the subscriber too.
+    DFHACK_EXPORT bool refresh(int id, int32_t max_age = 0);
+}
+}
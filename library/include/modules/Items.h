@@ -203,6 +203,8 @@ DFHACK_EXPORT bool canTrade(df::item *item);
 DFHACK_EXPORT bool canTradeWithContents(df::item *item);
 /// Returns true if the item is empty and can be traded or if the item contains any item that can be traded
 DFHACK_EXPORT bool canTradeAnyWithContents(df::item *item);
+/// Same as above, with the contained items already fetched by getContainedItems
+DFHACK_EXPORT bool canTradeAnyWithContents(df::item *item, const std::vector<df::item *> &contained_items);
 /// marks the given item for trade at the given depot
 DFHACK_EXPORT bool markForTrade(df::item *item, df::building_tradedepotst *depot);
 /// Returns true if an active caravan will pay extra for the given item
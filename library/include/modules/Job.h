@@ -34,8 +34,11 @@ distribution.
 
 #include "DataDefs.h"
 #include "df/job_item_ref.h"
+#include "df/job_type.h"
 #include "df/item_type.h"
 
+#include <vector>
+
 namespace df
 {
     struct job;
@@ -97,6 +100,14 @@ namespace DFHack
         // lists jobs with ids >= *id_var, and sets *id_var = *job_next_id;
         DFHACK_EXPORT bool listNewlyCreated(std::vector<df::job*> *pvec, int *id_var);
 
+        // All jobs in world->jobs.list, in list order. The list is indexed at
+        // most once per game tick (and again after linkIntoWorld or removeJob),
+        // so the result and the pointers in it are only valid until the game
+        // runs again.
+        DFHACK_EXPORT const std::vector<df::job*> &getJobs();
+        // Number of jobs of the given type in world->jobs.list, from the same index
+        DFHACK_EXPORT int countJobs(df::job_type type);
+
         DFHACK_EXPORT bool attachJobItem(df::job *job, df::item *item,
                                          df::job_item_ref::T_role role,
                                          int filter_idx = -1, int insert_idx = -1);
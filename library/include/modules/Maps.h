@@ -60,6 +60,7 @@ namespace df {
     struct map_block;
     struct map_block_column;
     struct region_map_entry;
+    struct unit;
     struct world;
     struct world_data;
     struct world_geo_biome;
@@ -343,6 +344,43 @@ DFHACK_EXPORT uint16_t getWalkableGroup(df::coord pos);
 DFHACK_EXPORT bool canWalkBetween(df::coord pos1, df::coord pos2);
 DFHACK_EXPORT bool canStepBetween(df::coord pos1, df::coord pos2);
 
+/**
+ * A set of walkability groups, e.g. the groups occupied by a set of units.
+ * Checking whether a tile can be reached from any of the units is a single
+ * lookup instead of a canWalkBetween call per unit.
+ */
+class DFHACK_EXPORT WalkableGroupSet
+{
+public:
+    WalkableGroupSet();
+
+    void clear();
+    /// add the walkability group of the given tile. unwalkable tiles are ignored.
+    void add(df::coord pos);
+    void addUnits(const std::vector<df::unit *> &units);
+
+    bool empty() const { return count == 0; }
+    bool contains(uint16_t group) const {
+        return group && (bits[group >> 6] >> (group & 63)) & 1;
+    }
+
+    /// true if a tile is in the same walkability group as any tile in the set
+    bool isReachableFromAny(df::coord pos) const;
+    /// true if any of the 8 tiles around pos on the same z-level is reachable
+    bool isAdjacentReachable(df::coord pos) const;
+
+private:
+    std::vector<uint64_t> bits;
+    size_t count;
+};
+
+/**
+ * Walkability groups occupied by the citizens of the fort. Computed lazily at
+ * most once per DFHack update (i.e. per frame, paused or not), so changes to
+ * the map made in the same core suspend as the query are not seen.
+ */
+DFHACK_EXPORT const WalkableGroupSet &getCitizenWalkableGroups();
+
 /**
  * Get the plant that owns the tile at the specified position
  */
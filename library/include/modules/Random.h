@@ -133,6 +133,8 @@ namespace Random
             static inline void setup(PerlinNoise<T,VSIZE,BITS,IDXT> *self, const T *pv, Temp *pt);
             static inline T eval(PerlinNoise<T,VSIZE,BITS,IDXT> *self, Temp *pt, unsigned idx, T *pq);
         };
+        template<unsigned mask>
+        static inline void setup_axis(PerlinNoise<T,VSIZE,BITS,IDXT> *self, unsigned i, T v, Temp *pt);
 
     public:
         /* No constructor or destructor - safe to treat as data */
@@ -140,6 +142,14 @@ namespace Random
         void init(MersenneRNG &rng);
 
         T eval(const T coords[VSIZE]);
+
+        /*
+         * Evaluate at count points that differ only in the given axis: the
+         * value of that axis is taken from values, the others from coords.
+         * Same results as separate eval calls, but the other axes are only
+         * set up once.
+         */
+        void eval_row(const T coords[VSIZE], unsigned axis, const T *values, T *out, unsigned count);
     };
 
 #ifndef DFHACK_RANDOM_CPP
@@ -173,6 +183,11 @@ namespace Random
             T tmp[3] = { x, y, z };
             return this->eval(tmp);
         }
+        // out[i] = (*this)(x, ys[i], z) for i < count
+        void eval_y(T x, const T *ys, T z, T *out, unsigned count) {
+            T tmp[3] = { x, 0, z };
+            this->eval_row(tmp, 1, ys, out, count);
+        }
     };
 }
 }
@@ -142,7 +142,7 @@ namespace DFHack
             Pen get_tile(unsigned int x, unsigned int y);
             void set_tile(unsigned int x, unsigned int y, Screen::Pen pen);
             void draw(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
-                unsigned int bufx = 0, unsigned int bufy = 0);
+                unsigned int bufx = 0, unsigned int bufy = 0, bool map = false);
         };
 
         struct DFHACK_EXPORT ViewRect {
@@ -201,6 +201,15 @@ namespace DFHack
         /// Paint one screen tile with the given pen
         DFHACK_EXPORT bool paintTile(const Pen &pen, int x, int y, bool map = false);
 
+        /// Paint count tiles starting at x,y and going right, one pen per tile.
+        /// Invalid pens (tile < 0) are skipped. Returns true if any tile was painted.
+        DFHACK_EXPORT bool paintSpan(const Pen *pens, size_t count, int x, int y, bool map = false);
+
+        /// Paint a width x height rectangle at x,y from a row-major pen buffer
+        /// whose rows are pitch pens apart. Much cheaper than a loop over
+        /// paintTile, since the target buffers are only resolved once.
+        DFHACK_EXPORT bool paintRect(const Pen *pens, size_t pitch, int x, int y, int width, int height, bool map = false);
+
         /// Retrieves one screen tile from the buffer
         DFHACK_EXPORT Pen readTile(int x, int y, bool map = false);
 
@@ -668,14 +668,23 @@ local internal = dfhack.internal
 Script = defclass(Script)
 function Script:init(path)
     self.path = path
-    self.mtime = dfhack.filesystem.mtime(path)
+    self.mtime = self:get_mtime()
     self._flags = {}
 end
+-- only stats the file if the script directories changed since the last check
+function Script:get_mtime()
+    local version = internal.getScriptsVersion()
+    if not version or version ~= self.checked_version then
+        self.checked_version = version
+        self.cur_mtime = dfhack.filesystem.mtime(self.path)
+    end
+    return self.cur_mtime
+end
 function Script:needs_update()
-    return (not self.env) or self.mtime ~= dfhack.filesystem.mtime(self.path)
+    return (not self.env) or self.mtime ~= self:get_mtime()
 end
 function Script:get_flags()
-    local mtime = dfhack.filesystem.mtime(self.path)
+    local mtime = self:get_mtime()
     if self.flags_mtime ~= mtime then
         self.flags_mtime = mtime
         self._flags = {}
@@ -812,7 +821,7 @@ function dfhack.run_script_with_env(envVars, name, flags, ...)
     env.moduleMode = flags.module
     local script_code
     local perr
-    local time = dfhack.filesystem.mtime(file)
+    local time = scripts[file]:get_mtime()
     if time == scripts[file].mtime and scripts[file].run then
         script_code = scripts[file].run
     else
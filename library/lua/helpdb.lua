@@ -14,6 +14,11 @@ local SCRIPT_DOC_END = ']====]'
 
 local GLOBAL_KEY = 'HELPDB'
 
+-- parsed help text is saved here so it doesn't have to be parsed again after a
+-- restart. set to false to disable the cache (the tests do this).
+CACHE_PATH = dfhack.getHackPath() .. 'cache/helpdb.lua'
+local CACHE_VERSION = 1
+
 -- enums
 local ENTRY_TYPES = {
     BUILTIN='builtin',
@@ -48,6 +53,7 @@ local BUILTINS = {
     ls=true,
     man='help',
     plug=true,
+    profile=true,
     reload=true,
     script=true,
     ['sc-script']=true,
@@ -88,10 +94,17 @@ local entrydb = {}
 -- will have an empty list.
 local tag_index = {}
 
+-- trigram -> list of entry names that contain it. used to narrow down the
+-- entries that search_entries has to check for substring filters.
+local name_index = {}
+
 ---------------------------------------------------------------------------
 -- data ingestion
 ---------------------------------------------------------------------------
 
+-- set when an entry is parsed from its source file instead of being reused
+local cache_dirty = false
+
 local function get_rendered_path(entry_name)
     return RENDERED_PATH .. entry_name .. '.txt'
 end
@@ -217,6 +230,7 @@ local function make_rendered_entry(old_entry, entry_name, kwargs)
         return old_entry
     end
     kwargs.source_path, kwargs.source_timestamp = source_path, source_timestamp
+    cache_dirty = true
     local entry = make_default_entry(entry_name, HELP_SOURCES.RENDERED, kwargs)
     local ok, lines = pcall(io.lines, source_path)
     if not ok then
@@ -248,13 +262,14 @@ end
 local function make_script_entry(old_entry, entry_name, kwargs)
     local source_path = kwargs.source_path
     local source_timestamp = dfhack.filesystem.mtime(source_path)
-    if old_entry and old_entry.source == HELP_SOURCES.SCRIPT and
+    if old_entry and old_entry.help_source == HELP_SOURCES.SCRIPT and
             old_entry.source_path == source_path and
             old_entry.source_timestamp >= source_timestamp then
         -- we already have the latest info
         return old_entry
     end
     kwargs.source_timestamp, kwargs.entry_type = source_timestamp
+    cache_dirty = true
     local entry = make_default_entry(entry_name, HELP_SOURCES.SCRIPT, kwargs)
     local ok, lines = pcall(io.lines, source_path)
     if not ok then
@@ -403,7 +418,86 @@ local function index_tags()
     end
 end
 
+local function index_names()
+    for entry_name in pairs(entrydb) do
+        local seen = {}
+        for i=1,#entry_name-2 do
+            local trigram = entry_name:sub(i, i+2)
+            if not seen[trigram] then
+                seen[trigram] = true
+                local names = name_index[trigram]
+                if not names then
+                    names = {}
+                    name_index[trigram] = names
+                end
+                table.insert(names, entry_name)
+            end
+        end
+    end
+end
+
+---------------------------------------------------------------------------
+-- persistent cache
+---------------------------------------------------------------------------
+
+-- only text parsed from files is cached. the cached entries are used like the
+-- entries of a previous scan: an entry is parsed again if its source file is
+-- newer than the cached text. the whole cache is dropped when the tag
+-- definitions change, since unknown tags are removed while parsing.
+
+local function is_cacheable(entry)
+    return entry.help_source == HELP_SOURCES.RENDERED or
+            entry.help_source == HELP_SOURCES.SCRIPT
+end
+
+local function load_cache()
+    if not CACHE_PATH then return nil end
+    local f = io.open(CACHE_PATH, 'rb')
+    if not f then return nil end
+    local text = f:read('a')
+    f:close()
+    local chunk = text and load(text, '=(helpdb cache)', 't', {})
+    if not chunk then return nil end
+    local ok, data = pcall(chunk)
+    if not ok or type(data) ~= 'table' or data.version ~= CACHE_VERSION or
+            data.tags_timestamp ~= dfhack.filesystem.mtime(TAG_DEFINITIONS) or
+            type(data.entries) ~= 'table' then
+        return nil
+    end
+    return data.entries
+end
+
+local function save_cache()
+    if not CACHE_PATH then return end
+    local lines = {('return {version=%d,tags_timestamp=%d,entries={'):format(
+            CACHE_VERSION, dfhack.filesystem.mtime(TAG_DEFINITIONS))}
+    for entry_name,entry in pairs(textdb) do
+        if is_cacheable(entry) then
+            local tags = {}
+            for tag in pairs(entry.tags) do
+                table.insert(tags, ('[%q]=true,'):format(tag))
+            end
+            table.insert(lines, ('[%q]={help_source=%q,short_help=%q,long_help=%q,tags={%s},source_timestamp=%d,source_path=%q},'):format(
+                    entry_name, entry.help_source, entry.short_help,
+                    entry.long_help, table.concat(tags),
+                    entry.source_timestamp, entry.source_path))
+        end
+    end
+    table.insert(lines, '}}\n')
+
+    dfhack.filesystem.mkdir_recursive(CACHE_PATH:match('^(.*)[/\\]') or '.')
+    local tmp_path = CACHE_PATH .. '.tmp'
+    local f = io.open(tmp_path, 'wb')
+    if not f then return end
+    local ok = f:write(table.concat(lines, '\n'))
+    f:close()
+    if not ok or not os.rename(tmp_path, CACHE_PATH) then
+        os.remove(tmp_path)
+    end
+end
+
 local needs_refresh = true
+local cache_loaded = false
 
 -- ensures the db is loaded
 local function ensure_db()
@@ -411,13 +505,34 @@ local function ensure_db()
     needs_refresh = false
 
     local old_db = textdb
-    textdb, entrydb, tag_index = {}, {}, {}
+    textdb, entrydb, tag_index, name_index = {}, {}, {}, {}
+
+    -- the first scan after startup starts from the cached text
+    local num_cached = 0
+    if not cache_loaded then
+        cache_loaded = true
+        old_db = load_cache() or old_db
+    end
+    for _,entry in pairs(old_db) do
+        if is_cacheable(entry) then num_cached = num_cached + 1 end
+    end
+    cache_dirty = false
 
     initialize_tags()
     scan_builtins(old_db)
     scan_plugins(old_db)
     scan_scripts(old_db)
     index_tags()
+    index_names()
+
+    -- also save when entries were removed
+    local num_cacheable = 0
+    for _,entry in pairs(textdb) do
+        if is_cacheable(entry) then num_cacheable = num_cacheable + 1 end
+    end
+    if cache_dirty or num_cacheable ~= num_cached then
+        save_cache()
+    end
 end
 
 function refresh()
@@ -631,6 +746,39 @@ local function matches(entry_name, filter)
     return true
 end
 
+-- returns a list of entry names that includes all the entries that contain
+-- str, or nil if str is too short to be looked up
+local function get_name_candidates(str)
+    if #str < 3 then return nil end
+    local best
+    for i=1,#str-2 do
+        local names = name_index[str:sub(i, i+2)]
+        if not names then return {} end
+        if not best or #names < #best then
+            best = names
+        end
+    end
+    return best
+end
+
+-- returns a set of entry names that includes every entry that can match the
+-- filters, or nil if all entries have to be checked
+local function get_candidates(filters)
+    if not filters then return nil end
+    local candidates = {}
+    for _,filter in ipairs(filters) do
+        if not filter.str then return nil end
+        for _,str in ipairs(filter.str) do
+            local names = get_name_candidates(str)
+            if not names then return nil end
+            for _,name in ipairs(names) do
+                candidates[name] = true
+            end
+        end
+    end
+    return candidates
+end
+
 local function matches_any(entry_name, filters)
     for _,filter in ipairs(filters) do
         if matches(entry_name, filter) then
@@ -687,7 +835,7 @@ function search_entries(include, exclude)
     include = normalize_filter_list(include)
     exclude = normalize_filter_list(exclude)
     local entries = {}
-    for entry in pairs(entrydb) do
+    for entry in pairs(get_candidates(include) or entrydb) do
         if (not include or matches_any(entry, include)) and
                 (not exclude or not matches_any(entry, exclude)) then
             table.insert(entries, entry)
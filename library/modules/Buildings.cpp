@@ -29,6 +29,7 @@ distribution.
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -105,6 +106,152 @@ struct CoordHash {
 
 static unordered_map<df::coord, int32_t, CoordHash> locationToBuilding;
 
+/*
+ * Spatial index of building and zone bounding boxes, used to answer
+ * findAtTile and findCivzonesAt without scanning every building.
+ *
+ * Each building is listed in every 16x16 cell (the size of a map block)
+ * that its bounding box overlaps. New and removed buildings are picked up
+ * by comparing against building_next_id and the size of buildings.all;
+ * zones and stockpiles can be repainted by the player, so their bounds are
+ * rechecked once per frame before the first query.
+ */
+bool buildings_index_dirty = true;
+
+namespace {
+    struct IndexedBounds {
+        int16_t x1, y1, x2, y2, z;
+    };
+
+    class BuildingIndex {
+        unordered_map<int32_t, IndexedBounds> bounds;
+        unordered_map<uint64_t, vector<int32_t>> cells;
+        int32_t next_id = -1;
+
+        static uint64_t cellKey(int x, int y, int z) {
+            return (uint64_t(uint16_t(z)) << 32) |
+                (uint64_t(uint16_t(x >> 4)) << 16) | uint16_t(y >> 4);
+        }
+
+        static IndexedBounds getBounds(df::building *bld) {
+            IndexedBounds b;
+            b.x1 = min(bld->x1, bld->x2);
+            b.y1 = min(bld->y1, bld->y2);
+            b.x2 = max(bld->x1, bld->x2);
+            b.y2 = max(bld->y1, bld->y2);
+            b.z = bld->z;
+            return b;
+        }
+
+        void link(int32_t id, const IndexedBounds &b) {
+            for (int cx = b.x1 >> 4; cx <= b.x2 >> 4; cx++)
+                for (int cy = b.y1 >> 4; cy <= b.y2 >> 4; cy++)
+                    cells[cellKey(cx << 4, cy << 4, b.z)].push_back(id);
+        }
+
+        void unlink(int32_t id, const IndexedBounds &b) {
+            for (int cx = b.x1 >> 4; cx <= b.x2 >> 4; cx++) {
+                for (int cy = b.y1 >> 4; cy <= b.y2 >> 4; cy++) {
+                    auto it = cells.find(cellKey(cx << 4, cy << 4, b.z));
+                    if (it == cells.end())
+                        continue;
+                    auto &ids = it->second;
+                    auto pos = std::find(ids.begin(), ids.end(), id);
+                    if (pos != ids.end()) {
+                        *pos = ids.back();
+                        ids.pop_back();
+                    }
+                    if (ids.empty())
+                        cells.erase(it);
+                }
+            }
+        }
+
+        void rebuild() {
+            clear();
+            for (auto bld : world->buildings.all)
+                insert(bld);
+            next_id = *building_next_id;
+        }
+
+    public:
+        void clear() {
+            bounds.clear();
+            cells.clear();
+            next_id = -1;
+        }
+
+        // adds the building or updates its bounds if they have changed
+        void insert(df::building *bld) {
+            IndexedBounds b = getBounds(bld);
+            auto it = bounds.find(bld->id);
+            if (it != bounds.end()) {
+                const IndexedBounds &old = it->second;
+                if (old.x1 == b.x1 && old.y1 == b.y1 && old.x2 == b.x2 &&
+                        old.y2 == b.y2 && old.z == b.z)
+                    return;
+                unlink(bld->id, old);
+                it->second = b;
+            } else {
+                bounds.emplace(bld->id, b);
+            }
+            link(bld->id, b);
+        }
+
+        // updates the bounds of a building that is already indexed
+        void refresh(df::building *bld) {
+            if (bounds.count(bld->id))
+                insert(bld);
+        }
+
+        void remove(int32_t id) {
+            auto it = bounds.find(id);
+            if (it == bounds.end())
+                return;
+            unlink(id, it->second);
+            bounds.erase(it);
+        }
+
+        void sync() {
+            if (!world || !building_next_id)
+                return;
+
+            auto &all = world->buildings.all;
+            if (next_id < 0 || next_id > *building_next_id) {
+                rebuild();
+            } else if (next_id != *building_next_id) {
+                // buildings.all is sorted by id
+                auto it = std::lower_bound(all.begin(), all.end(), next_id,
+                    [](df::building *bld, int32_t id) { return bld->id < id; });
+                for (; it != all.end(); ++it)
+                    insert(*it);
+                next_id = *building_next_id;
+            }
+
+            // anything missing or left over means we missed a removal
+            if (bounds.size() != all.size())
+                rebuild();
+
+            if (buildings_index_dirty) {
+                buildings_index_dirty = false;
+                for (auto zone : world->buildings.other.ANY_ZONE)
+                    insert(zone);
+                for (auto stockpile : world->buildings.other.STOCKPILE)
+                    insert(stockpile);
+            }
+        }
+
+        // ids of the buildings whose bounding box may contain pos
+        const vector<int32_t> *candidates(df::coord pos) {
+            sync();
+            auto it = cells.find(cellKey(pos.x, pos.y, pos.z));
+            return it == cells.end() ? nullptr : &it->second;
+        }
+    };
+}
+
+static BuildingIndex building_index;
+
 static df::building_extents_type *getExtentTile(df::building_extents &extent, df::coord2d tile)
 {
     if (!extent.extents)
@@ -123,6 +270,8 @@ static df::building_extents_type *getExtentTile(df::building_extents &extent, df
  */
 bool buildings_do_onupdate = false;
 
+static void clearStockpileContents();
+
 void buildings_onStateChange(color_ostream &out, state_change_event event)
 {
     switch (event) {
@@ -131,6 +280,7 @@ void buildings_onStateChange(color_ostream &out, state_change_event event)
         break;
     case SC_MAP_UNLOADED:
         buildings_do_onupdate = false;
+        clearStockpileContents();
         break;
     default:
         break;
@@ -413,11 +563,21 @@ df::building *Buildings::findAtTile(df::coord pos)
         }
     }
 
-    // The authentic method, i.e. how the game generally does this:
-    auto &vec = df::building::get_vector();
-    for (size_t i = 0; i < vec.size(); i++)
+    // Otherwise check the buildings whose bounds overlap the tile, picking
+    // the lowest id like the game's scan over the whole vector does:
+    auto ids = building_index.candidates(pos);
+    if (!ids)
+        return NULL;
+
+    df::building *found = NULL;
+    for (int32_t id : *ids)
     {
-        auto bld = vec[i];
+        if (found && found->id < id)
+            continue;
+
+        auto bld = df::building::find(id);
+        if (!bld)
+            continue;
 
         if (pos.z != bld->z ||
             pos.x < bld->x1 || pos.x > bld->x2 ||
@@ -434,10 +594,10 @@ df::building *Buildings::findAtTile(df::coord pos)
                 continue;
         }
 
-        return bld;
+        found = bld;
     }
 
-    return NULL;
+    return found;
 }
 
 static unordered_map<int32_t, df::coord> corner1;
@@ -464,9 +624,18 @@ bool Buildings::findCivzonesAt(std::vector<df::building_civzonest*> *pvec,
                                df::coord pos) {
     pvec->clear();
 
-    for (df::building_civzonest* zone : world->buildings.other.ANY_ZONE)
+    auto ids = building_index.candidates(pos);
+    if (!ids)
+        return false;
+
+    for (int32_t id : *ids)
     {
-        if (pos.z != zone->z)
+        auto bld = df::building::find(id);
+        if (!bld || bld->getType() != building_type::Civzone || pos.z != bld->z)
+            continue;
+
+        auto zone = strict_virtual_cast<df::building_civzonest>(bld);
+        if (!zone)
             continue;
 
         if (zone->room.extents && zone->isExtentShaped())
@@ -479,6 +648,10 @@ bool Buildings::findCivzonesAt(std::vector<df::building_civzonest*> *pvec,
         }
     }
 
+    // keep the order of the ANY_ZONE vector
+    std::sort(pvec->begin(), pvec->end(),
+        [](df::building_civzonest *a, df::building_civzonest *b) { return a->id < b->id; });
+
     return !pvec->empty();
 }
 
@@ -941,6 +1114,7 @@ bool Buildings::setSize(df::building *bld, df::coord2d size, int direction)
     bld->y2 = bld->y1 + size.y - 1;
     bld->centerx = bld->x1 + center.x;
     bld->centery = bld->y1 + center.y;
+    building_index.refresh(bld);
 
     auto type = bld->getType();
 
@@ -1087,6 +1261,7 @@ static void linkBuilding(df::building *bld)
 
     world->buildings.all.push_back(bld);
     bld->categorize(true);
+    building_index.insert(bld);
 
     if (bld->isSettingOccupancy())
         markBuildingTiles(bld, false);
@@ -1392,6 +1567,7 @@ bool Buildings::deconstruct(df::building *bld)
     // Don't clear arrows.
 
     bld->uncategorize();
+    building_index.remove(id);
 
     remove_building_from_all_zones(bld);
 
@@ -1446,6 +1622,8 @@ void Buildings::notifyCivzoneModified(df::building* bld)
     if (bld->getType() != building_type::Civzone)
         return;
 
+    building_index.refresh(bld);
+
     //remove zone here needs to be the slow method
     remove_zone_from_all_buildings(bld);
     add_zone_to_all_buildings(bld);
@@ -1455,6 +1633,7 @@ void Buildings::clearBuildings(color_ostream& out) {
     corner1.clear();
     corner2.clear();
     locationToBuilding.clear();
+    building_index.clear();
 }
 
 void Buildings::updateBuildings(color_ostream&, void* ptr)
@@ -1464,15 +1643,20 @@ void Buildings::updateBuildings(color_ostream&, void* ptr)
 
     if (building)
     {
+        building_index.insert(building);
+
         bool is_civzone = !building->isSettingOccupancy();
         if (!corner1.count(id) && !is_civzone)
             cacheBuilding(building);
+        return;
     }
-    else if (corner1.count(id))
+
+    building_index.remove(id);
+
+    if (corner1.count(id))
     {
         // existing building: destroy it
-        // note that civzones are lazy-destroyed in findCivzonesAt() and are
-        // not handled here
+        // note that civzones do not occupy tiles and are not handled here
         df::coord p1 = corner1[id];
         df::coord p2 = corner2[id];
 
@@ -1557,19 +1741,6 @@ std::string Buildings::getRoomDescription(df::building *building, df::unit *unit
 */ return "";
 }
 
-void Buildings::getStockpileContents(df::building_stockpilest *stockpile, std::vector<df::item*> *items)
-{
-    CHECK_NULL_POINTER(stockpile);
-
-    items->clear();
-
-    Buildings::StockpileIterator stored;
-    for (stored.begin(stockpile); !stored.done(); ++stored) {
-        df::item *item = *stored;
-        items->push_back(item);
-    }
-}
-
 bool Buildings::isActivityZone(df::building * building)
 {
     CHECK_NULL_POINTER(building);
@@ -1624,63 +1795,166 @@ df::building* Buildings::findPenPitAt(df::coord coord)
     return NULL;
 }
 
-using Buildings::StockpileIterator;
-StockpileIterator& StockpileIterator::operator++() {
-    while (stockpile) {
-        if (block) {
-            // Check the next item in the current block.
-            ++current;
-        }
-        else if (stockpile->x2 < 0 || stockpile->y2 < 0 || stockpile->z < 0 || stockpile->x1 > world->map.x_count - 1 || stockpile->y1 > world->map.y_count - 1 || stockpile->z > world->map.z_count - 1) {
-            // if the stockpile bounds exist outside of valid map plane then no items can be in the stockpile
-            block = NULL;
-            item = NULL;
-            return *this;
-        } else {
-            // Start with the top-left block covering the stockpile.
-            block = Maps::getTileBlock(std::min(std::max(stockpile->x1, 0), world->map.x_count-1), std::min(std::max(stockpile->y1, 0), world->map.y_count-1), stockpile->z);
-            current = 0;
+/*
+ * Cache of the items stored on each stockpile.
+ *
+ * DF does not announce item moves, so the cache is tied to a generation that
+ * is bumped every tick and by the Items module whenever it moves, creates or
+ * removes an item. Within a generation, iterating a stockpile only touches
+ * the items stored there.
+ *
+ * When the generation changed, the blocks under the stockpile are checked
+ * against a snapshot of their item lists. The snapshot keeps the pointer for
+ * every item id, so only the items that entered a block since the last check
+ * need df::item::find. The snapshot is shared by all stockpiles on the block.
+ */
+uint32_t stockpile_contents_generation = 1;
+
+namespace {
+    struct BlockItems {
+        uint32_t generation = 0;
+        vector<int32_t> ids;
+        vector<df::item *> items;
+    };
+
+    struct StockpileContents {
+        uint32_t generation = 0;
+        int32_t x1, y1, x2, y2, z;
+        shared_ptr<const vector<df::item *>> items;
+    };
+
+    unordered_map<df::map_block *, BlockItems> block_items;
+    unordered_map<int32_t, StockpileContents> stockpile_contents;
+
+    const vector<df::item *> &syncBlock(df::map_block *block) {
+        BlockItems &snap = block_items[block];
+        if (snap.generation == stockpile_contents_generation)
+            return snap.items;
+        snap.generation = stockpile_contents_generation;
+        if (snap.ids == block->items)
+            return snap.items;
+
+        unordered_map<int32_t, df::item *> known;
+        known.reserve(snap.ids.size());
+        for (size_t i = 0; i < snap.ids.size(); i++)
+            known.emplace(snap.ids[i], snap.items[i]);
+
+        snap.ids.clear();
+        snap.items.clear();
+        for (int32_t id : block->items) {
+            auto it = known.find(id);
+            df::item *item = it != known.end() ? it->second : df::item::find(id);
+            if (!item)
+                continue;
+            snap.ids.push_back(id);
+            snap.items.push_back(item);
         }
+        return snap.items;
+    }
 
-        while (current >= block->items.size()) {
-            // Out of items in this block; find the next block to search.
-            if (block->map_pos.x + 16 <= std::min(stockpile->x2, world->map.x_count-1)) {
-                block = Maps::getTileBlock(block->map_pos.x + 16, block->map_pos.y, stockpile->z);
-                current = 0;
-            } else if (block->map_pos.y + 16 <= std::min(stockpile->y2, world->map.y_count-1)) {
-                block = Maps::getTileBlock(std::max(stockpile->x1, 0), block->map_pos.y + 16, stockpile->z);
-                current = 0;
-            } else {
-                // All items in all blocks have been checked.
-                block = NULL;
-                item = NULL;
-                return *this;
-            }
-        }
+    bool isStoredOn(df::building_stockpilest *stockpile, df::item *item) {
+        if (!item->flags.bits.on_ground)
+            return false;
+        if (!Buildings::containsTile(stockpile, item->pos))
+            return false;
+        // Ignore empty bins, barrels, and wheelbarrows assigned here.
+        if (item->isAssignedToThisStockpile(stockpile->id) &&
+                !Items::getGeneralRef(item, df::general_ref_type::CONTAINS_ITEM))
+            return false;
+        return true;
+    }
 
-        // If the current item isn't properly stored, move on to the next.
-        item = df::item::find(block->items[current]);
-        if (!item->flags.bits.on_ground) {
-            continue;
-        }
+    void collectContents(df::building_stockpilest *stockpile, vector<df::item *> *out) {
+        // if the stockpile bounds exist outside of valid map plane then no items can be in the stockpile
+        if (stockpile->x2 < 0 || stockpile->y2 < 0 || stockpile->z < 0 ||
+                stockpile->x1 > world->map.x_count - 1 ||
+                stockpile->y1 > world->map.y_count - 1 ||
+                stockpile->z > world->map.z_count - 1)
+            return;
 
-        if (!Buildings::containsTile(stockpile, item->pos)) {
-            continue;
-        }
+        int x1 = std::max(stockpile->x1, 0) & ~15;
+        int y1 = std::max(stockpile->y1, 0) & ~15;
+        int x2 = std::min(stockpile->x2, world->map.x_count - 1);
+        int y2 = std::min(stockpile->y2, world->map.y_count - 1);
 
-        // Ignore empty bins, barrels, and wheelbarrows assigned here.
-        if (item->isAssignedToThisStockpile(stockpile->id)) {
-            auto ref = Items::getGeneralRef(item, df::general_ref_type::CONTAINS_ITEM);
-            if (!ref) continue;
+        // top left block first, moving right, row by row
+        for (int y = y1; y <= y2; y += 16) {
+            for (int x = x1; x <= x2; x += 16) {
+                df::map_block *block = Maps::getTileBlock(x, y, stockpile->z);
+                if (!block)
+                    continue;
+                for (df::item *item : syncBlock(block))
+                    if (isStoredOn(stockpile, item))
+                        out->push_back(item);
+            }
         }
+    }
 
-        // Found a valid item; yield it.
-        break;
+    shared_ptr<const vector<df::item *>> getContents(df::building_stockpilest *stockpile) {
+        // forget demolished stockpiles once in a while
+        if (stockpile_contents.size() > 2 * world->buildings.other.STOCKPILE.size() + 16)
+            stockpile_contents.clear();
+
+        StockpileContents &entry = stockpile_contents[stockpile->id];
+        if (entry.items && entry.generation == stockpile_contents_generation &&
+                entry.x1 == stockpile->x1 && entry.y1 == stockpile->y1 &&
+                entry.x2 == stockpile->x2 && entry.y2 == stockpile->y2 &&
+                entry.z == stockpile->z)
+            return entry.items;
+
+        auto items = make_shared<vector<df::item *>>();
+        if (entry.items)
+            items->reserve(entry.items->size());
+        collectContents(stockpile, items.get());
+
+        entry.generation = stockpile_contents_generation;
+        entry.x1 = stockpile->x1;
+        entry.y1 = stockpile->y1;
+        entry.x2 = stockpile->x2;
+        entry.y2 = stockpile->y2;
+        entry.z = stockpile->z;
+        entry.items = items;
+        return items;
     }
+}
 
+static void clearStockpileContents()
+{
+    block_items.clear();
+    stockpile_contents.clear();
+}
+
+using Buildings::StockpileIterator;
+void StockpileIterator::begin(df::building_stockpilest* sp) {
+    items.reset();
+    item = NULL;
+    if (!sp)
+        return;
+    items = getContents(sp);
+    current = 0;
+    item = items->empty() ? NULL : (*items)[0];
+}
+
+StockpileIterator& StockpileIterator::operator++() {
+    if (!item)
+        return *this;
+    if (++current < items->size()) {
+        item = (*items)[current];
+    } else {
+        item = NULL;
+        items.reset();
+    }
     return *this;
 }
 
+void Buildings::getStockpileContents(df::building_stockpilest *stockpile, std::vector<df::item*> *items)
+{
+    CHECK_NULL_POINTER(stockpile);
+
+    auto contents = getContents(stockpile);
+    items->assign(contents->begin(), contents->end());
+}
+
 bool Buildings::getCageOccupants(df::building_cagest *cage, vector<df::unit*> &units)
 {
     CHECK_NULL_POINTER(cage);
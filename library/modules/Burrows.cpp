@@ -25,8 +25,10 @@ distribution.
 
 #include "Internal.h"
 
+#include <algorithm>
 #include <vector>
 #include <cstdlib>
+#include <unordered_map>
 using namespace std;
 
 #include "Core.h"
@@ -116,10 +118,176 @@ void Burrows::setAssignedUnit(df::burrow *burrow, df::unit *unit, bool enable)
     }
 }
 
+// Bumped by Core every frame and on state changes. DF adds and removes burrow
+// masks only while DFHack is not running, so index entries built in an older
+// generation may point to freed masks or blocks and are rebuilt on next use.
+uint32_t burrows_index_generation = 1;
+
+namespace {
+    // Lookup table from the map blocks in the bounding box of a burrow to the
+    // burrow's tile mask in each block. The masks stay owned by their blocks,
+    // so tile changes made through a mask are always visible; only adding and
+    // removing masks has to be tracked here.
+    struct BurrowIndex
+    {
+        // burrows that are only checked a few times per frame keep walking the
+        // block lists instead of paying for a full build every frame
+        static const uint32_t BUILD_THRESHOLD = 16;
+
+        uint32_t generation = 0;
+        uint32_t lookups = 0;
+        bool built = false;
+
+        df::coord origin;
+        int dim_x = 0, dim_y = 0, dim_z = 0;
+        std::vector<df::block_burrow*> masks;
+        // in the order of the burrow's block_x/y/z vectors
+        std::vector<df::map_block*> blocks;
+
+        df::block_burrow **slot(df::coord bpos)
+        {
+            int x = bpos.x - origin.x, y = bpos.y - origin.y, z = bpos.z - origin.z;
+            if (x < 0 || y < 0 || z < 0 || x >= dim_x || y >= dim_y || z >= dim_z)
+                return NULL;
+            return &masks[(size_t(z) * dim_y + y) * dim_x + x];
+        }
+    };
+
+    std::unordered_map<int32_t, BurrowIndex> burrow_index;
+
+    BurrowIndex &getIndex(df::burrow *burrow)
+    {
+        auto &idx = burrow_index[burrow->id];
+        if (idx.generation != burrows_index_generation)
+        {
+            idx.generation = burrows_index_generation;
+            idx.lookups = 0;
+            idx.built = false;
+        }
+        return idx;
+    }
+}
+
+static df::block_burrow *walkBlockMask(int32_t id, df::map_block *block)
+{
+    for (auto link = block->block_burrows.next; link; link = link->next)
+        if (link->item->id == id)
+            return link->item;
+    return NULL;
+}
+
+// local block coordinates of the block
+static df::coord blockPos(df::map_block *block)
+{
+    return block->map_pos / 16;
+}
+
+static void buildIndex(BurrowIndex &idx, df::burrow *burrow, df::coord extra = df::coord())
+{
+    df::coord base(world->map.region_x*3,world->map.region_y*3,world->map.region_z);
+
+    idx.blocks.clear();
+    idx.blocks.reserve(burrow->block_x.size());
+
+    df::coord lo, hi;
+    bool any = false;
+    auto include = [&](df::coord pos) {
+        if (!any) {
+            lo = hi = pos;
+            any = true;
+            return;
+        }
+        lo.x = std::min(lo.x, pos.x); hi.x = std::max(hi.x, pos.x);
+        lo.y = std::min(lo.y, pos.y); hi.y = std::max(hi.y, pos.y);
+        lo.z = std::min(lo.z, pos.z); hi.z = std::max(hi.z, pos.z);
+    };
+
+    for (size_t i = 0; i < burrow->block_x.size(); i++)
+    {
+        df::coord pos(burrow->block_x[i], burrow->block_y[i], burrow->block_z[i]);
+
+        auto block = Maps::getBlock(pos - base);
+        if (!block)
+            continue;
+        idx.blocks.push_back(block);
+        include(blockPos(block));
+    }
+    if (extra.isValid())
+        include(extra);
+
+    // leave room around the burrow, so growing it by painting or flood
+    // filling does not need a rebuild for every new block
+    if (any)
+    {
+        lo.x = std::max(0, lo.x - 2); hi.x += 2;
+        lo.y = std::max(0, lo.y - 2); hi.y += 2;
+        lo.z = std::max(0, lo.z - 1); hi.z += 1;
+        idx.origin = lo;
+        idx.dim_x = hi.x - lo.x + 1;
+        idx.dim_y = hi.y - lo.y + 1;
+        idx.dim_z = hi.z - lo.z + 1;
+    }
+    else
+        idx.dim_x = idx.dim_y = idx.dim_z = 0;
+
+    idx.masks.assign(size_t(idx.dim_x) * idx.dim_y * idx.dim_z, NULL);
+    for (auto block : idx.blocks)
+        *idx.slot(blockPos(block)) = walkBlockMask(burrow->id, block);
+
+    idx.built = true;
+}
+
+static df::block_burrow *findBlockMask(df::burrow *burrow, df::map_block *block)
+{
+    auto &idx = getIndex(burrow);
+    if (!idx.built)
+    {
+        if (++idx.lookups < BurrowIndex::BUILD_THRESHOLD)
+            return walkBlockMask(burrow->id, block);
+        buildIndex(idx, burrow);
+    }
+
+    auto slot = idx.slot(blockPos(block));
+    return slot ? *slot : NULL;
+}
+
+static void indexAddMask(df::burrow *burrow, df::map_block *block, df::block_burrow *mask)
+{
+    auto &idx = getIndex(burrow);
+    if (!idx.built)
+        return;
+
+    idx.blocks.push_back(block);
+    if (auto slot = idx.slot(blockPos(block)))
+        *slot = mask;
+    else
+        buildIndex(idx, burrow, blockPos(block));
+}
+
+static void indexRemoveMask(df::burrow *burrow, df::map_block *block)
+{
+    auto &idx = getIndex(burrow);
+    if (!idx.built)
+        return;
+
+    if (auto slot = idx.slot(blockPos(block)))
+        *slot = NULL;
+    auto it = std::find(idx.blocks.begin(), idx.blocks.end(), block);
+    if (it != idx.blocks.end())
+        idx.blocks.erase(it);
+}
+
 void Burrows::listBlocks(std::vector<df::map_block*> *pvec, df::burrow *burrow)
 {
     CHECK_NULL_POINTER(burrow);
 
+    auto &idx = getIndex(burrow);
+    if (idx.built)
+    {
+        *pvec = idx.blocks;
+        return;
+    }
+
     pvec->clear();
     pvec->reserve(burrow->block_x.size());
 
@@ -169,6 +337,7 @@ void Burrows::clearTiles(df::burrow *burrow)
     burrow->block_x.clear();
     burrow->block_y.clear();
     burrow->block_z.clear();
+    burrow_index.erase(burrow->id);
 }
 
 df::block_burrow *Burrows::getBlockMask(df::burrow *burrow, df::map_block *block, bool create)
@@ -176,17 +345,21 @@ df::block_burrow *Burrows::getBlockMask(df::burrow *burrow, df::map_block *block
     CHECK_NULL_POINTER(burrow);
     CHECK_NULL_POINTER(block);
 
-    int32_t id = burrow->id;
-    df::block_burrow_link *prev = &block->block_burrows;
-    df::block_burrow_link *link = prev->next;
-
-    for (; link; prev = link, link = link->next)
-        if (link->item->id == id)
-            return link->item;
+    if (auto mask = findBlockMask(burrow, block))
+        return mask;
 
     if (create)
     {
-        link = new df::block_burrow_link;
+        df::block_burrow_link *prev = &block->block_burrows;
+        for (; prev->next; prev = prev->next)
+        {
+            // the mask exists, but the block is missing from the burrow's
+            // block list
+            if (prev->next->item->id == burrow->id)
+                return prev->next->item;
+        }
+
+        auto link = new df::block_burrow_link;
         link->item = new df::block_burrow;
 
         link->item->id = burrow->id;
@@ -204,6 +377,8 @@ df::block_burrow *Burrows::getBlockMask(df::burrow *burrow, df::map_block *block
         burrow->block_y.push_back(pos.y);
         burrow->block_z.push_back(pos.z);
 
+        indexAddMask(burrow, block, link->item);
+
         return link->item;
     }
 
@@ -221,6 +396,7 @@ bool Burrows::deleteBlockMask(df::burrow *burrow, df::map_block *block, df::bloc
     df::coord base(world->map.region_x*3,world->map.region_y*3,world->map.region_z);
     df::coord pos = base + block->map_pos/16;
 
+    indexRemoveMask(burrow, block);
     destroyBurrowMask(mask);
 
     for (size_t i = 0; i < burrow->block_x.size(); i++)
@@ -246,7 +422,7 @@ bool Burrows::isAssignedBlockTile(df::burrow *burrow, df::map_block *block, df::
 
     if (!block) return false;
 
-    auto mask = getBlockMask(burrow, block);
+    auto mask = findBlockMask(burrow, block);
 
     return mask ? mask->getassignment(tile & 15) : false;
 }
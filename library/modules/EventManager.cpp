@@ -69,7 +69,7 @@ static int32_t eventLastTick[EventType::EVENT_MAX];
 static const int32_t ticksPerYear = 403200;
 
 void DFHack::EventManager::registerListener(EventType::EventType e, EventHandler handler, Plugin* plugin) {
-    DEBUG(log).print("registering handler %p from plugin %s for event %d\n", handler.eventHandler, plugin->getName().c_str(), e);
+    DEBUG(log).print("registering handler %p from plugin %s for event %d\n", handler.eventHandler, (plugin ? plugin->getName().c_str() : "core"), e);
     handlers[e].insert(pair<Plugin*, EventHandler>(plugin, handler));
 }
 
@@ -85,7 +85,7 @@ int32_t DFHack::EventManager::registerTick(EventHandler handler, int32_t when, P
     }
     handler.freq = when;
     tickQueue.insert(pair<int32_t, EventHandler>(handler.freq, handler));
-    DEBUG(log).print("registering handler %p from plugin %s for event TICK\n", handler.eventHandler, plugin->getName().c_str());
+    DEBUG(log).print("registering handler %p from plugin %s for event TICK\n", handler.eventHandler, (plugin ? plugin->getName().c_str() : "core"));
     handlers[EventType::TICK].insert(pair<Plugin*,EventHandler>(plugin,handler));
     return when;
 }
@@ -111,7 +111,7 @@ void DFHack::EventManager::unregister(EventType::EventType e, EventHandler handl
             i++;
             continue;
         }
-        DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, plugin->getName().c_str(), e);
+        DEBUG(log).print("unregistering handler %p from plugin %s for event %d\n", handler.eventHandler, (plugin ? plugin->getName().c_str() : "core"), e);
         i = handlers[e].erase(i);
         if ( e == EventType::TICK )
             removeFromTickQueue(handler);
@@ -119,7 +119,7 @@ void DFHack::EventManager::unregister(EventType::EventType e, EventHandler handl
 }
 
 void DFHack::EventManager::unregisterAll(Plugin* plugin) {
-    DEBUG(log).print("unregistering all handlers for plugin %s\n", plugin->getName().c_str());
+    DEBUG(log).print("unregistering all handlers for plugin %s\n", (plugin ? plugin->getName().c_str() : "core"));
     for ( auto i = handlers[EventType::TICK].find(plugin); i != handlers[EventType::TICK].end(); i++ ) {
         if ( (*i).first != plugin )
             break;
@@ -0,0 +1,239 @@
+/*
+https://github.com/peterix/dfhack
+Copyright (c) 2009-2012 Petr Mrázek (peterix@gmail.com)
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any
+damages arising from the use of this software.
+
+Permission is granted to anyone to use this software for any
+purpose, including commercial applications, and to alter it and
+redistribute it freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must
+not claim that you wrote the original software. If you use this
+software in a product, an acknowledgment in the product documentation
+would be appreciated but is not required.
+
+2. Altered source versions must be plainly marked as such, and
+must not be misrepresented as being the original software.
+
+3. This notice may not be removed or altered from any source
+distribution.
+*/
+
+#include "Core.h"
+#include "Error.h"
+#include "PluginManager.h"
+#include "Profiler.h"
+
+#include "modules/ItemSweep.h"
+
+#include "df/item.h"
+#include "df/world.h"
+
+#include <algorithm>
+
+using namespace DFHack;
+using df::global::world;
+
+// bumped by Core::onUpdate; items only change between updates
+uint32_t item_sweep_generation = 1;
+
+namespace {
+    struct Entry
+    {
+        int id;
+        Plugin *owner;
+        ItemSweep::Filter filter;
+        ItemSweep::Subscriber *sub;
+        bool fed;
+        // update generation and frame_counter of the last sweep seen
+        uint32_t generation;
+        int32_t tick;
+        // frame_counter, max_age and spacing of the periodic refreshes, i.e.
+        // the ones that accept older items
+        int32_t periodic_tick;
+        int32_t periodic_age;
+        int32_t periodic_interval;
+    };
+
+    std::vector<Entry> entries;
+    int next_id = 1;
+    bool sweeping = false;
+
+    Entry *find(int id)
+    {
+        for (auto &entry : entries)
+            if (entry.id == id)
+                return &entry;
+        return NULL;
+    }
+
+    bool is_fresh(const Entry &entry, int32_t now, int32_t max_age)
+    {
+        if (!entry.fed)
+            return false;
+        if (entry.generation == item_sweep_generation)
+            return true;
+        return max_age > 0 && now >= entry.tick && now - entry.tick <= max_age;
+    }
+
+    bool wants(const Entry &entry, df::item *item)
+    {
+        uint32_t flags = item->flags.whole;
+        return !(flags & entry.filter.bad_flags) &&
+            (flags & entry.filter.good_flags) == entry.filter.good_flags;
+    }
+
+    // true if the next periodic refresh of the subscriber is expected soon
+    // enough to accept the items seen now, and would have to sweep otherwise.
+    // subscribers that only refresh on demand are never due.
+    bool is_due(const Entry &entry, int32_t now)
+    {
+        if (entry.owner && !entry.owner->is_enabled())
+            return false;
+        if (entry.periodic_interval <= 0)
+            return false;
+        int32_t next = entry.periodic_tick + entry.periodic_interval;
+        if (next - now > entry.periodic_age)
+            return false;
+        return !entry.fed || next - entry.tick > entry.periodic_age;
+    }
+
+    void sweep(Entry *requester, int32_t now)
+    {
+        static Profiler::Stats *sweep_stats = Profiler::getStats("core/itemsweep");
+        Profiler::ScopedTimer timer(sweep_stats);
+
+        // other subscribers only take part when that saves their next periodic
+        // refresh a sweep, so a refresh for a UI does not run the counting of
+        // every other plugin
+        std::vector<Entry *> active;
+        for (auto &entry : entries)
+        {
+            if (&entry == requester || is_due(entry, now))
+                active.push_back(&entry);
+        }
+
+        const size_t num_types = ENUM_LAST_ITEM(item_type) + 1;
+        std::vector<std::vector<Entry *>> by_type(num_types);
+        std::vector<Entry *> any_type;
+        for (auto entry : active)
+        {
+            if (entry->filter.types.empty())
+                any_type.push_back(entry);
+            for (auto type : entry->filter.types)
+            {
+                if (type >= 0 && size_t(type) < num_types)
+                    by_type[type].push_back(entry);
+            }
+        }
+
+        sweeping = true;
+        for (auto entry : active)
+            entry->sub->begin();
+
+        for (auto item : world->items.other.IN_PLAY)
+        {
+            for (auto entry : any_type)
+            {
+                if (wants(*entry, item))
+                    entry->sub->visit(item);
+            }
+
+            int type = item->getType();
+            if (type < 0 || size_t(type) >= num_types)
+                continue;
+            for (auto entry : by_type[type])
+            {
+                if (wants(*entry, item))
+                    entry->sub->visit(item);
+            }
+        }
+
+        for (auto entry : active)
+        {
+            entry->sub->end();
+            entry->fed = true;
+            entry->generation = item_sweep_generation;
+            entry->tick = now;
+        }
+        sweeping = false;
+    }
+}
+
+void itemsweep_onStateChange(color_ostream &out, state_change_event event)
+{
+    // the counts and ticks of the subscribers belong to the previous world
+    if (event == SC_WORLD_LOADED || event == SC_WORLD_UNLOADED)
+    {
+        for (auto &entry : entries)
+        {
+            entry.fed = false;
+            entry.periodic_tick = -1;
+            entry.periodic_interval = 0;
+        }
+    }
+}
+
+int ItemSweep::subscribe(Plugin *owner, const Filter &filter, Subscriber *sub)
+{
+    CHECK_NULL_POINTER(sub);
+    // adding an entry could move the ones the sweep is feeding
+    CHECK_INVALID_ARGUMENT(!sweeping);
+
+    Entry entry;
+    entry.id = next_id++;
+    entry.owner = owner;
+    entry.filter = filter;
+    entry.sub = sub;
+    entry.fed = false;
+    entry.generation = 0;
+    entry.tick = -1;
+    entry.periodic_tick = -1;
+    entry.periodic_age = 0;
+    entry.periodic_interval = 0;
+
+    // drop duplicates so an item is not visited twice by one subscriber
+    auto &types = entry.filter.types;
+    std::sort(types.begin(), types.end());
+    types.erase(std::unique(types.begin(), types.end()), types.end());
+
+    entries.push_back(entry);
+    return entry.id;
+}
+
+void ItemSweep::unsubscribe(int id)
+{
+    CHECK_INVALID_ARGUMENT(!sweeping);
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+        [id](const Entry &entry) { return entry.id == id; }), entries.end());
+}
+
+void ItemSweep::unsubscribeAll(Plugin *owner)
+{
+    CHECK_INVALID_ARGUMENT(!sweeping);
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+        [owner](const Entry &entry) { return entry.owner == owner; }), entries.end());
+}
+
+bool ItemSweep::refresh(int id, int32_t max_age)
+{
+    Entry *entry = find(id);
+    if (!entry || sweeping || !world || !Core::getInstance().isWorldLoaded())
+        return false;
+
+    int32_t now = world->frame_counter;
+    if (max_age > 0 && now != entry->periodic_tick)
+    {
+        if (entry->periodic_tick >= 0 && now > entry->periodic_tick)
+            entry->periodic_interval = now - entry->periodic_tick;
+        entry->periodic_tick = now;
+        entry->periodic_age = max_age;
+    }
+
+    if (!is_fresh(*entry, now, max_age))
+        sweep(entry, now);
+    return true;
+}
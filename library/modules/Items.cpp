@@ -865,8 +865,13 @@ static void resetUnitInvFlags(df::unit *unit, df::unit_inventory_item *inv_item)
     }
 }
 
+// Buildings keeps the contents of each stockpile until this changes
+extern uint32_t stockpile_contents_generation;
+
 static bool detachItem(MapExtras::MapCache &mc, df::item *item)
 {
+    stockpile_contents_generation++;
+
     if (!item->specific_refs.empty())
         return false;
     if (item->world_data_id != -1)
@@ -2125,6 +2130,7 @@ int32_t Items::createItem(df::item_type item_type, int16_t item_subtype, int16_t
     for (size_t a = 0; a < out_items.size(); a++ ) {
         out_items[a]->moveToGround(unit->pos.x, unit->pos.y, unit->pos.z);
     }
+    stockpile_contents_generation++;
 
     return out_items[0]->id;
 }
@@ -2222,6 +2228,15 @@ bool Items::canTradeAnyWithContents(df::item *item)
 
     vector<df::item*> contained_items;
     getContainedItems(item, &contained_items);
+    return canTradeAnyWithContents(item, contained_items);
+}
+
+bool Items::canTradeAnyWithContents(df::item *item, const vector<df::item *> &contained_items)
+{
+    CHECK_NULL_POINTER(item);
+
+    if (item->flags.bits.in_inventory)
+        return false;
 
     if (contained_items.empty())
         return canTrade(item);
@@ -58,6 +58,9 @@ using namespace std;
 using namespace DFHack;
 using namespace df::enums;
 
+// bumped by Core whenever DF may have changed the job list; see getJobs
+uint32_t job_registry_generation = 1;
+
 df::job *DFHack::Job::cloneJobStruct(df::job *job, bool keepEverything)
 {
     CHECK_NULL_POINTER(job);
@@ -360,6 +363,8 @@ bool DFHack::Job::removeJob(df::job* job) {
     using df::global::world;
     CHECK_NULL_POINTER(job);
 
+    job_registry_generation++;
+
     // cancel_job below does not clean up all refs, so we have to do some work
 
     // manually handle DESTROY_BUILDING jobs (cancel_job doesn't handle them)
@@ -451,6 +456,8 @@ bool DFHack::Job::linkIntoWorld(df::job *job, bool new_id)
 
     assert(!job->list_link);
 
+    job_registry_generation++;
+
     if (new_id) {
         job->id = (*job_next_id)++;
 
@@ -502,6 +509,59 @@ bool DFHack::Job::removePostings(df::job *job, bool remove_all)
     return removed;
 }
 
+/*
+ * Index of world->jobs.list for tools that would otherwise walk the list to
+ * count jobs. DF does not announce new or finished jobs, so the index is tied
+ * to a generation that Core bumps every tick and on state changes, and that
+ * linkIntoWorld and removeJob bump for jobs added or removed by DFHack.
+ */
+namespace {
+    struct JobRegistry {
+        uint32_t generation = 0;
+        std::vector<df::job*> jobs;
+        // indexed by job_type - ENUM_FIRST_ITEM(job_type)
+        std::vector<int> counts;
+    } job_registry;
+
+    JobRegistry &get_job_registry()
+    {
+        using df::global::world;
+
+        JobRegistry &reg = job_registry;
+        if (reg.generation == job_registry_generation)
+            return reg;
+        reg.generation = job_registry_generation;
+
+        reg.jobs.clear();
+        reg.counts.assign(size_t(ENUM_LAST_ITEM(job_type) - ENUM_FIRST_ITEM(job_type)) + 1, 0);
+        if (!world)
+            return reg;
+
+        for (auto link = world->jobs.list.next; link; link = link->next)
+        {
+            df::job *job = link->item;
+            if (!job)
+                continue;
+            reg.jobs.push_back(job);
+            if (is_valid_enum_item(job->job_type))
+                reg.counts[job->job_type - ENUM_FIRST_ITEM(job_type)]++;
+        }
+        return reg;
+    }
+}
+
+const std::vector<df::job*> &DFHack::Job::getJobs()
+{
+    return get_job_registry().jobs;
+}
+
+int DFHack::Job::countJobs(df::job_type type)
+{
+    if (!is_valid_enum_item(type))
+        return 0;
+    return get_job_registry().counts[type - ENUM_FIRST_ITEM(job_type)];
+}
+
 bool DFHack::Job::listNewlyCreated(std::vector<df::job*> *pvec, int *id_var)
 {
     using df::global::world;
@@ -29,6 +29,7 @@ distribution.
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 using namespace std;
@@ -45,6 +46,7 @@ using namespace std;
 #include "modules/Buildings.h"
 #include "modules/MapCache.h"
 #include "modules/Maps.h"
+#include "modules/Units.h"
 
 #include "df/biome_type.h"
 #include "df/block_burrow.h"
@@ -635,6 +637,87 @@ bool Maps::canWalkBetween(df::coord pos1, df::coord pos2)
     return tile1 && tile1 == tile2;
 }
 
+Maps::WalkableGroupSet::WalkableGroupSet()
+    : bits(65536 / 64), count(0)
+{
+}
+
+void Maps::WalkableGroupSet::clear()
+{
+    std::fill(bits.begin(), bits.end(), 0);
+    count = 0;
+}
+
+void Maps::WalkableGroupSet::add(df::coord pos)
+{
+    uint16_t group = getWalkableGroup(pos);
+    if (!group || contains(group))
+        return;
+
+    bits[group >> 6] |= uint64_t(1) << (group & 63);
+    count++;
+}
+
+void Maps::WalkableGroupSet::addUnits(const std::vector<df::unit *> &units)
+{
+    for (auto unit : units)
+        add(Units::getPosition(unit));
+}
+
+bool Maps::WalkableGroupSet::isReachableFromAny(df::coord pos) const
+{
+    return count && contains(getWalkableGroup(pos));
+}
+
+bool Maps::WalkableGroupSet::isAdjacentReachable(df::coord pos) const
+{
+    if (!count)
+        return false;
+
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            if ((dx || dy) && contains(getWalkableGroup(df::coord(pos.x + dx, pos.y + dy, pos.z))))
+                return true;
+        }
+    }
+    return false;
+}
+
+// bumped by Core::onUpdate and on state changes. Units and walkability groups
+// change while the game runs, but also when DFHack tools dig, build or edit
+// the map while the game is paused, which does not advance frame_counter.
+uint32_t walkable_groups_generation = 1;
+
+const Maps::WalkableGroupSet &Maps::getCitizenWalkableGroups()
+{
+    static WalkableGroupSet groups;
+    static uint32_t cached_generation = 0;
+    static void *cached_map = NULL;
+
+    if (!IsValid())
+    {
+        groups.clear();
+        cached_map = NULL;
+        return groups;
+    }
+
+    // one computation per update is enough
+    if (cached_generation == walkable_groups_generation && cached_map == world->map.block_index)
+        return groups;
+
+    cached_generation = walkable_groups_generation;
+    cached_map = world->map.block_index;
+
+    std::vector<df::unit *> citizens;
+    Units::getCitizens(citizens);
+    groups.clear();
+    groups.addUnits(citizens);
+
+    return groups;
+}
+
 bool Maps::canStepBetween(df::coord pos1, df::coord pos2)
 {
     color_ostream& out = Core::getInstance().getConsole();
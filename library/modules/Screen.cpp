@@ -116,36 +116,53 @@ bool Screen::inGraphicsMode()
     return init && init->display.flag.is_set(init_display_flags::USE_GRAPHICS);
 }
 
-static bool doSetTile_map(const Pen &pen, int x, int y) {
-    auto &vp = gps->main_viewport;
+/*
+ * Resolves the target screen buffers once, so that painting many tiles in a
+ * row only costs the index math and the writes for each tile.
+ */
+namespace {
+    struct TileWriter {
+        bool use_graphics;
+        bool map;
+        int dimx, dimy;
+
+        explicit TileWriter(bool map)
+            : use_graphics(Screen::inGraphicsMode()), map(map && use_graphics)
+        {
+            if (this->map) {
+                dimx = gps->main_viewport->dim_x;
+                dimy = gps->main_viewport->dim_y;
+            } else {
+                dimx = gps->dimx;
+                dimy = gps->dimy;
+            }
+        }
 
-    if (x < 0 || x >= vp->dim_x || y < 0 || y >= vp->dim_y)
-        return false;
+        bool inBounds(int x, int y) const {
+            return x >= 0 && x < dimx && y >= 0 && y < dimy;
+        }
 
-    size_t max_index = vp->dim_x * vp->dim_y - 1;
-    size_t index = (x * vp->dim_y) + y;
+        bool write(const Pen &pen, int x, int y) const {
+            if (!inBounds(x, y))
+                return false;
+            size_t index = (x * dimy) + y;
+            return map ? writeMap(pen, index) : writeScreen(pen, index);
+        }
 
-    if (index > max_index)
-        return false;
+        bool writeMap(const Pen &pen, size_t index) const {
+            long texpos = pen.tile;
+            if (!texpos && pen.ch)
+                texpos = init->font.large_font_texpos[(uint8_t)pen.ch];
+            gps->main_viewport->screentexpos_interface[index] = texpos;
+            return true;
+        }
 
-    long texpos = pen.tile;
-    if (!texpos && pen.ch)
-        texpos = init->font.large_font_texpos[(uint8_t)pen.ch];
-    vp->screentexpos_interface[index] = texpos;
-    return true;
+        bool writeScreen(const Pen &pen, size_t index) const;
+    };
 }
 
-static bool doSetTile_default(const Pen &pen, int x, int y, bool map)
+bool TileWriter::writeScreen(const Pen &pen, size_t index) const
 {
-    bool use_graphics = Screen::inGraphicsMode();
-
-    if (map && use_graphics)
-        return doSetTile_map(pen, x, y);
-
-    if (x < 0 || x >= gps->dimx || y < 0 || y >= gps->dimy)
-        return false;
-
-    size_t index = (x * gps->dimy) + y;
     uint8_t *screen = &gps->screen[index * 8];
 
     if (screen > gps->screen_limit)
@@ -225,12 +242,23 @@ static bool doSetTile_default(const Pen &pen, int x, int y, bool map)
     return true;
 }
 
+static bool doSetTile_default(const Pen &pen, int x, int y, bool map)
+{
+    return TileWriter(map).write(pen, x, y);
+}
+
 GUI_HOOK_DEFINE(Screen::Hooks::set_tile, doSetTile_default);
 static bool doSetTile(const Pen &pen, int x, int y, bool map)
 {
     return GUI_HOOK_TOP(Screen::Hooks::set_tile)(pen, x, y, map);
 }
 
+// Bulk painting can only bypass the per-tile hook if nobody has installed one
+static bool isSetTileHooked()
+{
+    return GUI_HOOK_TOP(Screen::Hooks::set_tile) != doSetTile_default;
+}
+
 bool Screen::paintTile(const Pen &pen, int x, int y, bool map)
 {
     if (!gps || !pen.valid()) return false;
@@ -239,6 +267,56 @@ bool Screen::paintTile(const Pen &pen, int x, int y, bool map)
     return true;
 }
 
+bool Screen::paintSpan(const Pen *pens, size_t count, int x, int y, bool map)
+{
+    return paintRect(pens, count, x, y, count, 1, map);
+}
+
+bool Screen::paintRect(const Pen *pens, size_t pitch, int x, int y, int width, int height, bool map)
+{
+    if (!gps || !pens || width <= 0 || height <= 0) return false;
+
+    bool ok = false;
+
+    if (isSetTileHooked())
+    {
+        for (int dy = 0; dy < height; dy++)
+        {
+            for (int dx = 0; dx < width; dx++)
+            {
+                const Pen &pen = pens[dy * pitch + dx];
+                if (pen.valid())
+                    ok = doSetTile(pen, x + dx, y + dy, map) || ok;
+            }
+        }
+        return ok;
+    }
+
+    TileWriter writer(map);
+
+    // clip to the target buffer
+    int dx1 = std::max(0, -x), dy1 = std::max(0, -y);
+    int dx2 = std::min(width, writer.dimx - x), dy2 = std::min(height, writer.dimy - y);
+
+    // the screen buffers are stored column by column
+    for (int dx = dx1; dx < dx2; dx++)
+    {
+        size_t index = size_t(x + dx) * writer.dimy + (y + dy1);
+        const Pen *pen = &pens[dy1 * pitch + dx];
+        for (int dy = dy1; dy < dy2; dy++, index++, pen += pitch)
+        {
+            if (!pen->valid())
+                continue;
+            if (writer.map)
+                ok = writer.writeMap(*pen, index) || ok;
+            else
+                ok = writer.writeScreen(*pen, index) || ok;
+        }
+    }
+
+    return ok;
+}
+
 static Pen doGetTile_map(int x, int y) {
     auto &vp = gps->main_viewport;
 
@@ -361,21 +439,21 @@ bool Screen::paintString(const Pen &pen, int x, int y, const std::string &text,
     auto dim = getWindowSize();
     if (!gps || y < 0 || y >= dim.y) return false;
 
-    Pen tmp(pen);
-    bool ok = false;
+    size_t start = -std::min(0,x);
+    if (start >= text.size() || x + start >= size_t(dim.x))
+        return false;
+    size_t count = std::min(text.size(), size_t(dim.x - x)) - start;
 
-    for (size_t i = -std::min(0,x); i < text.size(); i++)
+    std::vector<Pen> pens(count, pen);
+    for (size_t i = 0; i < count; i++)
     {
-        if (x + i >= size_t(dim.x))
-            break;
-
-        tmp.ch = text[i];
-        tmp.tile = (pen.tile ? pen.tile + uint8_t(text[i]) : 0);
-        paintTile(tmp, x+i, y, map);
-        ok = true;
+        uint8_t ch = text[start + i];
+        pens[i].ch = ch;
+        pens[i].tile = (pen.tile ? pen.tile + ch : 0);
     }
 
-    return ok;
+    paintSpan(pens.data(), count, x + start, y, map);
+    return true;
 }
 
 bool Screen::fillRect(const Pen &pen, int x1, int y1, int x2, int y2, bool map)
@@ -389,10 +467,21 @@ bool Screen::fillRect(const Pen &pen, int x1, int y1, int x2, int y2, bool map)
     if (y2 >= dim.y) y2 = dim.y-1;
     if (x1 > x2 || y1 > y2) return false;
 
+    if (isSetTileHooked())
+    {
+        for (int x = x1; x <= x2; x++)
+        {
+            for (int y = y1; y <= y2; y++)
+                doSetTile(pen, x, y, map);
+        }
+        return true;
+    }
+
+    TileWriter writer(map);
     for (int x = x1; x <= x2; x++)
     {
         for (int y = y1; y <= y2; y++)
-            doSetTile(pen, x, y, map);
+            writer.write(pen, x, y);
     }
 
     return true;
@@ -700,22 +789,13 @@ void PenArray::set_tile(unsigned int x, unsigned int y, Screen::Pen pen)
 }
 
 void PenArray::draw(unsigned int x, unsigned int y, unsigned int width, unsigned int height,
-                    unsigned int bufx, unsigned int bufy)
+                    unsigned int bufx, unsigned int bufy, bool map)
 {
-    if (!gps)
+    if (!gps || bufx >= dimx || bufy >= dimy)
         return;
-    for (unsigned int gridx = x; gridx < x + width; gridx++)
-    {
-        for (unsigned int gridy = y; gridy < y + height; gridy++)
-        {
-            if (gridx >= unsigned(gps->dimx) ||
-                gridy >= unsigned(gps->dimy) ||
-                gridx - x + bufx >= dimx ||
-                gridy - y + bufy >= dimy)
-                continue;
-            Screen::paintTile(buffer[((gridy - y + bufy) * dimx) + (gridx - x + bufx)], gridx, gridy);
-        }
-    }
+    width = std::min(width, dimx - bufx);
+    height = std::min(height, dimy - bufy);
+    Screen::paintRect(&buffer[(bufy * dimx) + bufx], dimx, x, y, width, height, map);
 }
 
 /*
@@ -2,6 +2,8 @@
 #include <iomanip>
 #include <map>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <math.h>
 
@@ -87,12 +89,31 @@ struct NoiseFunction
      * the threshold causing placement of a vein tile.
      */
     virtual float eval(float x, float y, float z) = 0;
+    // out[i] = eval(x, ys[i], z) for i < count
+    virtual void eval_y(float x, const float *ys, float z, float *out, unsigned count) {
+        for (unsigned i = 0; i < count; i++)
+            out[i] = eval(x, ys[i], z);
+    }
     virtual t_range range() = 0;
     virtual void displace(float &x, float &y, float &z) = 0;
 };
 
 inline float apow(float a, float b) { return powf(fabsf(a), b); }
 
+// Longest row passed to eval_y: one block column
+const unsigned MAX_ROW = 16;
+
+// Evaluates noise(x*scale, ys[i]*scale, z*zscale) for a row of tiles
+template<class N>
+static void noise_row(N &noise, float x, const float *ys, float z, float *out,
+                      unsigned count, float div, float zdiv)
+{
+    float tmp[MAX_ROW];
+    for (unsigned i = 0; i < count; i++)
+        tmp[i] = ys[i]/div;
+    noise.eval_y(x/div, tmp, z/zdiv, out, count);
+}
+
 struct Distribution : NoiseFunction
 {
     float bx, by, bz;
@@ -128,6 +149,16 @@ struct DistributionVein : Distribution
                     +0.6f*strand1b(x/16,y/16,z/8), 0.6f);
     }
 
+    void eval_y(float x, const float *ys, float z, float *out, unsigned count) {
+        float d1[MAX_ROW], d2[MAX_ROW], s1a[MAX_ROW], s1b[MAX_ROW];
+        noise_row(density1, x, ys, z, d1, count, 96, 48);
+        noise_row(density2, x, ys, z, d2, count, 48, 24);
+        noise_row(strand1a, x, ys, z, s1a, count, 24, 12);
+        noise_row(strand1b, x, ys, z, s1b, count, 16, 8);
+        for (unsigned i = 0; i < count; i++)
+            out[i] = 0.1f * d1[i] + 0.2f * d2[i] - apow(s1a[i] + 0.6f*s1b[i], 0.6f);
+    }
+
     t_range range() { return t_range(-0.3f-1.33f,0.3f); }
 };
 
@@ -147,6 +178,15 @@ struct DistributionCluster : Distribution
              + shape(x/24, y/24, z/8);
     }
 
+    void eval_y(float x, const float *ys, float z, float *out, unsigned count) {
+        float d1[MAX_ROW], d2[MAX_ROW], sh[MAX_ROW];
+        noise_row(density1, x, ys, z, d1, count, 96, 32);
+        noise_row(density2, x, ys, z, d2, count, 48, 16);
+        noise_row(shape, x, ys, z, sh, count, 24, 8);
+        for (unsigned i = 0; i < count; i++)
+            out[i] = 0.2f * d1[i] + 0.6f * d2[i] + sh[i];
+    }
+
     t_range range() { return t_range(-1.8f,1.8f); }
 };
 
@@ -167,6 +207,18 @@ struct DistributionClusterSmall : Distribution
              + apow(shape(x*scale, y*scale, z*scale), 0.1f);
     }
 
+    void eval_y(float x, const float *ys, float z, float *out, unsigned count) {
+        const float scale = 1.0f/4.3f;
+        float d1[MAX_ROW], d2[MAX_ROW], sh[MAX_ROW], tmp[MAX_ROW];
+        noise_row(density1, x, ys, z, d1, count, 96, 48);
+        noise_row(density2, x, ys, z, d2, count, 24, 12);
+        for (unsigned i = 0; i < count; i++)
+            tmp[i] = ys[i]*scale;
+        shape.eval_y(x*scale, tmp, z*scale, sh, count);
+        for (unsigned i = 0; i < count; i++)
+            out[i] = 0.06f * d1[i] + 0.12f * d2[i] + apow(sh[i], 0.1f);
+    }
+
     t_range range() { return t_range(-0.18f,1.18f); }
 };
 
@@ -186,6 +238,17 @@ struct DistributionClusterOne : Distribution
              + shape(x-bx, y-by, z-bz);
     }
 
+    void eval_y(float x, const float *ys, float z, float *out, unsigned count) {
+        float d1[MAX_ROW], d2[MAX_ROW], sh[MAX_ROW], tmp[MAX_ROW];
+        noise_row(density1, x, ys, z, d1, count, 96, 48);
+        noise_row(density2, x, ys, z, d2, count, 48, 24);
+        for (unsigned i = 0; i < count; i++)
+            tmp[i] = ys[i]-by;
+        shape.eval_y(x-bx, tmp, z-bz, sh, count);
+        for (unsigned i = 0; i < count; i++)
+            out[i] = 0.05f * d1[i] + 0.1f * d2[i] + sh[i];
+    }
+
     t_range range() { return t_range(-1.15f,1.15f); }
 };
 
@@ -283,7 +346,7 @@ struct GeoBlock
         memset(material, -1, sizeof(material));
     }
 
-    bool prepare_arena(int16_t env_material, NoiseFunction::Ptr fn);
+    bool prepare_arena(int16_t env_material, NoiseFunction *fn);
     int measure_placement(float threshold);
     void place_tiles(float threshold, int16_t new_material, df::inclusion_type itype);
 };
@@ -1117,7 +1180,7 @@ void VeinGenerator::write_block_tiles(Block *b, df::coord2d column, int z)
  * Vein placement code
  */
 
-bool GeoBlock::prepare_arena(int16_t basemat, NoiseFunction::Ptr fn)
+bool GeoBlock::prepare_arena(int16_t basemat, NoiseFunction *fn)
 {
     arena_mask = arena_unmined = 0;
     arena_material = basemat;
@@ -1130,17 +1193,31 @@ bool GeoBlock::prepare_arena(int16_t basemat, NoiseFunction::Ptr fn)
 
     for (int x = 0; x < 16; x++)
     {
+        // Evaluate all matching tiles of the column in one call
+        float ys[16], values[16];
+        uint8_t idx[16];
+        unsigned count = 0;
+
         for (int y = 0; y < 16; y++)
         {
             if (material[x][y] != arena_material)
                 continue;
 
-            weight[x][y] = fn->eval(x0+x, y0+y, z);
+            idx[count] = y;
+            ys[count++] = y0+y;
 
-            arena_mask |= (1<<x);
             if (unmined.getassignment(x,y))
                 arena_unmined |= (1<<x);
         }
+
+        if (!count)
+            continue;
+
+        arena_mask |= (1<<x);
+        fn->eval_y(x0+x, ys, z, values, count);
+
+        for (unsigned i = 0; i < count; i++)
+            weight[x][idx[i]] = values[i];
     }
 
     return arena_mask != 0;
@@ -1189,11 +1266,49 @@ void GeoBlock::place_tiles(float threshold, int16_t new_material, df::inclusion_
     }
 }
 
+/*
+ * Blocks are processed independently once the distribution is
+ * known, so large arenas are split between worker threads.
+ * Each block is only touched by one thread, and the results
+ * do not depend on the number of threads.
+ */
+const size_t MIN_PARALLEL_BLOCKS = 64;
+
+template<class F>
+static void parallel_for(size_t count, F fn)
+{
+    size_t workers = std::min<size_t>(std::thread::hardware_concurrency(),
+                                      count / MIN_PARALLEL_BLOCKS);
+    if (workers <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        const size_t chunk = 16;
+        for (size_t start; (start = next.fetch_add(chunk)) < count; )
+            for (size_t i = start; i < std::min(count, start + chunk); i++)
+                fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool)
+        th.join();
+}
+
 static int measure(const std::vector<GeoBlock*> &arena, float threshold)
 {
-    int count = 0;
-    for (size_t i = 0; i < arena.size(); i++)
-        count += arena[i]->measure_placement(threshold);
+    std::atomic<int> count(0);
+    parallel_for(arena.size(), [&](size_t i) {
+        if (int c = arena[i]->measure_placement(threshold))
+            count += c;
+    });
     return count;
 }
 
@@ -1235,19 +1350,27 @@ void VeinExtent::merge_into(Ptr target)
 
 void VeinExtent::place_tiles()
 {
-    std::vector<GeoBlock*> arena;
+    std::vector<GeoBlock*> blocks, arena;
 
     int env_material = parent_mat();
 
     for (size_t i = 0; i < layers.size(); i++)
     {
         auto layer = layers[i];
+        blocks.insert(blocks.end(), layer->block_list.begin(), layer->block_list.end());
+    }
 
-        for (auto bit = layer->block_list.begin(); bit != layer->block_list.end(); ++bit)
-        {
-            if ((*bit)->prepare_arena(env_material, distribution))
-                arena.push_back(*bit);
-        }
+    std::vector<uint8_t> in_arena(blocks.size());
+    NoiseFunction *fn = distribution.get();
+
+    parallel_for(blocks.size(), [&](size_t i) {
+        in_arena[i] = blocks[i]->prepare_arena(env_material, fn);
+    });
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (in_arena[i])
+            arena.push_back(blocks[i]);
     }
 
     // Binary search to meet the required number
@@ -1268,8 +1391,9 @@ void VeinExtent::place_tiles()
     }
 
     // Write the tiles out
-    for (size_t i = 0; i < arena.size(); i++)
+    parallel_for(arena.size(), [&](size_t i) {
         arena[i]->place_tiles(mid, vein.first, vein.second);
+    });
 
     placed = true;
 }
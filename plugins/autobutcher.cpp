@@ -79,7 +79,8 @@ struct WatchedRace;
 // to ignore them for a while but still keep the target count settings
 static unordered_map<int, WatchedRace*> watched_races;
 static unordered_map<string, int> race_to_id;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+// period is updated from CONFIG_CYCLE_TICKS
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 6000, 500);
 
 static void init_autobutcher(color_ostream &out);
 static void cleanup_autobutcher(color_ostream &out);
@@ -122,7 +123,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -143,6 +143,7 @@ DFhackCExport command_result plugin_load_data (color_ostream &out) {
     is_enabled = get_config_bool(CONFIG_IS_ENABLED);
     DEBUG(status,out).print("loading persisted enabled state: %s\n",
                             is_enabled ? "true" : "false");
+    cycle_schedule.period = get_config_val(CONFIG_CYCLE_TICKS);
 
     // load the persisted watchlist
     init_autobutcher(out);
@@ -162,9 +163,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= get_config_val(CONFIG_CYCLE_TICKS))
-        autobutcher_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    autobutcher_cycle(out);
     return CR_OK;
 }
 
@@ -503,6 +503,7 @@ static command_result df_autobutcher(color_ostream &out, vector<string> &paramet
     }
     else if (opts.command == "ticks") {
         set_config_val(CONFIG_CYCLE_TICKS, opts.ticks);
+        cycle_schedule.period = opts.ticks;
         INFO(status,out).print("New cycle timer: %d ticks.\n", opts.ticks);
     }
     else {
@@ -757,9 +758,6 @@ static bool isProtectedUnit(df::unit *unit) {
 }
 
 static void autobutcher_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
     // check if there is anything to watch before walking through units vector
@@ -926,6 +924,7 @@ static unsigned autobutcher_getSleep(color_ostream &out) {
 static void autobutcher_setSleep(color_ostream &out, unsigned ticks) {
 
     set_config_val(CONFIG_CYCLE_TICKS, ticks);
+    cycle_schedule.period = ticks;
 }
 
 static void autowatch_setEnabled(color_ostream &out, bool enable) {
@@ -7,10 +7,10 @@
 
 #include "modules/Burrows.h"
 #include "modules/Designations.h"
+#include "modules/ItemSweep.h"
 #include "modules/Items.h"
 #include "modules/Maps.h"
 #include "modules/Persistence.h"
-#include "modules/Units.h"
 #include "modules/World.h"
 
 #include "df/burrow.h"
@@ -114,11 +114,11 @@ static void validate_burrow_configs(color_ostream &out) {
     }
 }
 
-static const int32_t CYCLE_TICKS = 1200;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 2000);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static int32_t do_cycle(color_ostream &out, bool force_designate = false);
+static void subscribe_logs();
 
 DFhackCExport command_result plugin_init(color_ostream &out, std::vector <PluginCommand> &commands) {
     DEBUG(status,out).print("initializing %s\n", plugin_name);
@@ -129,6 +129,8 @@ DFhackCExport command_result plugin_init(color_ostream &out, std::vector <Plugin
         "Auto-harvest trees when low on stockpiled logs.",
         do_command));
 
+    subscribe_logs();
+
     return CR_OK;
 }
 
@@ -160,7 +162,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -201,12 +202,10 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int32_t designated = do_cycle(out);
-        if (0 < designated)
-            out.print("autochop: designated %d tree(s) for chopping\n", designated);
-    }
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    int32_t designated = do_cycle(out);
+    if (0 < designated)
+        out.print("autochop: designated %d tree(s) for chopping\n", designated);
     return CR_OK;
 }
 
@@ -257,29 +256,13 @@ static command_result do_command(color_ostream &out, vector<string> &parameters)
 // cycle logic
 //
 
-static bool is_accessible_item(df::item *item, const vector<df::unit *> &citizens) {
-    const df::coord pos = Items::getPosition(item);
-    for (auto &unit : citizens) {
-        if (Maps::canWalkBetween(Units::getPosition(unit), pos))
-            return true;
-    }
-    return false;
+static bool is_accessible_item(df::item *item, const Maps::WalkableGroupSet &citizen_groups) {
+    return citizen_groups.isReachableFromAny(Items::getPosition(item));
 }
 
 // at least one member of the fort can reach a position adjacent to the given pos
-static bool is_accessible_tree(const df::coord &pos, const vector<df::unit *> &citizens) {
-    for (auto &unit : citizens) {
-        if (Maps::canWalkBetween(unit->pos, df::coord(pos.x-1, pos.y-1, pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x,   pos.y-1, pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x+1, pos.y-1, pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x-1, pos.y,   pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x+1, pos.y,   pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x-1, pos.y+1, pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x,   pos.y+1, pos.z))
-                || Maps::canWalkBetween(unit->pos, df::coord(pos.x+1, pos.y+1, pos.z)))
-            return true;
-    }
-    return false;
+static bool is_accessible_tree(const df::coord &pos, const Maps::WalkableGroupSet &citizen_groups) {
+    return citizen_groups.isAdjacentReachable(pos);
 }
 
 static bool is_valid_tree(const df::plant *plant) {
@@ -397,7 +380,7 @@ typedef multimap<int, df::plant *, std::greater<int>> TreesBySize;
 
 static int32_t scan_tree(color_ostream & out, df::plant *plant, int32_t *expected_yield,
         TreesBySize *designatable_trees_by_size, bool designate_clearcut,
-        const vector<df::unit *> &citizens, int32_t *accessible_trees,
+        const Maps::WalkableGroupSet &citizen_groups, int32_t *accessible_trees,
         int32_t *inaccessible_trees, int32_t *designated_trees, int32_t *accessible_yield,
         map<int32_t, int32_t> *tree_counts,
         map<int32_t, int32_t> *designated_tree_counts,
@@ -409,7 +392,7 @@ static int32_t scan_tree(color_ostream & out, df::plant *plant, int32_t *expecte
     if (!is_valid_tree(plant))
         return 0;
 
-    bool accessible = is_accessible_tree(plant->pos, citizens);
+    bool accessible = is_accessible_tree(plant->pos, citizen_groups);
     int32_t yield = estimate_logs(plant);
 
     if (accessible) {
@@ -447,7 +430,7 @@ static int32_t scan_tree(color_ostream & out, df::plant *plant, int32_t *expecte
 // returns the number of trees that were newly marked
 static int32_t scan_trees(color_ostream & out, int32_t *expected_yield,
         TreesBySize *designatable_trees_by_size, bool designate_clearcut,
-        const vector<df::unit *> &citizens, int32_t *accessible_trees = NULL,
+        const Maps::WalkableGroupSet &citizen_groups, int32_t *accessible_trees = NULL,
         int32_t *inaccessible_trees = NULL, int32_t *designated_trees = NULL,
         int32_t *accessible_yield = NULL,
         map<int32_t, int32_t> *tree_counts = NULL,
@@ -475,13 +458,13 @@ static int32_t scan_trees(color_ostream & out, int32_t *expected_yield,
 
     for (auto plant : world->plants.tree_dry)
         newly_marked += scan_tree(out, plant, expected_yield, designatable_trees_by_size,
-                                  designate_clearcut, citizens, accessible_trees,
+                                  designate_clearcut, citizen_groups, accessible_trees,
                                   inaccessible_trees, designated_trees, accessible_yield,
                                   tree_counts, designated_tree_counts,
                                   clearcut_burrows, chop_burrows);
     for (auto plant : world->plants.tree_wet)
         newly_marked += scan_tree(out, plant, expected_yield, designatable_trees_by_size,
-                                  designate_clearcut, citizens, accessible_trees,
+                                  designate_clearcut, citizen_groups, accessible_trees,
                                   inaccessible_trees, designated_trees, accessible_yield,
                                   tree_counts, designated_tree_counts,
                                   clearcut_burrows, chop_burrows);
@@ -539,55 +522,70 @@ struct BadFlags
     }
 };
 
-static void scan_logs(color_ostream &out, int32_t *usable_logs,
-                      const vector<df::unit *> &citizens, int32_t *inaccessible_logs = NULL) {
-    static const BadFlags bad_flags;
+// log counts from the last shared item sweep
+struct LogCounter : ItemSweep::Subscriber {
+    const Maps::WalkableGroupSet *citizen_groups = NULL;
+    int32_t usable = 0;
+    int32_t inaccessible = 0;
 
-    TRACE(cycle,out).print("scanning logs\n");
-    if (usable_logs)
-        *usable_logs = 0;
-    if (inaccessible_logs)
-        *inaccessible_logs = 0;
-
-    for (auto &item : world->items.other[items_other_id::IN_PLAY]) {
-        TRACE(cycle,out).print("  scanning log %d\n", item->id);
-        if (item->flags.whole & bad_flags.whole)
-            continue;
-
-        if (item->getType() != item_type::WOOD)
-            continue;
+    void begin() {
+        usable = inaccessible = 0;
+        citizen_groups = &Maps::getCitizenWalkableGroups();
+    }
 
+    void visit(df::item *item) {
         if (!is_valid_item(item))
-            continue;
+            return;
 
-        if (!is_accessible_item(item, citizens)) {
-            if (inaccessible_logs)
-                ++*inaccessible_logs;
-        } else if (usable_logs) {
-            ++*usable_logs;
-        }
+        if (!is_accessible_item(item, *citizen_groups))
+            ++inaccessible;
+        else
+            ++usable;
     }
+};
+
+static LogCounter log_counter;
+static int log_sweep_id = -1;
+
+// the cycle accepts log counts this many ticks old, so it can share the
+// item sweep of other plugins
+static const int32_t CYCLE_LOGS_MAX_AGE = 300;
+
+static void subscribe_logs() {
+    static const BadFlags bad_flags;
+
+    ItemSweep::Filter filter;
+    filter.types.push_back(item_type::WOOD);
+    filter.bad_flags = bad_flags.whole;
+    log_sweep_id = ItemSweep::subscribe(plugin_self, filter, &log_counter);
+}
+
+static void scan_logs(color_ostream &out, int32_t *usable_logs,
+                      int32_t *inaccessible_logs = NULL, int32_t max_age = 0) {
+    TRACE(cycle,out).print("scanning logs\n");
+
+    bool ok = ItemSweep::refresh(log_sweep_id, max_age);
+    if (usable_logs)
+        *usable_logs = ok ? log_counter.usable : 0;
+    if (inaccessible_logs)
+        *inaccessible_logs = ok ? log_counter.inaccessible : 0;
 }
 
 static int32_t do_cycle(color_ostream &out, bool force_designate) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     validate_burrow_configs(out);
 
     // scan trees and clearcut marked burrows
     int32_t expected_yield;
     TreesBySize designatable_trees_by_size;
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens);
+    const Maps::WalkableGroupSet &citizen_groups = Maps::getCitizenWalkableGroups();
     int32_t newly_marked = scan_trees(out, &expected_yield,
-            &designatable_trees_by_size, true, citizens);
+            &designatable_trees_by_size, true, citizen_groups);
 
     // check how many logs we have already
     int32_t usable_logs;
-    scan_logs(out, &usable_logs, citizens);
+    scan_logs(out, &usable_logs, NULL, force_designate ? 0 : CYCLE_LOGS_MAX_AGE);
 
     if (get_config_bool(config, CONFIG_WAITING_FOR_MIN)
             && usable_logs <= get_config_val(config, CONFIG_MIN_LOGS)) {
@@ -668,10 +666,9 @@ static void autochop_printStatus(color_ostream &out) {
     int32_t accessible_trees, inaccessible_trees;
     int32_t designated_trees, expected_yield, accessible_yield;
     map<int32_t, int32_t> tree_counts, designated_tree_counts;
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens);
-    scan_logs(out, &usable_logs, citizens, &inaccessible_logs);
-    scan_trees(out, &expected_yield, NULL, false, citizens, &accessible_trees, &inaccessible_trees,
+    const Maps::WalkableGroupSet &citizen_groups = Maps::getCitizenWalkableGroups();
+    scan_logs(out, &usable_logs, &inaccessible_logs);
+    scan_trees(out, &expected_yield, NULL, false, citizen_groups, &accessible_trees, &inaccessible_trees,
             &designated_trees, &accessible_yield, &tree_counts, &designated_tree_counts);
 
     out.print("summary:\n");
@@ -773,9 +770,7 @@ static int autochop_getLogCounts(lua_State *L) {
         out = &Core::getInstance().getConsole();
     DEBUG(status,*out).print("entering autochop_getNumLogs\n");
     int32_t usable_logs, inaccessible_logs;
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens);
-    scan_logs(*out, &usable_logs, citizens, &inaccessible_logs);
+    scan_logs(*out, &usable_logs, &inaccessible_logs);
     Lua::Push(L, usable_logs);
     Lua::Push(L, inaccessible_logs);
     return 2;
@@ -836,9 +831,8 @@ static int autochop_getTreeCountsAndBurrowConfigs(lua_State *L) {
     int32_t accessible_trees, inaccessible_trees;
     int32_t designated_trees, expected_yield, accessible_yield;
     map<int32_t, int32_t> tree_counts, designated_tree_counts;
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens);
-    scan_trees(*out, &expected_yield, NULL, false, citizens, &accessible_trees, &inaccessible_trees,
+    const Maps::WalkableGroupSet &citizen_groups = Maps::getCitizenWalkableGroups();
+    scan_trees(*out, &expected_yield, NULL, false, citizen_groups, &accessible_trees, &inaccessible_trees,
             &designated_trees, &accessible_yield, &tree_counts, &designated_tree_counts);
 
     map<string, int32_t> summary;
@@ -5,10 +5,12 @@
 #include "PluginManager.h"
 
 #include <map>
+#include <tuple>
 
 // DF data structure definition headers
 #include "DataDefs.h"
 
+#include "modules/ItemSweep.h"
 #include "modules/Items.h"
 #include "modules/Maps.h"
 #include "modules/Materials.h"
@@ -88,7 +90,8 @@ command_result autoclothing(color_ostream &out, vector <string> & parameters);
 static void init_state(color_ostream &out);
 static void save_state(color_ostream &out);
 static void cleanup_state(color_ostream &out);
-static void do_autoclothing();
+static void do_autoclothing(int32_t max_age = 0);
+static void subscribe_clothing();
 static bool validateMaterialCategory(ClothingRequirement * requirement);
 static bool setItem(string name, ClothingRequirement* requirement);
 static void generate_report(color_ostream& out);
@@ -234,6 +237,7 @@ DFhackCExport command_result plugin_init(color_ostream &out, vector <PluginComma
         "autoclothing",
         "Automatically manage clothing work orders",
         autoclothing));
+    subscribe_clothing();
     return CR_OK;
 }
 
@@ -291,24 +295,18 @@ DFhackCExport command_result plugin_enable(color_ostream& out, bool enable) {
     return CR_OK;
 }
 
-// Whatever you put here will be done in each game step. Don't abuse it.
-// It's optional, so you can just comment it out like this if you don't need it.
+// Check every day; the core spreads the cycles of the plugins over the day.
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 500);
+// the daily check accepts item counts this many ticks old, so it can share
+// the item sweep of other plugins
+static const int32_t CYCLE_ITEMS_MAX_AGE = 600;
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out)
+DFhackCExport command_result plugin_oncycle(color_ostream &out)
 {
-    if (!autoclothing_enabled)
-        return CR_OK;
-
     if (!Maps::IsValid())
         return CR_OK;
 
-    if (DFHack::World::ReadPauseState())
-        return CR_OK;
-
-    if ((world->frame_counter + 500) % 1200 != 0) // Check every day, but not the same day as other things
-        return CR_OK;
-
-    do_autoclothing();
+    do_autoclothing(CYCLE_ITEMS_MAX_AGE);
 
     return CR_OK;
 }
@@ -593,29 +591,76 @@ static void find_needed_clothing_items()
     }
 }
 
-static void remove_available_clothing()
+// unowned clothing in play, counted by the shared item sweep
+struct ClothingKey
 {
-    for (auto& item : world->items.all)
+    df::item_type type;
+    int16_t subtype;
+    int16_t mat_type;
+    int32_t mat_index;
+    int16_t maker_race;
+
+    bool operator<(const ClothingKey &b) const
+    {
+        return std::tie(type, subtype, mat_type, mat_index, maker_race) <
+            std::tie(b.type, b.subtype, b.mat_type, b.mat_index, b.maker_race);
+    }
+};
+
+struct ClothingCounter : ItemSweep::Subscriber
+{
+    map<ClothingKey, int32_t> counts;
+
+    void begin() { counts.clear(); }
+
+    void visit(df::item *item)
     {
         //skip any owned items.
         if (getOwner(item))
-            continue;
+            return;
+
+        // the same material MaterialInfo::decode(item) would report
+        ClothingKey key = { item->getType(), item->getSubtype(),
+            item->getActualMaterial(), item->getActualMaterialIndex(),
+            item->getMakerRace() };
+        ++counts[key];
+    }
+};
+
+static ClothingCounter clothing_counter;
+static int clothing_sweep_id = -1;
+
+static void subscribe_clothing()
+{
+    ItemSweep::Filter filter;
+    filter.types = { item_type::ARMOR, item_type::GLOVES, item_type::SHOES,
+                     item_type::HELM, item_type::PANTS };
+    clothing_sweep_id = ItemSweep::subscribe(plugin_self, filter, &clothing_counter);
+}
+
+static void remove_available_clothing(int32_t max_age)
+{
+    if (!ItemSweep::refresh(clothing_sweep_id, max_age))
+        return;
+
+    for (auto& entry : clothing_counter.counts)
+    {
+        auto &key = entry.first;
 
-        //again, for each item, find if any clothing order matches
+        //again, for each kind of item, find if any clothing order matches
         for (auto& clothingOrder : clothingOrders)
         {
-            if (item->getType() != clothingOrder.itemType)
+            if (key.type != clothingOrder.itemType)
                 continue;
-            if (item->getSubtype() != clothingOrder.item_subtype)
+            if (key.subtype != clothingOrder.item_subtype)
                 continue;
 
-            MaterialInfo matInfo;
-            matInfo.decode(item);
+            MaterialInfo matInfo(key.mat_type, key.mat_index);
 
             if (!matInfo.matches(clothingOrder.material_category))
                 continue;
 
-            clothingOrder.total_needed_per_race[item->getMakerRace()] --;
+            clothingOrder.total_needed_per_race[key.maker_race] -= entry.second;
         }
     }
 }
@@ -672,7 +717,7 @@ static void add_clothing_orders()
     }
 }
 
-static void do_autoclothing()
+static void do_autoclothing(int32_t max_age)
 {
     if (clothingOrders.size() == 0)
         return;
@@ -681,7 +726,7 @@ static void do_autoclothing()
     find_needed_clothing_items();
 
     //Now we go through all the items in the map to see how many clothing items we have but aren't owned yet.
-    remove_available_clothing();
+    remove_available_clothing(max_age);
 
     //Finally loop through the clothing orders to find ones that need more made.
     add_clothing_orders();
@@ -63,7 +63,8 @@ static void set_config_bool(int index, bool value) {
 }
 
 static bool did_complain = false; // avoids message spam
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+// period is updated from CONFIG_CYCLE_TICKS
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 6000, 300);
 
 static command_result df_autonestbox(color_ostream &out, vector<string> &parameters);
 static void autonestbox_cycle(color_ostream &out);
@@ -96,7 +97,6 @@ DFhackCExport command_result plugin_enable(color_ostream &out, bool enable) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -112,6 +112,7 @@ DFhackCExport command_result plugin_load_data (color_ostream &out) {
     is_enabled = get_config_bool(CONFIG_IS_ENABLED);
     DEBUG(status,out).print("loading persisted enabled state: %s\n",
                             is_enabled ? "true" : "false");
+    cycle_schedule.period = get_config_val(CONFIG_CYCLE_TICKS);
     did_complain = false;
     return CR_OK;
 }
@@ -127,9 +128,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= get_config_val(CONFIG_CYCLE_TICKS))
-        autonestbox_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    autonestbox_cycle(out);
     return CR_OK;
 }
 
@@ -195,6 +195,7 @@ static command_result df_autonestbox(color_ostream &out, vector<string> &paramet
 
     if (opts.ticks > -1) {
         set_config_val(CONFIG_CYCLE_TICKS, opts.ticks);
+        cycle_schedule.period = opts.ticks;
         INFO(status,out).print("New cycle timer: %d ticks.\n", opts.ticks);
     }
     else if (opts.now) {
@@ -390,9 +391,6 @@ static size_t assign_nestboxes(color_ostream &out) {
 }
 
 static void autonestbox_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running autonestbox cycle\n");
 
     size_t processed = assign_nestboxes(out);
@@ -67,7 +67,7 @@ static void set_config_bool(int index, bool value)
     set_config_val(index, value ? 1 : 0);
 }
 
-static int32_t cycle_timestamp = 0; // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 300);
 
 static void do_cycle(color_ostream &out);
 
@@ -110,7 +110,6 @@ DFhackCExport command_result plugin_shutdown(color_ostream &out)
 
 DFhackCExport command_result plugin_load_data(color_ostream &out)
 {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid())
@@ -141,13 +140,9 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-static const int32_t CYCLE_TICKS = 1200;
-
-DFhackCExport command_result plugin_onupdate(color_ostream &out)
+DFhackCExport command_result plugin_oncycle(color_ostream &out)
 {
-    CoreSuspender suspend;
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        do_cycle(out);
+    do_cycle(out);
     return CR_OK;
 }
 
@@ -202,8 +197,5 @@ static void checkslabs(color_ostream &out)
 
 static void do_cycle(color_ostream &out)
 {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     checkslabs(out);
 }
@@ -5,8 +5,18 @@
  * Written by cdombroski.
  */
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "Console.h"
 #include "DataDefs.h"
@@ -147,8 +157,13 @@ DFhackCExport command_result plugin_shutdown(color_ostream &) {
 }
 
 struct blueprint_processor;
+struct level_snapshot;
 struct tile_context {
     blueprint_processor *processor;
+    const level_snapshot *level = NULL;
+    // buildings and zones that have already been named in this phase. every
+    // building is on a single z-level, so this can be tracked per level.
+    std::set<df::building *> *seen = NULL;
     bool pretty = false;
     df::building* b = NULL;
 };
@@ -168,12 +183,13 @@ struct blueprint_processor {
     const bool force_create;
     get_tile_fn * const get_tile;
     init_ctx_fn * const init_ctx;
-    std::set<df::building *> seen;
+    // whether get_tile looks up the zones at the tile
+    const bool need_zones;
     blueprint_processor(const string &mode, const string &phase,
                         bool force_create, get_tile_fn *get_tile,
-                        init_ctx_fn *init_ctx)
+                        init_ctx_fn *init_ctx, bool need_zones)
         : mode(mode), phase(phase), force_create(force_create),
-          get_tile(get_tile), init_ctx(init_ctx) { }
+          get_tile(get_tile), init_ctx(init_ctx), need_zones(need_zones) { }
 };
 
 // global engravings cache, cleared when the string cache is cleared
@@ -187,22 +203,72 @@ static std::unordered_map<df::coord, df::engraving *, PosHash> engravings_cache;
 // We use const char * throughout this code instead of std::string to avoid
 // having to allocate memory for all the small string literals. This
 // significantly speeds up processing and allows us to handle very large maps
-// (e.g. 16x16 embarks) without running out of memory. This cache provides a
+// (e.g. 16x16 embarks) without running out of memory. This interner provides a
 // mechanism for storing dynamically created strings so their memory stays
-// allocated until we write out the blueprints at the end.
-// If NULL is passed as the str, the cache is cleared.
+// allocated until we write out the blueprints at the end. The strings are
+// packed into large chunks instead of being allocated one by one, and the
+// interner can be used by the worker threads that generate the phases.
+class string_interner {
+public:
+    const char * intern(std::string_view str) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = strings.find(str);
+        if (it != strings.end())
+            return it->data();
+
+        char *mem = allocate(str.size() + 1);
+        memcpy(mem, str.data(), str.size());
+        mem[str.size()] = '\0';
+        strings.emplace(mem, str.size());
+        return mem;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        strings.clear();
+        chunks.clear();
+        large.clear();
+        chunk_used = CHUNK_SIZE;
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    char * allocate(size_t size) {
+        if (size > CHUNK_SIZE / 4) {
+            large.emplace_back(new char[size]);
+            return large.back().get();
+        }
+        if (chunk_used + size > CHUNK_SIZE) {
+            chunks.emplace_back(new char[CHUNK_SIZE]);
+            chunk_used = 0;
+        }
+        char *mem = chunks.back().get() + chunk_used;
+        chunk_used += size;
+        return mem;
+    }
+
+    std::mutex mutex;
+    std::unordered_set<std::string_view> strings;
+    vector<std::unique_ptr<char[]>> chunks;
+    vector<std::unique_ptr<char[]>> large;
+    size_t chunk_used = CHUNK_SIZE;
+};
+
+static string_interner interned_strings;
+
+// Interns the given string. If NULL is passed as the str, all interned strings
+// are freed.
 static const char * cache(const char *str) {
-    // this local static assumes that no two blueprints are being generated at
-    // the same time, which is currently ensured by the higher-level DFHack
-    // command handling code. if this assumption ever becomes untrue, we'll
-    // need to protect the cache with thread synchronization primitives.
-    static std::set<string> _cache;
+    // this assumes that no two blueprints are being generated at the same
+    // time, which is currently ensured by the higher-level DFHack command
+    // handling code.
     if (!str) {
-        _cache.clear();
+        interned_strings.clear();
         engravings_cache.clear();
         return NULL;
     }
-    return _cache.emplace(str).first->c_str();
+    return interned_strings.intern(str);
 }
 
 // Convenience wrapper for std::string.
@@ -993,17 +1059,15 @@ static const char * get_zone_keys(const df::building_civzonest *zone) {
     return cache(keys_str);
 }
 
+static df::building_civzonest * get_civzone(const df::coord &pos,
+                                            const tile_context &ctx);
+
 static const char * get_tile_zone(const df::coord &pos,
                                   const tile_context &ctx) {
-    vector<df::building_civzonest*> civzones;
-    if (!Buildings::findCivzonesAt(&civzones, pos))
+    df::building_civzonest *zone = get_civzone(pos, ctx);
+    if (!zone)
         return NULL;
 
-    // we only have one "zone" blueprint, so use the "topmost" zone (that is,
-    // the one that is highlighted when the cursor is over this tile).
-    // overlapping zones are outside the scope of this plugin, I think.
-    df::building_civzonest *zone = civzones.back();
-
     if (!is_rectangular(zone))
         return get_zone_keys(zone);
 
@@ -1037,21 +1101,14 @@ static string csv_quote(const string &str) {
 static const char * get_tile_query(const df::coord &pos,
                                    const tile_context &ctx) {
     string bld_name, zone_name;
-    auto & seen = ctx.processor->seen;
+    auto & seen = *ctx.seen;
 
-    if (ctx.b && !seen.count(ctx.b)) {
+    if (ctx.b && seen.emplace(ctx.b).second)
         bld_name = ctx.b->name;
-        seen.emplace(ctx.b);
-    }
 
-    vector<df::building_civzonest*> civzones;
-    if (Buildings::findCivzonesAt(&civzones, pos)) {
-        auto civzone = civzones.back();
-        if (!seen.count(civzone)) {
-            zone_name = civzone->name;
-            seen.emplace(civzone);
-        }
-    }
+    df::building_civzonest *civzone = get_civzone(pos, ctx);
+    if (civzone && seen.emplace(civzone).second)
+        zone_name = civzone->name;
 
     if (!bld_name.size() && !zone_name.size())
         return NULL;
@@ -1169,7 +1226,7 @@ static bool is_meta_phase(color_ostream &out,
     return lua_toboolean(L, -1);
 }
 
-static void write_minimal(ofstream &ofile, const blueprint_options &opts,
+static void write_minimal(string &buf, const blueprint_options &opts,
                           const bp_volume &mapdata) {
     if (mapdata.begin() == mapdata.end())
         return;
@@ -1177,13 +1234,15 @@ static void write_minimal(ofstream &ofile, const blueprint_options &opts,
     const string z_key = opts.depth > 0 ? "#<" : "#>";
 
     int16_t zprev = 0;
-    for (auto area : mapdata) {
-        for ( ; zprev < area.first; ++zprev)
-            ofile << z_key << endl;
+    for (auto &area : mapdata) {
+        for ( ; zprev < area.first; ++zprev) {
+            buf += z_key;
+            buf += '\n';
+        }
         int16_t yprev = 0;
-        for (auto row : area.second) {
+        for (auto &row : area.second) {
             for ( ; yprev < row.first; ++yprev)
-                ofile << endl;
+                buf += '\n';
             size_t xprev = 0;
             auto &tiles = row.second;
             size_t rowsize = tiles.size();
@@ -1191,40 +1250,115 @@ static void write_minimal(ofstream &ofile, const blueprint_options &opts,
                 if (!tiles[x])
                     continue;
                 for ( ; xprev < x; ++xprev)
-                    ofile << ",";
-                ofile << tiles[x];
+                    buf += ',';
+                buf += tiles[x];
             }
         }
-        ofile << endl;
+        buf += '\n';
     }
 }
 
-static void write_pretty(ofstream &ofile, const blueprint_options &opts,
+static void write_pretty(string &buf, const blueprint_options &opts,
                          const bp_volume &mapdata) {
     const string z_key = opts.depth > 0 ? "#<" : "#>";
 
     int16_t absdepth = abs(opts.depth);
+    // most tiles are a single character followed by a comma
+    buf.reserve(buf.size() + size_t(absdepth) * opts.height * (opts.width * 2 + 2));
     for (int16_t z = 0; z < absdepth; ++z) {
         const bp_area *area = NULL;
-        if (mapdata.count(z))
-            area = &mapdata.at(z);
+        auto area_it = mapdata.find(z);
+        if (area_it != mapdata.end())
+            area = &area_it->second;
         for (int16_t y = 0; y < opts.height; ++y) {
             const bp_row *row = NULL;
-            if (area && area->count(y))
-                row = &area->at(y);
+            if (area) {
+                auto row_it = area->find(y);
+                if (row_it != area->end())
+                    row = &row_it->second;
+            }
             for (int16_t x = 0; x < opts.width; ++x) {
                 const char *tile = NULL;
                 if (row)
                     tile = row->at(x);
-                ofile << (tile ? tile : " ") << ",";
+                buf += tile ? tile : " ";
+                buf += ',';
             }
-            ofile << "#" << endl;
+            buf += "#\n";
+        }
+        if (z < absdepth - 1) {
+            buf += z_key;
+            buf += '\n';
         }
-        if (z < absdepth - 1)
-            ofile << z_key << endl;
     }
 }
 
+// Writes the generated blueprints to disk on a background thread, so the next
+// phase can be formatted while the previous one is being written. Blueprints
+// are written in the order they are queued; files are truncated when they are
+// first written to.
+class blueprint_writer {
+public:
+    blueprint_writer() : writer([this]() { run(); }) { }
+
+    ~blueprint_writer() {
+        finish();
+    }
+
+    void write(const string &fname, string &&text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.emplace_back(fname, std::move(text));
+        cond.notify_one();
+    }
+
+    // waits until everything is written and closes the files. returns the
+    // names of all written files.
+    vector<string> finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            cond.notify_one();
+        }
+        if (writer.joinable())
+            writer.join();
+
+        vector<string> names;
+        for (auto &it : files) {
+            names.push_back(it.first);
+            it.second->close();
+        }
+        files.clear();
+        return names;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [this]() { return done || !queue.empty(); });
+            if (queue.empty())
+                return;
+            auto item = std::move(queue.front());
+            queue.pop_front();
+
+            lock.unlock();
+            auto &file = files[item.first];
+            if (!file)
+                file.reset(new ofstream(item.first, ofstream::trunc));
+            file->write(item.second.data(), item.second.size());
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<pair<string, string>> queue;
+    bool done = false;
+    // only used by the writer thread until it is joined
+    map<string, std::unique_ptr<ofstream>> files;
+    std::thread writer;
+};
+
 static string get_modeline(color_ostream &out, const blueprint_options &opts,
                            const string &mode, const string &phase) {
     std::ostringstream modeline;
@@ -1244,71 +1378,120 @@ static string get_modeline(color_ostream &out, const blueprint_options &opts,
 }
 
 static bool write_blueprint(color_ostream &out,
-                            std::map<string, ofstream*> &output_files,
+                            blueprint_writer &writer,
                             const blueprint_options &opts,
                             const blueprint_processor &processor,
                             bool pretty, int32_t ordinal) {
     string fname;
     if (!get_filename(fname, out, opts, processor.phase, ordinal))
         return false;
-    if (!output_files.count(fname))
-        output_files[fname] = new ofstream(fname, ofstream::trunc);
 
-    ofstream &ofile = *output_files[fname];
-    ofile << get_modeline(out, opts, processor.mode, processor.phase) << endl;
+    string buf = get_modeline(out, opts, processor.mode, processor.phase);
+    buf += '\n';
 
     if (pretty)
-        write_pretty(ofile, opts, processor.mapdata);
+        write_pretty(buf, opts, processor.mapdata);
     else
-        write_minimal(ofile, opts, processor.mapdata);
+        write_minimal(buf, opts, processor.mapdata);
 
+    writer.write(fname, std::move(buf));
     return true;
 }
 
 static void write_meta_blueprint(color_ostream &out,
-                                 std::map<string, ofstream*> &output_files,
+                                 blueprint_writer &writer,
                                  const blueprint_options &opts,
                                  const std::vector<string> & meta_phases,
                                  int32_t ordinal) {
     string fname;
     get_filename(fname, out, opts, meta_phases.front(), ordinal);
-    ofstream &ofile = *output_files[fname];
 
-    ofile << "#meta label(";
+    string buf = "#meta label(";
     for (string phase : meta_phases) {
-        ofile << phase;
+        buf += phase;
         if (phase != meta_phases.back())
-            ofile << "_";
+            buf += "_";
     }
-    ofile << ")" << endl;
+    buf += ")\n";
 
     for (string phase : meta_phases) {
-        ofile << "/" << phase << endl;
+        buf += "/" + phase + "\n";
     }
+
+    writer.write(fname, std::move(buf));
 }
 
+// The tiles of one z-level of the blueprint area, handed to a worker thread
+// that generates all phases for that level.
+struct level_snapshot {
+    df::coord start;
+    int32_t width = 0;
+    int32_t z = 0;
+    // Buildings::findAtTile and Buildings::findCivzonesAt keep caches that
+    // must not be updated from several threads at once, so the buildings and
+    // the topmost zone at each tile are looked up on the main thread. Empty
+    // if no phase needs them.
+    vector<df::building *> buildings;
+    vector<df::building_civzonest *> civzones;
+    // generated tiles and named buildings, indexed like the processors
+    vector<bp_area> areas;
+    vector<std::set<df::building *>> seen;
+
+    size_t index(const df::coord &pos) const {
+        return (pos.y - start.y) * width + (pos.x - start.x);
+    }
+
+    df::building * building_at(const df::coord &pos) const {
+        if (buildings.empty())
+            return NULL;
+        return buildings[index(pos)];
+    }
+
+    df::building_civzonest * civzone_at(const df::coord &pos) const {
+        if (civzones.empty())
+            return NULL;
+        return civzones[index(pos)];
+    }
+};
+
 static void ensure_building(const df::coord &pos, tile_context &ctx) {
     if (ctx.b)
         return;
-    ctx.b = Buildings::findAtTile(pos);
+    ctx.b = ctx.level ? ctx.level->building_at(pos) : Buildings::findAtTile(pos);
+}
+
+// we only have one "zone" blueprint, so use the "topmost" zone (that is, the
+// one that is highlighted when the cursor is over this tile). overlapping
+// zones are outside the scope of this plugin, I think.
+static df::building_civzonest * find_topmost_civzone(const df::coord &pos) {
+    vector<df::building_civzonest*> civzones;
+    if (!Buildings::findCivzonesAt(&civzones, pos))
+        return NULL;
+    return civzones.back();
+}
+
+static df::building_civzonest * get_civzone(const df::coord &pos,
+                                            const tile_context &ctx) {
+    return ctx.level ? ctx.level->civzone_at(pos) : find_topmost_civzone(pos);
 }
 
 static void add_processor(vector<blueprint_processor> &processors,
                           const blueprint_options &opts, const char *mode,
                           const char *phase, bool require_phase,
                           get_tile_fn * const get_tile,
-                          init_ctx_fn * const init_ctx = NULL) {
+                          init_ctx_fn * const init_ctx = NULL,
+                          bool need_zones = false) {
     if (opts.auto_phase || require_phase)
         processors.push_back(blueprint_processor(mode, phase, require_phase,
-                                                 get_tile, init_ctx));
+                                                 get_tile, init_ctx,
+                                                 need_zones));
 }
 
 static bool do_transform(color_ostream &out,
                          const df::coord &start, const df::coord &end,
                          blueprint_options opts, // copy so we can munge it
                          vector<string> &filenames) {
-    // empty map instances to pass to emplace() below
-    static const bp_area EMPTY_AREA;
+    // empty row to pass to emplace() below
     static const bp_row EMPTY_ROW;
 
     if (opts.engrave) {
@@ -1336,9 +1519,10 @@ static bool do_transform(color_ostream &out,
     add_processor(processors, opts, "place", "place", opts.place,
                   get_tile_place, ensure_building);
 /* TODO: understand how this changes for v50
-    add_processor(processors, opts, "zone", "zone", opts.zone, get_tile_zone);
+    add_processor(processors, opts, "zone", "zone", opts.zone, get_tile_zone,
+                  NULL, true);
     add_processor(processors, opts, "query", "query", opts.query,
-                  get_tile_query, ensure_building);
+                  get_tile_query, ensure_building, true);
     add_processor(processors, opts, "query", "rooms", opts.rooms,
                   get_tile_rooms, ensure_building);
 */
@@ -1352,23 +1536,39 @@ static bool do_transform(color_ostream &out,
 
     const bool pretty = opts.format != "minimal";
     const int32_t z_inc = start.z < end.z ? 1 : -1;
-    for (int32_t z = start.z; z != end.z; z += z_inc) {
+    const int32_t width = end.x - start.x;
+    const int32_t height = end.y - start.y;
+    const size_t num_levels = abs(end.z - start.z);
+
+    bool need_buildings = false, need_zones = false;
+    for (auto &processor : processors) {
+        need_buildings |= processor.init_ctx != NULL;
+        need_zones |= processor.need_zones;
+    }
+
+    vector<std::unique_ptr<level_snapshot>> levels(num_levels);
+
+    // generates the phases for one level. only reads map data, so several
+    // levels can be processed at the same time.
+    auto process_level = [&](level_snapshot &level) {
+        level.areas.resize(processors.size());
+        level.seen.resize(processors.size());
         for (int32_t y = start.y; y < end.y; y++) {
             for (int32_t x = start.x; x < end.x; x++) {
-                df::coord pos(x, y, z);
+                df::coord pos(x, y, level.z);
                 tile_context ctx;
                 ctx.pretty = pretty;
-                for (blueprint_processor &processor : processors) {
+                ctx.level = &level;
+                for (size_t i = 0; i < processors.size(); ++i) {
+                    blueprint_processor &processor = processors[i];
                     ctx.processor = &processor;
+                    ctx.seen = &level.seen[i];
                     if (processor.init_ctx)
                         processor.init_ctx(pos, ctx);
                     const char *tile_str = processor.get_tile(pos, ctx);
                     if (tile_str) {
-                        // ensure our z-index is in the order we want to write
-                        auto area = processor.mapdata.emplace(abs(z - start.z),
-                                                              EMPTY_AREA);
-                        auto row = area.first->second.emplace(y - start.y,
-                                                              EMPTY_ROW);
+                        auto row = level.areas[i].emplace(y - start.y,
+                                                          EMPTY_ROW);
                         auto &tiles = row.first->second;
                         if (row.second)
                             tiles.resize(opts.width);
@@ -1377,6 +1577,108 @@ static bool do_transform(color_ostream &out,
                 }
             }
         }
+        level.buildings.clear();
+        level.buildings.shrink_to_fit();
+        level.civzones.clear();
+        level.civzones.shrink_to_fit();
+        level.seen.clear();
+    };
+
+    // snapshots are taken on this thread and queued for the workers. the
+    // queue is bounded so the building snapshots of a very deep area are
+    // not all held in memory at once.
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::deque<level_snapshot *> queue;
+    bool queue_done = false;
+    // rethrown on this thread once the workers are done
+    std::exception_ptr worker_error;
+    std::mutex error_mutex;
+
+    size_t num_workers = std::min<size_t>(std::thread::hardware_concurrency(),
+                                          num_levels);
+    num_workers = std::min<size_t>(num_workers, 8);
+    const size_t max_queued = num_workers * 2;
+
+    vector<std::thread> workers;
+    if (num_workers > 1) {
+        for (size_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back([&]() {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                while (true) {
+                    queue_cond.wait(lock, [&]() {
+                        return queue_done || !queue.empty();
+                    });
+                    if (queue.empty())
+                        return;
+                    level_snapshot *level = queue.front();
+                    queue.pop_front();
+                    queue_cond.notify_all();
+                    lock.unlock();
+                    try {
+                        process_level(*level);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> error_lock(error_mutex);
+                        if (!worker_error)
+                            worker_error = std::current_exception();
+                    }
+                    lock.lock();
+                }
+            });
+        }
+    }
+
+    for (size_t i = 0; i < num_levels; ++i) {
+        auto &level = levels[i];
+        level.reset(new level_snapshot);
+        level->start = start;
+        level->width = width;
+        level->z = start.z + int32_t(i) * z_inc;
+
+        if (need_buildings) {
+            level->buildings.resize(size_t(width) * height);
+            for (int32_t y = start.y; y < end.y; y++)
+                for (int32_t x = start.x; x < end.x; x++)
+                    level->buildings[(y - start.y) * width + (x - start.x)] =
+                        Buildings::findAtTile(df::coord(x, y, level->z));
+        }
+        if (need_zones) {
+            level->civzones.resize(size_t(width) * height);
+            for (int32_t y = start.y; y < end.y; y++)
+                for (int32_t x = start.x; x < end.x; x++)
+                    level->civzones[(y - start.y) * width + (x - start.x)] =
+                        find_topmost_civzone(df::coord(x, y, level->z));
+        }
+
+        if (workers.empty()) {
+            process_level(*level);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_cond.wait(lock, [&]() { return queue.size() < max_queued; });
+        queue.push_back(level.get());
+        queue_cond.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue_done = true;
+        queue_cond.notify_all();
+    }
+    for (auto &worker : workers)
+        worker.join();
+    if (worker_error)
+        std::rethrow_exception(worker_error);
+
+    // the z-index is the order we want to write
+    for (size_t i = 0; i < num_levels; ++i) {
+        auto &areas = levels[i]->areas;
+        for (size_t p = 0; p < processors.size(); ++p) {
+            if (!areas[p].empty())
+                processors[p].mapdata.emplace(int16_t(i), std::move(areas[p]));
+        }
+        levels[i].reset();
     }
 
     std::vector<string> meta_phases;
@@ -1391,7 +1693,7 @@ static bool do_transform(color_ostream &out,
 
     bool in_meta = false;
     int32_t ordinal = 0;
-    std::map<string, ofstream*> output_files;
+    blueprint_writer writer;
     for (blueprint_processor &processor : processors) {
         if (processor.mapdata.empty() && !processor.force_create)
             continue;
@@ -1399,22 +1701,18 @@ static bool do_transform(color_ostream &out,
         if (!in_meta)
             ++ordinal;
         if (in_meta && !meta_phase) {
-            write_meta_blueprint(out, output_files, opts, meta_phases, ordinal);
+            write_meta_blueprint(out, writer, opts, meta_phases, ordinal);
             ++ordinal;
         }
         in_meta = meta_phase;
-        if (!write_blueprint(out, output_files, opts, processor, pretty,
-                             ordinal))
+        if (!write_blueprint(out, writer, opts, processor, pretty, ordinal))
             break;
     }
     if (in_meta)
-        write_meta_blueprint(out, output_files, opts, meta_phases, ordinal);
+        write_meta_blueprint(out, writer, opts, meta_phases, ordinal);
 
-    for (auto &it : output_files) {
-        filenames.push_back(it.first);
-        it.second->close();
-        delete(it.second);
-    }
+    for (auto &fname : writer.finish())
+        filenames.push_back(fname);
 
     return true;
 }
@@ -77,8 +77,7 @@ void PlannedBuilding::remove(color_ostream &out) {
         planned_buildings.erase(id);
 }
 
-static const int32_t CYCLE_TICKS = 600; // twice per game day
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 600, 1000); // twice per game day
 
 static bool call_buildingplan_lua(color_ostream *out, const char *fn_name,
         int nargs = 0, int nres = 0,
@@ -323,8 +322,16 @@ static bool is_suspendmanager_enabled(color_ostream &out) {
     return suspendmanager_enabled;
 }
 
+static void load_filter_configs(color_ostream &out) {
+    vector<PersistentDataItem> filter_configs;
+    World::GetPersistentData(&filter_configs, FILTER_CONFIG_KEY);
+    for (auto &cfg : filter_configs) {
+        BuildingTypeKey key = DefaultItemFilters::getKey(cfg);
+        cur_item_filters.emplace(key, DefaultItemFilters(out, cfg, get_job_items(out, key)));
+    }
+}
+
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -337,13 +344,7 @@ DFhackCExport command_result plugin_load_data (color_ostream &out) {
     clear_state(out);
 
     load_material_cache();
-
-    vector<PersistentDataItem> filter_configs;
-    World::GetPersistentData(&filter_configs, FILTER_CONFIG_KEY);
-    for (auto &cfg : filter_configs) {
-        BuildingTypeKey key = DefaultItemFilters::getKey(cfg);
-        cur_item_filters.emplace(key, DefaultItemFilters(out, cfg, get_job_items(out, key)));
-    }
+    load_filter_configs(out);
 
     vector<PersistentDataItem> building_configs;
     World::GetPersistentData(&building_configs, BLD_CONFIG_KEY);
@@ -369,25 +370,141 @@ DFhackCExport command_result plugin_load_data (color_ostream &out) {
     return CR_OK;
 }
 
-static bool cycle_requested = false;
+// on reload, the new instance takes over the task queues (in their current
+// order, so buildings that have waited longest still get items first) and the
+// heat safety settings, which are not persisted. the planned buildings are
+// read back from the persistent data, which stays in memory, but they are not
+// checked and bucketed again.
+static const int32_t HANDOFF_VERSION = 1;
+
+static void write_string(std::ostream &os, const string &str) {
+    os << str.size() << ' ' << str << '\n';
+}
+
+static bool read_string(std::istream &is, string &str) {
+    size_t len;
+    if (!(is >> len) || is.get() != ' ')
+        return false;
+    str.resize(len);
+    return bool(is.read(&str[0], len));
+}
+
+DFhackCExport command_result plugin_export_state (color_ostream &out, int32_t &version, string &data) {
+    if (!Core::getInstance().isWorldLoaded())
+        return CR_FAILURE;
+
+    std::ostringstream ss;
+    ss << cur_heat_safety.size() << '\n';
+    for (auto &entry : cur_heat_safety)
+        ss << entry.first.serialize() << ' ' << int(entry.second) << '\n';
+    size_t num_buckets = 0;
+    for (auto &vec : tasks)
+        num_buckets += vec.second.size();
+    ss << num_buckets << '\n';
+    for (auto &vec : tasks) {
+        for (auto &bucket : vec.second) {
+            ss << int(vec.first) << ' ';
+            write_string(ss, bucket.first);
+            ss << bucket.second.size();
+            for (auto &task : bucket.second)
+                ss << ' ' << task.first << ' ' << task.second;
+            ss << '\n';
+        }
+    }
+
+    DEBUG(status,out).print("exporting %zu task bucket(s)\n", num_buckets);
+    version = HANDOFF_VERSION;
+    data = ss.str();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_import_state (color_ostream &out, int32_t version, const string &data) {
+    if (version != HANDOFF_VERSION || !Core::getInstance().isWorldLoaded())
+        return CR_FAILURE;
+
+    // parse everything before touching any state, so a bad handoff can still
+    // fall back to plugin_load_data
+    std::istringstream ss(data);
+    vector<std::pair<BuildingTypeKey, HeatSafety>> heat_safety;
+    size_t count;
+    if (!(ss >> count))
+        return CR_FAILURE;
+    for (size_t i = 0; i < count; ++i) {
+        string key_str;
+        int heat;
+        if (!(ss >> key_str >> heat))
+            return CR_FAILURE;
+        heat_safety.emplace_back(BuildingTypeKey(out, key_str), (HeatSafety)heat);
+    }
+    Tasks new_tasks;
+    if (!(ss >> count))
+        return CR_FAILURE;
+    for (size_t i = 0; i < count; ++i) {
+        int vector_id;
+        string bucket_name;
+        size_t num_tasks;
+        if (!(ss >> vector_id) || ss.get() != ' ' || !read_string(ss, bucket_name)
+                || !(ss >> num_tasks))
+            return CR_FAILURE;
+        auto &bucket = new_tasks[(df::job_item_vector_id)vector_id][bucket_name];
+        for (size_t j = 0; j < num_tasks; ++j) {
+            int32_t id;
+            int jitem_index;
+            if (!(ss >> id >> jitem_index))
+                return CR_FAILURE;
+            bucket.emplace_back(id, jitem_index);
+        }
+    }
+
+    config = World::GetPersistentData(CONFIG_KEY);
+    if (!config.isValid())
+        return CR_FAILURE;
+    validate_config(out);
+
+    DEBUG(status,out).print("importing state from the previous instance\n");
+    clear_state(out);
+
+    load_material_cache();
+    load_filter_configs(out);
+    for (auto &entry : heat_safety)
+        cur_heat_safety[entry.first] = entry.second;
+
+    vector<PersistentDataItem> building_configs;
+    World::GetPersistentData(&building_configs, BLD_CONFIG_KEY);
+    for (auto &cfg : building_configs) {
+        PlannedBuilding pb(out, cfg);
+        if (!df::building::find(pb.id)) {
+            DEBUG(status,out).print("building %d no longer exists; skipping\n", pb.id);
+            pb.remove(out);
+            continue;
+        }
+        planned_buildings.emplace(pb.id, pb);
+    }
+
+    // skip the tasks of buildings that are gone instead of leaving them for
+    // the cycle to discard
+    for (auto &vec : new_tasks) {
+        for (auto &bucket : vec.second) {
+            for (auto &task : bucket.second) {
+                if (planned_buildings.count(task.first))
+                    tasks[vec.first][bucket.first].push_back(task);
+            }
+        }
+    }
+
+    return CR_OK;
+}
 
 static void do_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-    cycle_requested = false;
+    cycle_schedule.requested = false;
 
     bool unsuspend_on_finalize = !is_suspendmanager_enabled(out);
     buildingplan_cycle(out, tasks, planned_buildings, unsuspend_on_finalize);
     call_buildingplan_lua(&out, "signal_reset");
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (!Core::getInstance().isWorldLoaded())
-        return CR_OK;
-
-    if (is_enabled &&
-            (cycle_requested || world->frame_counter - cycle_timestamp >= CYCLE_TICKS))
-        do_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    do_cycle(out);
     return CR_OK;
 }
 
@@ -670,7 +787,7 @@ static void doCycle(color_ostream &out) {
 
 static void scheduleCycle(color_ostream &out) {
     DEBUG(status,out).print("entering scheduleCycle\n");
-    cycle_requested = true;
+    cycle_schedule.requested = true;
 }
 
 static int scanAvailableItems(color_ostream &out, df::building_type type, int16_t subtype,
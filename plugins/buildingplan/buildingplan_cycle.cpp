@@ -44,11 +44,14 @@ struct BadFlags {
 
 // This is tricky. we want to choose an item that can be brought to the job site, but that's not
 // necessarily the same as job->pos. it could be many tiles off in any direction (e.g. for bridges), or
-// up or down (e.g. for stairs). For now, just return if the item is on a walkable tile.
+// up or down (e.g. for stairs). For now, just return if a citizen can walk to the item. If there are
+// no citizens to check against, accept any item on a walkable tile.
 static bool isAccessible(color_ostream& out, df::item* item) {
     df::coord item_pos = Items::getPosition(item);
     uint16_t walkability_group = Maps::getWalkableGroup(item_pos);
-    bool is_walkable = walkability_group != 0;
+    const Maps::WalkableGroupSet &citizen_groups = Maps::getCitizenWalkableGroups();
+    bool is_walkable = citizen_groups.empty() ? walkability_group != 0
+                                              : citizen_groups.contains(walkability_group);
     TRACE(cycle, out).print("item %d in walkability_group %u at (%d,%d,%d) is %saccessible from job site\n",
         item->id, walkability_group, item_pos.x, item_pos.y, item_pos.z, is_walkable ? "(probably) " : "not ");
     return is_walkable;
@@ -25,6 +25,7 @@ redistribute it freely, subject to the following restrictions:
 #include "PluginManager.h"
 #include "DebugManager.h"
 #include "Debug.h"
+#include "DebugLogSink.h"
 #include "modules/Filesystem.h"
 
 #include <jsoncpp-ex.h>
@@ -1047,6 +1048,62 @@ static command_result configureHeader(color_ostream& out,
     return CR_OK;
 }
 
+static command_result configureLog(color_ostream& out,
+                                   std::vector<std::string>& parameters)
+{
+    DebugLogSink &sink = DebugLogSink::getInstance();
+    DebugLogSink::Config config = sink.getConfig();
+
+    const size_t nparams = parameters.size();
+    if (nparams >= 3 && parameters[1] == "async" &&
+        (parameters[2] == "enable" || parameters[2] == "disable")) {
+        config.async = parameters[2] == "enable";
+        sink.setConfig(config);
+    } else if (nparams >= 3 && parameters[1] == "file") {
+        if (parameters[2] == "disable") {
+            config.file.clear();
+        } else {
+            config.file = parameters[2];
+            try {
+                if (nparams >= 4)
+                    config.file_max_size = std::stoul(parameters[3]) * 1024;
+                if (nparams >= 5)
+                    config.file_count = std::stoul(parameters[4]);
+            } catch(...) {
+                ERR(command,out) << "File size and count must be numbers"
+                    << std::endl;
+                return CR_WRONG_USAGE;
+            }
+        }
+        sink.setConfig(config);
+    } else if (nparams >= 2) {
+        ERR(command,out).print("log requires 'async enable|disable' or "
+                "'file <path>|disable'\n");
+        return CR_WRONG_USAGE;
+    }
+
+    out.color(COLOR_GREEN);
+    out << std::setw(welement) << "Log output"
+        << std::setw(wsetting) << "Setting" << '\n';
+    listHeaderSetting(out, COLOR_CYAN, "async",
+                      config.async || !config.file.empty());
+    out.color(COLOR_LIGHTCYAN);
+    out << std::setw(welement) << "file"
+        << std::setw(wsetting)
+        << (config.file.empty() ? "Disabled" : config.file) << '\n';
+    if (!config.file.empty()) {
+        out.color(COLOR_CYAN);
+        out << std::setw(welement) << "file size"
+            << std::setw(wsetting) << config.file_max_size / 1024 << " KiB\n";
+        out.color(COLOR_LIGHTCYAN);
+        out << std::setw(welement) << "rotated files"
+            << std::setw(wsetting) << config.file_count << '\n';
+    }
+    out << std::endl;
+
+    return CR_OK;
+}
+
 using DFHack::debugPlugin::CommandDispatch;
 
 CommandDispatch::dispatch_t CommandDispatch::dispatch {
@@ -1057,6 +1114,7 @@ CommandDispatch::dispatch_t CommandDispatch::dispatch {
     {"enable", {enableFilter}},
     {"disable", {disableFilter}},
     {"header", {configureHeader}},
+    {"log", {configureLog}},
 };
 
 //! Dispatch command handling to the subcommand or help
@@ -0,0 +1,108 @@
+// Measure the throughput of virtual_cast, strict_virtual_cast and
+// virtual_identity::get on the items of the loaded world.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Console.h"
+#include "Core.h"
+#include "DataDefs.h"
+#include "Export.h"
+#include "PluginManager.h"
+
+#include "df/item.h"
+#include "df/item_constructed.h"
+#include "df/item_weaponst.h"
+#include "df/world.h"
+
+using std::string;
+using std::vector;
+
+using namespace DFHack;
+
+DFHACK_PLUGIN("vcastbench");
+REQUIRE_GLOBAL(world);
+
+typedef std::chrono::steady_clock bench_clock;
+
+template<class F>
+static double run(const vector<df::item *> &items, int iterations, int threads, F fn)
+{
+    std::atomic<size_t> hits{0};
+    auto worker = [&]() {
+        size_t found = 0;
+        for (int i = 0; i < iterations; i++)
+            for (auto item : items)
+                found += fn(item) ? 1 : 0;
+        hits += found;
+    };
+
+    auto start = bench_clock::now();
+    vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool)
+        th.join();
+    auto elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // keep the compiler from dropping the casts
+    if (hits.load() == size_t(-1))
+        abort();
+
+    return double(items.size()) * iterations * threads / elapsed;
+}
+
+static void report(color_ostream &out, const char *name, double per_second)
+{
+    out.print("  %-22s %10.2f M casts/s\n", name, per_second / 1e6);
+}
+
+command_result df_vcastbench(color_ostream &out, vector<string> &parameters)
+{
+    if (parameters.size() > 2)
+        return CR_WRONG_USAGE;
+
+    int iterations = parameters.size() > 0 ? atoi(parameters[0].c_str()) : 100;
+    int threads = parameters.size() > 1 ? atoi(parameters[1].c_str()) : 1;
+    if (iterations <= 0 || threads <= 0)
+        return CR_WRONG_USAGE;
+
+    CoreSuspender suspend;
+
+    if (!world || world->items.all.empty())
+    {
+        out.printerr("No items to test with; load a fort first.\n");
+        return CR_FAILURE;
+    }
+
+    vector<df::item *> items(world->items.all.begin(), world->items.all.end());
+
+    out.print("%zu items, %d iterations, %d thread(s)\n", items.size(), iterations, threads);
+    report(out, "strict_virtual_cast", run(items, iterations, threads,
+        [](df::item *item) { return strict_virtual_cast<df::item_weaponst>(item) != NULL; }));
+    report(out, "virtual_cast", run(items, iterations, threads,
+        [](df::item *item) { return virtual_cast<df::item_constructed>(item) != NULL; }));
+    report(out, "virtual_identity::get", run(items, iterations, threads,
+        [](df::item *item) { return virtual_identity::get(item) != NULL; }));
+
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_init(color_ostream &out, std::vector<PluginCommand> &commands)
+{
+    commands.push_back(PluginCommand("vcastbench",
+                                     "Measure virtual cast throughput: vcastbench [iterations] [threads]",
+                                     df_vcastbench));
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_shutdown(color_ostream &out)
+{
+    return CR_OK;
+}
@@ -67,8 +67,7 @@ static void set_config_bool(int index, bool value) {
     set_config_val(index, value ? 1 : 0);
 }
 
-static const int32_t CYCLE_TICKS = 2459; // a prime number that's around 2 days
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 2459, 500); // a prime number that's around 2 days
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void dwarfvet_cycle(color_ostream &out);
@@ -101,7 +100,6 @@ DFhackCExport command_result plugin_enable(color_ostream &out, bool enable) {
 }
 
 DFhackCExport command_result plugin_load_data(color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -127,9 +125,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        dwarfvet_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    dwarfvet_cycle(out);
     return CR_OK;
 }
 
@@ -176,9 +173,6 @@ static command_result do_command(color_ostream &out, vector<string> &parameters)
 }
 
 static void dwarfvet_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
     call_dwarfvet_lua(&out, "checkup");
 }
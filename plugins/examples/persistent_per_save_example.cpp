@@ -86,8 +86,10 @@ static void remove_elem_config(color_ostream &out, int id) {
     elems.erase(id);
 }
 
-static const int32_t CYCLE_TICKS = 1200; // one day
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+// run plugin_oncycle once a day while enabled. the last value is a rough
+// guess of how many microseconds a cycle takes, which the core uses to keep
+// the cycles of different plugins from running on the same tick
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 500);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream &out);
@@ -132,7 +134,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -173,9 +174,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        do_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    do_cycle(out);
     return CR_OK;
 }
 
@@ -201,10 +201,7 @@ static command_result do_command(color_ostream &out, vector<string> &parameters)
 //
 
 static void do_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
-    // TODO: logic that runs every CYCLE_TICKS ticks
+    // TODO: logic that runs every cycle_schedule.period ticks
 }
@@ -136,7 +136,9 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
 
 // Whatever you put here will be done in each game frame refresh. Don't abuse it.
 // Note that if the plugin implements the enabled API, this function is only called
-// if the plugin is enabled.
+// if the plugin is enabled. For work that only needs to run every N ticks,
+// declare DFHACK_PLUGIN_CYCLE and implement plugin_oncycle instead (see
+// persistent_per_save_example.cpp).
 DFhackCExport command_result plugin_onupdate (color_ostream &out) {
     DEBUG(onupdate,out).print(
         "onupdate called (run 'debugfilter set info skeleton onupdate' to stop"
@@ -167,6 +169,32 @@ DFhackCExport command_result plugin_load_data (color_ostream &out) {
     return CR_OK;
 }
 
+// When the plugin is reloaded (e.g. with the "reload" command), the old
+// instance can hand state to the new one so it does not have to be rebuilt
+// from the saved data. plugin_export_state is called after plugin_save_data
+// and before plugin_shutdown; the version and data are opaque to DFHack.
+// plugin_import_state is then called right after plugin_init of the new
+// instance. If it returns CR_OK, plugin_load_data is not called. Return
+// anything else (e.g. for a version you do not understand) to fall back to
+// plugin_load_data. The game may run briefly between the two calls.
+DFhackCExport command_result plugin_export_state (color_ostream &out, int32_t &version, string &data) {
+    DEBUG(status,out).print("reloading; exporting state for the next instance\n");
+    version = 1;
+    data.clear();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_import_state (color_ostream &out, int32_t version, const string &data) {
+    DEBUG(status,out).print("reloaded; importing state version %d\n", version);
+    // this skeleton exports no state, so nothing is imported here and
+    // plugin_load_data runs as usual
+    if (version != 1 || data.empty())
+        return CR_FAILURE;
+    // restore your state from data here. only return CR_OK once it has really
+    // been restored, since plugin_load_data is skipped then.
+    return CR_OK;
+}
+
 // This is the callback we registered in plugin_init. Note that while plugin
 // callbacks are called with the core suspended, command callbacks are called
 // from a different thread and need to explicity suspend the core if they
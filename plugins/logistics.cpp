@@ -3,6 +3,7 @@
 #include "PluginManager.h"
 
 #include "modules/Buildings.h"
+#include "modules/ItemSweep.h"
 #include "modules/Job.h"
 #include "modules/Persistence.h"
 #include "modules/Units.h"
@@ -94,12 +95,21 @@ static void remove_stockpile_config(color_ostream& out, int stockpile_number) {
     watched_stockpiles.erase(stockpile_number);
 }
 
-static const int32_t CYCLE_TICKS = 600;
-static int32_t cycle_timestamp = 0; // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 600, 2000);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream& out, int32_t& melt_count, int32_t& trade_count, int32_t& dump_count, int32_t& train_count);
 
+// items marked for dumping, counted by the shared item sweep
+struct DumpCounter : ItemSweep::Subscriber {
+    size_t count = 0;
+    void begin() { count = 0; }
+    void visit(df::item *) { ++count; }
+};
+
+static DumpCounter dump_counter;
+static int dump_sweep_id = -1;
+
 DFhackCExport command_result plugin_init(color_ostream &out, vector<PluginCommand> &commands) {
     DEBUG(status, out).print("initializing %s\n", plugin_name);
 
@@ -108,6 +118,12 @@ DFhackCExport command_result plugin_init(color_ostream &out, vector<PluginComman
         "Automatically mark and route items in monitored stockpiles.",
         do_command));
 
+    df::item_flags dump_flag;
+    dump_flag.bits.dump = true;
+    ItemSweep::Filter filter;
+    filter.good_flags = dump_flag.whole;
+    dump_sweep_id = ItemSweep::subscribe(plugin_self, filter, &dump_counter);
+
     return CR_OK;
 }
 
@@ -163,8 +179,6 @@ static void migrate_old_keys(color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data(color_ostream &out) {
-    cycle_timestamp = 0;
-
     vector<PersistentDataItem> loaded_persist_data;
     World::GetPersistentData(&loaded_persist_data, CONFIG_KEY_PREFIX, true);
     watched_stockpiles.clear();
@@ -178,21 +192,17 @@ DFhackCExport command_result plugin_load_data(color_ostream &out) {
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (!is_enabled || !Core::getInstance().isWorldLoaded())
-        return CR_OK;
-    if (world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int32_t melt_count = 0, trade_count = 0, dump_count = 0, train_count = 0;
-        do_cycle(out, melt_count, trade_count, dump_count, train_count);
-        if (0 < melt_count)
-            out.print("logistics: marked %d item(s) for melting\n", melt_count);
-        if (0 < trade_count)
-            out.print("logistics: marked %d item(s) for trading\n", trade_count);
-        if (0 < dump_count)
-            out.print("logistics: marked %d item(s) for dumping\n", dump_count);
-        if (0 < train_count)
-            out.print("logistics: marked %d animal(s) for training\n", dump_count);
-    }
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    int32_t melt_count = 0, trade_count = 0, dump_count = 0, train_count = 0;
+    do_cycle(out, melt_count, trade_count, dump_count, train_count);
+    if (0 < melt_count)
+        out.print("logistics: marked %d item(s) for melting\n", melt_count);
+    if (0 < trade_count)
+        out.print("logistics: marked %d item(s) for trading\n", trade_count);
+    if (0 < dump_count)
+        out.print("logistics: marked %d item(s) for dumping\n", dump_count);
+    if (0 < train_count)
+        out.print("logistics: marked %d animal(s) for training\n", dump_count);
     return CR_OK;
 }
 
@@ -244,6 +254,67 @@ struct ProcessorStats {
     StatMap designated_counts, can_designate_counts;
 };
 
+// state shared by the processors of all stockpiles scanned in one pass
+struct ScanContext {
+    df::building_tradedepotst *depot = NULL;
+    // container -> contained items, filled as containers are first seen
+    unordered_map<df::item *, vector<df::item *>> contents;
+    // container -> whether it is held by a unit
+    unordered_map<df::item *, bool> unit_held;
+
+    const vector<df::item *> & get_contents(df::item *container) {
+        auto it = contents.find(container);
+        if (it == contents.end()) {
+            it = contents.emplace(container, vector<df::item *>()).first;
+            Items::getContainedItems(container, &it->second);
+        }
+        return it->second;
+    }
+
+    bool is_unit_held(df::item *container) {
+        if (!container)
+            return false;
+        auto it = unit_held.find(container);
+        if (it == unit_held.end())
+            it = unit_held.emplace(container, Items::getGeneralRef(container,
+                    df::general_ref_type::UNIT_HOLDER) != NULL).first;
+        return it->second;
+    }
+};
+
+static df::building_tradedepotst * get_active_trade_depot() {
+    // at least one non-tribute caravan must be approaching or ready to trade
+    if (!plotinfo->caravans.size())
+        return NULL;
+    bool found = false;
+    for (auto caravan : plotinfo->caravans) {
+        if (caravan->flags.bits.tribute)
+            continue;
+        auto trade_state = caravan->trade_state;
+        auto time_remaining = caravan->time_remaining;
+        if ((trade_state == df::caravan_state::T_trade_state::Approaching ||
+                trade_state == df::caravan_state::T_trade_state::AtDepot) && time_remaining != 0) {
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        return NULL;
+
+    // at least one trade depot must be ready to receive goods
+    for (auto bld : world->buildings.other.TRADE_DEPOT) {
+        if (bld->getBuildStage() < bld->getMaxBuildStage())
+            continue;
+
+        if (bld->jobs.size() == 1 &&
+                bld->jobs[0]->job_type == df::job_type::DestroyBuilding)
+            continue;
+
+        return bld;
+    }
+    return NULL;
+}
+
 class StockProcessor {
 public:
     const string name;
@@ -261,8 +332,8 @@ public:
 
 class MeltStockProcessor : public StockProcessor {
 public:
-    MeltStockProcessor(int32_t stockpile_number, bool enabled, ProcessorStats &stats, bool melt_masterworks)
-            : StockProcessor("melt", stockpile_number, enabled, stats), melt_masterworks(melt_masterworks) { }
+    MeltStockProcessor(int32_t stockpile_number, bool enabled, ProcessorStats &stats, ScanContext &ctx, bool melt_masterworks)
+            : StockProcessor("melt", stockpile_number, enabled, stats), ctx(ctx), melt_masterworks(melt_masterworks) { }
 
     bool is_designated(color_ostream &out, df::item *item) override {
         return item->flags.bits.melt;
@@ -283,14 +354,9 @@ public:
             case df::general_ref_type::CONTAINS_UNIT:
                 return false;
             case df::general_ref_type::CONTAINED_IN_ITEM:
-            {
-                df::item *c = g->getItem();
-                for (auto &gg : c->general_refs) {
-                    if (gg->getType() == df::general_ref_type::UNIT_HOLDER)
-                        return false;
-                }
+                if (ctx.is_unit_held(g->getItem()))
+                    return false;
                 break;
-            }
             default:
                 break;
             }
@@ -311,14 +377,14 @@ public:
     }
 
     private:
+    ScanContext &ctx;
     const bool melt_masterworks;
 };
 
 class TradeStockProcessor: public StockProcessor {
 public:
-    TradeStockProcessor(int32_t stockpile_number, bool enabled, ProcessorStats& stats)
-            : StockProcessor("trade", stockpile_number, enabled && get_active_trade_depot(), stats),
-              depot(get_active_trade_depot()) { }
+    TradeStockProcessor(int32_t stockpile_number, bool enabled, ProcessorStats& stats, ScanContext &ctx)
+            : StockProcessor("trade", stockpile_number, enabled && ctx.depot, stats), ctx(ctx) { }
 
     bool is_designated(color_ostream& out, df::item* item) override {
         auto ref = Items::getSpecificRef(item, df::specific_ref_type::JOB);
@@ -327,50 +393,19 @@ public:
     }
 
     bool can_designate(color_ostream& out, df::item* item) override {
-        return Items::canTradeAnyWithContents(item);
+        // reuse the contents list that the melt and dump scans of the
+        // container also need
+        return Items::canTradeAnyWithContents(item, ctx.get_contents(item));
     }
 
     bool designate(color_ostream& out, df::item* item) override {
-        if (!depot)
+        if (!ctx.depot)
             return false;
-        return Items::markForTrade(item, depot);
+        return Items::markForTrade(item, ctx.depot);
     }
 
 private:
-    df::building_tradedepotst * const depot;
-
-    static df::building_tradedepotst * get_active_trade_depot() {
-        // at least one non-tribute caravan must be approaching or ready to trade
-        if (!plotinfo->caravans.size())
-            return NULL;
-        bool found = false;
-        for (auto caravan : plotinfo->caravans) {
-            if (caravan->flags.bits.tribute)
-                continue;
-            auto trade_state = caravan->trade_state;
-            auto time_remaining = caravan->time_remaining;
-            if ((trade_state == df::caravan_state::T_trade_state::Approaching ||
-                    trade_state == df::caravan_state::T_trade_state::AtDepot) && time_remaining != 0) {
-                found = true;
-                break;
-            }
-        }
-        if (!found)
-            return NULL;
-
-        // at least one trade depot must be ready to receive goods
-        for (auto bld : world->buildings.other.TRADE_DEPOT) {
-            if (bld->getBuildStage() < bld->getMaxBuildStage())
-                continue;
-
-            if (bld->jobs.size() == 1 &&
-                    bld->jobs[0]->job_type == df::job_type::DestroyBuilding)
-                continue;
-
-            return bld;
-        }
-        return NULL;
-    }
+    ScanContext &ctx;
 };
 
 class DumpStockProcessor: public StockProcessor {
@@ -485,7 +520,7 @@ static void scan_item(color_ostream &out, df::item *item, StockProcessor &proces
     ++processor.stats.designated_counts[processor.stockpile_number];
 }
 
-static void scan_stockpile(color_ostream &out, df::building_stockpilest *bld,
+static void scan_stockpile(color_ostream &out, df::building_stockpilest *bld, ScanContext &ctx,
         MeltStockProcessor &melt_stock_processor,
         TradeStockProcessor &trade_stock_processor,
         DumpStockProcessor &dump_stock_processor,
@@ -498,9 +533,7 @@ static void scan_stockpile(color_ostream &out, df::building_stockpilest *bld,
         if (0 == (item->flags.whole & bad_flags.whole) &&
                 item->isAssignedToThisStockpile(id)) {
             TRACE(cycle,out).print("assignedToStockpile\n");
-            vector<df::item *> contents;
-            Items::getContainedItems(item, &contents);
-            for (df::item *contained_item : contents) {
+            for (df::item *contained_item : ctx.get_contents(item)) {
                 scan_item(out, contained_item, melt_stock_processor);
                 scan_item(out, contained_item, dump_stock_processor);
             }
@@ -514,12 +547,14 @@ static void scan_stockpile(color_ostream &out, df::building_stockpilest *bld,
 
 static void do_cycle(color_ostream& out, int32_t& melt_count, int32_t& trade_count, int32_t& dump_count, int32_t& train_count) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
-    cycle_timestamp = world->frame_counter;
 
     ProcessorStats melt_stats, trade_stats, dump_stats, train_stats;
     unordered_map<df::building_stockpilest *, PersistentDataItem> cache;
     validate_stockpile_configs(out, cache);
 
+    ScanContext ctx;
+    ctx.depot = get_active_trade_depot();
+
     for (auto &entry : cache) {
         df::building_stockpilest *bld = entry.first;
         PersistentDataItem &c = entry.second;
@@ -531,12 +566,12 @@ static void do_cycle(color_ostream& out, int32_t& melt_count, int32_t& trade_cou
         bool dump = get_config_bool(c, STOCKPILE_CONFIG_DUMP);
         bool train = get_config_bool(c, STOCKPILE_CONFIG_TRAIN);
 
-        MeltStockProcessor melt_stock_processor(stockpile_number, melt, melt_stats, melt_masterworks);
-        TradeStockProcessor trade_stock_processor(stockpile_number, trade, trade_stats);
+        MeltStockProcessor melt_stock_processor(stockpile_number, melt, melt_stats, ctx, melt_masterworks);
+        TradeStockProcessor trade_stock_processor(stockpile_number, trade, trade_stats, ctx);
         DumpStockProcessor dump_stock_processor(stockpile_number, dump, dump_stats);
         TrainStockProcessor train_stock_processor(stockpile_number, train, train_stats);
 
-        scan_stockpile(out, bld, melt_stock_processor,
+        scan_stockpile(out, bld, ctx, melt_stock_processor,
                 trade_stock_processor, dump_stock_processor, train_stock_processor);
     }
 
@@ -560,15 +595,16 @@ static int logistics_getStockpileData(lua_State *L) {
     validate_stockpile_configs(*out, cache);
 
     ProcessorStats melt_stats, trade_stats, dump_stats, train_stats;
+    ScanContext ctx;
 
     for (auto bld : df::global::world->buildings.other.STOCKPILE) {
         int32_t stockpile_number = bld->stockpile_number;
-        MeltStockProcessor melt_stock_processor(stockpile_number, false, melt_stats, false);
-        TradeStockProcessor trade_stock_processor(stockpile_number, false, trade_stats);
+        MeltStockProcessor melt_stock_processor(stockpile_number, false, melt_stats, ctx, false);
+        TradeStockProcessor trade_stock_processor(stockpile_number, false, trade_stats, ctx);
         DumpStockProcessor dump_stock_processor(stockpile_number, false, dump_stats);
         TrainStockProcessor train_stock_processor(stockpile_number, false, train_stats);
 
-        scan_stockpile(*out, bld, melt_stock_processor,
+        scan_stockpile(*out, bld, ctx, melt_stock_processor,
                 trade_stock_processor, dump_stock_processor, train_stock_processor);
     }
 
@@ -726,18 +762,11 @@ static int logistics_getGlobalCounts(lua_State *L) {
 
     size_t num_melt = df::global::world->items.other.ANY_MELT_DESIGNATED.size();
 
-    size_t num_trade = 0;
-    for (auto link = world->jobs.list.next; link; link = link->next) {
-        df::job *job = link->item;
-        if (job->job_type == df::job_type::BringItemToDepot)
-            ++num_trade;
-    }
+    size_t num_trade = Job::countJobs(df::job_type::BringItemToDepot);
 
     size_t num_dump = 0;
-    for (auto item : world->items.other.IN_PLAY) {
-        if (item->flags.bits.dump)
-            ++num_dump;
-    }
+    if (ItemSweep::refresh(dump_sweep_id))
+        num_dump = dump_counter.count;
 
     size_t num_train = 0;
     // TODO
@@ -12,6 +12,12 @@ local GLOBAL_KEY = 'OVERLAY'
 
 local DEFAULT_X_POS, DEFAULT_Y_POS = -2, -2
 
+-- conditions that cause overlay_onupdate to be called before the next
+-- scheduled update. must match update_trigger in overlay.cpp
+local UPDATE_TRIGGERS = {viewscreen=1, tick=2, mouse=4}
+local TRIGGER_FOCUS = 8
+local TRIGGER_ALL = 15
+
 -- ---------------- --
 -- state and config --
 -- ---------------- --
@@ -64,6 +70,8 @@ local function reset()
 
     active_hotspot_widgets = {}
     active_viewscreen_widgets = {}
+
+    overlay_invalidateSchedules()
 end
 
 local function save_config()
@@ -180,6 +188,7 @@ local function do_enable(args, quiet, skip_save)
     if not skip_save then
         save_config()
     end
+    overlay_invalidateSchedules()
 end
 
 local function do_disable(args, quiet)
@@ -209,6 +218,7 @@ local function do_disable(args, quiet)
         do_by_names_or_numbers(args, disable_fn)
     end
     save_config()
+    overlay_invalidateSchedules()
 end
 
 local function do_list(args)
@@ -253,12 +263,26 @@ local function get_focus_strings(viewscreens)
     return focus_strings
 end
 
+local function get_trigger_mask(triggers)
+    local mask = 0
+    for _,trigger in ipairs(normalize_list(triggers)) do
+        local bit = UPDATE_TRIGGERS[trigger]
+        if not bit then
+            error(('unknown overlay_onupdate_triggers value: "%s"'):format(trigger))
+        end
+        mask = mask | bit
+    end
+    return mask
+end
+
 local function load_widget(name, widget_class)
     local widget = widget_class{name=name}
     widget_db[name] = {
         widget=widget,
         focus_strings=get_focus_strings(normalize_list(widget.viewscreens)),
         next_update_ms=widget.overlay_onupdate and 0 or math.huge,
+        trigger_mask=get_trigger_mask(widget.overlay_onupdate_triggers),
+        stats={},
     }
     if not overlay_config[name] then overlay_config[name] = {} end
     if widget.version ~= overlay_config[name].version then
@@ -410,6 +434,23 @@ end
 -- event management --
 -- ---------------- --
 
+-- per-widget timings are only collected while the core profiler is enabled;
+-- refreshed at the start of each call from the C++ side
+local profiling = false
+
+local function timed_call(db_entry, kind, fn)
+    if not profiling then return fn() end
+    local stats = db_entry.stats[kind]
+    if not stats then
+        stats = overlay_getWidgetStats(db_entry.widget.name, kind)
+        db_entry.stats[kind] = stats
+    end
+    local start = overlay_timerStart()
+    local ret = fn()
+    overlay_timerStop(stats, start)
+    return ret
+end
+
 local function detect_frame_change(widget, fn)
     local frame = widget.frame
     local w, h = frame.w, frame.h
@@ -430,29 +471,63 @@ local function get_next_onupdate_timestamp(now_ms, widget)
     return now_ms + freq_ms - jitter
 end
 
+-- returns whether the widget should be updated now. fired is the mask of
+-- the triggers that fired since the last call
+local function is_update_due(db_entry, now_ms, fired)
+    local w = db_entry.widget
+    if not w.overlay_onupdate then return false end
+    local triggered = (fired & db_entry.trigger_mask) ~= 0
+    if w.overlay_onupdate_max_freq_seconds == 0 then
+        return db_entry.trigger_mask == 0 or triggered
+    end
+    return triggered or db_entry.next_update_ms <= now_ms
+end
+
 -- reduces the next call by a small random amount to introduce jitter into the
 -- widget processing timings
-local function do_update(name, db_entry, now_ms, vs)
-    local w = db_entry.widget
-    if w.overlay_onupdate_max_freq_seconds ~= 0 and
-        db_entry.next_update_ms > now_ms
-    then
+local function do_update(name, db_entry, now_ms, vs, fired)
+    if not is_update_due(db_entry, now_ms, fired) then
         return
     end
+    local w = db_entry.widget
     db_entry.next_update_ms = get_next_onupdate_timestamp(now_ms, w)
-    if detect_frame_change(w, function() return w:overlay_onupdate(vs) end) then
+    if timed_call(db_entry, 'update', function()
+        return detect_frame_change(w, function() return w:overlay_onupdate(vs) end)
+    end) then
         if register_trigger_lock_screen(w:overlay_trigger(), name) then
             return true
         end
     end
 end
 
-function update_hotspot_widgets()
-    if triggered_screen_has_lock() then return end
+-- folds the widget's next update time and triggers into sched, which is
+-- returned to the C++ side so it can skip calls while no widget is due
+local function add_to_schedule(sched, db_entry)
+    local w = db_entry.widget
+    if not w.overlay_onupdate then return end
+    sched.mask = sched.mask | db_entry.trigger_mask
+    if w.overlay_onupdate_max_freq_seconds == 0 then
+        if db_entry.trigger_mask == 0 then
+            sched.next_ms = 0
+        end
+    else
+        sched.next_ms = math.min(sched.next_ms, db_entry.next_update_ms)
+    end
+end
+
+-- returns the time in ms when the next widget is due and the mask of
+-- triggers that should cause an earlier call
+function update_hotspot_widgets(fired)
+    profiling = overlay_isProfiling()
+    if triggered_screen_has_lock() then return 0, 0 end
+    fired = fired or TRIGGER_ALL
     local now_ms = dfhack.getTickCount()
+    local sched = {next_ms=math.huge, mask=0}
     for name,db_entry in pairs(active_hotspot_widgets) do
-        if do_update(name, db_entry, now_ms) then return end
+        if do_update(name, db_entry, now_ms, nil, fired) then return 0, 0 end
+        add_to_schedule(sched, db_entry)
     end
+    return sched.next_ms, sched.mask
 end
 
 local function matches_focus_strings(db_entry, vs_name, vs)
@@ -470,26 +545,40 @@ local function matches_focus_strings(db_entry, vs_name, vs)
     return matched
 end
 
-local function _update_viewscreen_widgets(vs_name, vs, now_ms)
+-- returns now_ms if processing should continue, or nil, true if a widget
+-- was triggered
+local function _update_viewscreen_widgets(vs_name, vs, now_ms, fired, sched)
     local vs_widgets = active_viewscreen_widgets[vs_name]
     if not vs_widgets then return end
     local is_all = vs_name == 'all'
     now_ms = now_ms or dfhack.getTickCount()
     for name,db_entry in pairs(vs_widgets) do
-        if (is_all or matches_focus_strings(db_entry, vs_name, vs)) and
-                do_update(name, db_entry, now_ms, vs) then
-            return
+        if is_all or matches_focus_strings(db_entry, vs_name, vs) then
+            if do_update(name, db_entry, now_ms, vs, fired) then
+                return nil, true
+            end
+            add_to_schedule(sched, db_entry)
+        else
+            -- check again when the focus changes
+            sched.mask = sched.mask | TRIGGER_FOCUS
         end
     end
     return now_ms
 end
 
-function update_viewscreen_widgets(vs_name, vs)
-    if triggered_screen_has_lock() then return end
-    local now_ms = _update_viewscreen_widgets(vs_name, vs, nil)
+-- returns the time in ms when the next widget is due and the mask of
+-- triggers that should cause an earlier call
+function update_viewscreen_widgets(vs_name, vs, fired)
+    profiling = overlay_isProfiling()
+    if triggered_screen_has_lock() then return 0, 0 end
+    fired = fired or TRIGGER_ALL
+    local sched = {next_ms=math.huge, mask=0}
+    local now_ms, triggered = _update_viewscreen_widgets(vs_name, vs, nil, fired, sched)
     if now_ms then
-        _update_viewscreen_widgets('all', vs, now_ms)
+        triggered = select(2, _update_viewscreen_widgets('all', vs, now_ms, fired, sched))
     end
+    if triggered then return 0, 0 end
+    return sched.next_ms, sched.mask
 end
 
 local function _feed_viewscreen_widgets(vs_name, vs, keys)
@@ -498,7 +587,9 @@ local function _feed_viewscreen_widgets(vs_name, vs, keys)
     for _,db_entry in pairs(vs_widgets) do
         local w = db_entry.widget
         if (not vs or matches_focus_strings(db_entry, vs_name, vs)) and
-                detect_frame_change(w, function() return w:onInput(keys) end) then
+                timed_call(db_entry, 'input', function()
+                    return detect_frame_change(w, function() return w:onInput(keys) end)
+                end) then
             return true
         end
     end
@@ -506,6 +597,7 @@ local function _feed_viewscreen_widgets(vs_name, vs, keys)
 end
 
 function feed_viewscreen_widgets(vs_name, vs, keys)
+    profiling = overlay_isProfiling()
     if not _feed_viewscreen_widgets(vs_name, vs, keys) and
             not _feed_viewscreen_widgets('all', nil, keys) then
         return false
@@ -520,7 +612,14 @@ local function _render_viewscreen_widgets(vs_name, vs, dc)
     for _,db_entry in pairs(vs_widgets) do
         local w = db_entry.widget
         if not vs or matches_focus_strings(db_entry, vs_name, vs) then
-            detect_frame_change(w, function() w:render(dc) end)
+            local freq = w.overlay_onupdate_max_freq_seconds
+            timed_call(db_entry, 'render', function()
+                detect_frame_change(w, function() w:render(dc) end)
+            end)
+            -- changes to the update frequency take effect immediately
+            if w.overlay_onupdate_max_freq_seconds ~= freq then
+                overlay_invalidateSchedules()
+            end
         end
     end
     return dc
@@ -529,6 +628,7 @@ end
 local force_refresh
 
 function render_viewscreen_widgets(vs_name, vs)
+    profiling = overlay_isProfiling()
     local dc = _render_viewscreen_widgets(vs_name, vs, nil)
     _render_viewscreen_widgets('all', nil, dc)
     if force_refresh then
@@ -559,6 +659,7 @@ OverlayWidget.ATTRS{
     hotspot=false, -- whether to call overlay_onupdate on all screens
     viewscreens={}, -- override with associated viewscreen or list of viewscrens
     overlay_onupdate_max_freq_seconds=5, -- throttle calls to overlay_onupdate
+    overlay_onupdate_triggers={}, -- 'viewscreen', 'tick' and/or 'mouse'
 }
 
 function OverlayWidget:init()
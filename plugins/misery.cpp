@@ -60,8 +60,7 @@ static void set_config_bool(PersistentDataItem &c, int index, bool value) {
     set_config_val(c, index, value ? 1 : 0);
 }
 
-static const int32_t CYCLE_TICKS = 1200; // one day
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 300); // one day
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream &out);
@@ -106,7 +105,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -134,9 +132,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        do_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    do_cycle(out);
     return CR_OK;
 }
 
@@ -222,9 +219,6 @@ static void affect_units(
 }
 
 static void do_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
     int strength = STRENGTH_MULTIPLIER * get_config_val(config, CONFIG_FACTOR);
@@ -51,8 +51,7 @@ static void set_config_bool(PersistentDataItem &c, int index, bool value) {
     set_config_val(c, index, value ? 1 : 0);
 }
 
-static const int32_t CYCLE_TICKS = 50; // need to react quickly when eggs are laid/unforbidden
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 50, 100); // need to react quickly when eggs are laid/unforbidden
 
 static void do_cycle(color_ostream &out);
 
@@ -90,7 +89,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -117,9 +115,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS)
-        do_cycle(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    do_cycle(out);
     return CR_OK;
 }
 
@@ -130,9 +127,6 @@ DFhackCExport command_result plugin_onupdate(color_ostream &out) {
 static void do_cycle(color_ostream &out) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     for (df::building_nest_boxst *nb : world->buildings.other.NEST_BOX) {
         bool fertile = false;
         if (nb->claimed_by != -1) {
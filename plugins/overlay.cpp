@@ -20,6 +20,7 @@
 #include "Debug.h"
 #include "LuaTools.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "VTableInterpose.h"
 
 #include "modules/Gui.h"
@@ -40,6 +41,80 @@ namespace DFHack {
 
 static df::coord2d screenSize;
 
+// Lua functions in plugins.overlay that we call every frame. The registry
+// references are resolved on first use and dropped when the plugin is
+// enabled or disabled, so we don't look up the module by name on every call.
+struct overlay_fn {
+    const char *name;
+    int ref = LUA_NOREF;
+
+    explicit overlay_fn(const char *name) : name(name) {}
+};
+
+static overlay_fn update_viewscreen_widgets_fn("update_viewscreen_widgets");
+static overlay_fn feed_viewscreen_widgets_fn("feed_viewscreen_widgets");
+static overlay_fn render_viewscreen_widgets_fn("render_viewscreen_widgets");
+static overlay_fn update_hotspot_widgets_fn("update_hotspot_widgets");
+static overlay_fn reposition_widgets_fn("reposition_widgets");
+
+static overlay_fn *cached_fns[] = {
+    &update_viewscreen_widgets_fn,
+    &feed_viewscreen_widgets_fn,
+    &render_viewscreen_widgets_fn,
+    &update_hotspot_widgets_fn,
+    &reposition_widgets_fn,
+};
+
+static void clear_fn_cache(lua_State *L) {
+    if (!L)
+        return;
+    for (auto fn : cached_fns) {
+        luaL_unref(L, LUA_REGISTRYINDEX, fn->ref);
+        fn->ref = LUA_NOREF;
+    }
+}
+
+static bool push_overlay_fn(color_ostream &out, lua_State *L, overlay_fn &fn) {
+    if (fn.ref != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, fn.ref);
+        return true;
+    }
+    if (!Lua::PushModulePublic(out, L, "plugins.overlay", fn.name))
+        return false;
+    lua_pushvalue(L, -1);
+    fn.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return true;
+}
+
+static void call_overlay_lua(color_ostream *out, overlay_fn &fn,
+        int nargs = 0, int nres = 0,
+        Lua::LuaLambda && args_lambda = Lua::DEFAULT_LUA_LAMBDA,
+        Lua::LuaLambda && res_lambda = Lua::DEFAULT_LUA_LAMBDA) {
+    DEBUG(event).print("calling overlay lua function: '%s'\n", fn.name);
+
+    CoreSuspender guard;
+
+    auto L = Lua::Core::State;
+    Lua::StackUnwinder top(L);
+
+    if (!out)
+        out = &Core::getInstance().getConsole();
+
+    if (!lua_checkstack(L, 1 + nargs) || !push_overlay_fn(*out, L, fn)) {
+        out->printerr("Failed to load plugins.overlay Lua code\n");
+        return;
+    }
+
+    std::forward<Lua::LuaLambda&&>(args_lambda)(L);
+
+    if (!Lua::SafeCall(*out, L, nargs, nres)) {
+        out->printerr("Failed Lua call to 'plugins.overlay.%s'\n", fn.name);
+        return;
+    }
+
+    std::forward<Lua::LuaLambda&&>(res_lambda)(L);
+}
+
 static void call_overlay_lua(color_ostream *out, const char *fn_name,
         int nargs = 0, int nres = 0,
         Lua::LuaLambda && args_lambda = Lua::DEFAULT_LUA_LAMBDA,
@@ -59,23 +134,107 @@ static void call_overlay_lua(color_ostream *out, const char *fn_name,
                                std::forward<Lua::LuaLambda&&>(res_lambda));
 }
 
+/*
+ * Update scheduling.
+ *
+ * The update_*_widgets Lua functions return the time at which the next
+ * widget is due for an update and a mask of conditions that should cause an
+ * earlier update (see overlay_onupdate_triggers in overlay.lua). Until then,
+ * the Lua side is not called at all. Any input or change to the widget
+ * configuration invalidates all schedules.
+ */
+enum update_trigger : uint32_t {
+    TRIGGER_VIEWSCREEN = 1,
+    TRIGGER_TICK = 2,
+    TRIGGER_MOUSE = 4,
+    TRIGGER_FOCUS = 8,
+    TRIGGER_ALL = 0xF,
+};
+
+static uint32_t schedule_generation = 1;
+
+struct update_schedule {
+    double next_ms = 0;
+    uint32_t triggers = 0;
+    uint32_t generation = 0;
+
+    df::viewscreen *vs = NULL;
+    int32_t tick = -1;
+    df::coord2d mouse;
+    std::vector<std::string> focus;
+
+    // returns whether the widgets need to be updated and which triggers fired
+    bool check(df::viewscreen *cur_vs, uint32_t *fired) {
+        *fired = 0;
+
+        if (cur_vs != vs) {
+            *fired |= TRIGGER_VIEWSCREEN;
+            vs = cur_vs;
+        }
+        if (world->frame_counter != tick) {
+            *fired |= TRIGGER_TICK;
+            tick = world->frame_counter;
+        }
+        df::coord2d cur_mouse = Screen::getMousePos();
+        if (cur_mouse != mouse) {
+            *fired |= TRIGGER_MOUSE;
+            mouse = cur_mouse;
+        }
+        if (triggers & TRIGGER_FOCUS) {
+            auto cur_focus = Gui::getFocusStrings(cur_vs);
+            if (cur_focus != focus) {
+                *fired |= TRIGGER_FOCUS;
+                focus = std::move(cur_focus);
+            }
+        } else {
+            focus.clear();
+        }
+
+        if (generation != schedule_generation) {
+            *fired = TRIGGER_ALL;
+            return true;
+        }
+        return (*fired & triggers) ||
+            Core::getInstance().p->getTickCount() >= next_ms;
+    }
+
+    void update(lua_State *L) {
+        next_ms = lua_isnil(L, -2) ? 0 : lua_tonumber(L, -2);
+        triggers = lua_tointeger(L, -1);
+        generation = schedule_generation;
+    }
+};
+
+static void invalidate_schedules() {
+    schedule_generation++;
+}
+
 template<class T>
 struct viewscreen_overlay : T {
     typedef T interpose_base;
 
     DEFINE_VMETHOD_INTERPOSE(void, logic, ()) {
         INTERPOSE_NEXT(logic)();
-        call_overlay_lua(NULL, "update_viewscreen_widgets", 2, 0,
+        static update_schedule schedule;
+        uint32_t fired;
+        if (!schedule.check(this, &fired))
+            return;
+        call_overlay_lua(NULL, update_viewscreen_widgets_fn, 3, 2,
                 [&](lua_State *L) {
                     Lua::Push(L, T::_identity.getName());
                     Lua::Push(L, this);
+                    lua_pushinteger(L, fired);
+                }, [&](lua_State *L) {
+                    schedule.update(L);
                 });
     }
     DEFINE_VMETHOD_INTERPOSE(void, feed, (std::set<df::interface_key> *input)) {
         bool input_is_handled = false;
+        // widgets may change state in response to input
+        invalidate_schedules();
         // don't send input to the overlays if there is a modal dialog up
         if (!world->status.popups.size())
-            call_overlay_lua(NULL, "feed_viewscreen_widgets", 3, 1,
+            call_overlay_lua(NULL, feed_viewscreen_widgets_fn, 3, 1,
                     [&](lua_State *L) {
                         Lua::Push(L, T::_identity.getName());
                         Lua::Push(L, this);
@@ -90,7 +249,7 @@ struct viewscreen_overlay : T {
     }
     DEFINE_VMETHOD_INTERPOSE(void, render, ()) {
         INTERPOSE_NEXT(render)();
-        call_overlay_lua(NULL, "render_viewscreen_widgets", 2, 0,
+        call_overlay_lua(NULL, render_viewscreen_widgets_fn, 2, 0,
                 [&](lua_State *L) {
                     Lua::Push(L, T::_identity.getName());
                     Lua::Push(L, this);
@@ -132,6 +291,9 @@ DFhackCExport command_result plugin_enable(color_ostream &out, bool enable) {
     if (is_enabled == enable)
         return CR_OK;
 
+    clear_fn_cache(Lua::Core::State);
+    invalidate_schedules();
+
     if (enable) {
         screenSize = Screen::getWindowSize();
         call_overlay_lua(&out, "rescan");
@@ -170,6 +332,7 @@ static command_result overlay_cmd(color_ostream &out, std::vector <std::string>
         }, [&](lua_State *L) {
             show_help = !lua_toboolean(L, -1);
         });
+    invalidate_schedules();
 
     return show_help ? CR_WRONG_USAGE : CR_OK;
 }
@@ -192,9 +355,65 @@ DFhackCExport command_result plugin_shutdown(color_ostream &out) {
 DFhackCExport command_result plugin_onupdate (color_ostream &out) {
     df::coord2d newScreenSize = Screen::getWindowSize();
     if (newScreenSize != screenSize) {
-        call_overlay_lua(&out, "reposition_widgets");
+        call_overlay_lua(&out, reposition_widgets_fn);
         screenSize = newScreenSize;
+        invalidate_schedules();
     }
-    call_overlay_lua(&out, "update_hotspot_widgets");
+
+    static update_schedule schedule;
+    uint32_t fired;
+    if (schedule.check(Gui::getCurViewscreen(true), &fired))
+        call_overlay_lua(&out, update_hotspot_widgets_fn, 1, 2,
+                [&](lua_State *L) {
+                    lua_pushinteger(L, fired);
+                }, [&](lua_State *L) {
+                    schedule.update(L);
+                });
     return CR_OK;
 }
+
+// called from Lua when the set of active widgets or their settings change
+static int overlay_invalidateSchedules(lua_State *L) {
+    invalidate_schedules();
+    return 0;
+}
+
+/*
+ * Per-widget timings. These are recorded in the core profiler as
+ * overlay/<widget>/<update|render|input> while profiling is enabled, so
+ * `profile report overlay/` lists them.
+ */
+
+static int overlay_isProfiling(lua_State *L) {
+    lua_pushboolean(L, Profiler::isEnabled());
+    return 1;
+}
+
+static int overlay_getWidgetStats(lua_State *L) {
+    std::string name = luaL_checkstring(L, 1);
+    std::string kind = luaL_checkstring(L, 2);
+    lua_pushlightuserdata(L, Profiler::getStats("overlay/" + name + "/" + kind));
+    return 1;
+}
+
+static int overlay_timerStart(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)Profiler::ticks());
+    return 1;
+}
+
+static int overlay_timerStop(lua_State *L) {
+    auto stats = (Profiler::Stats *)lua_touserdata(L, 1);
+    uint64_t start = (uint64_t)luaL_checkinteger(L, 2);
+    if (stats && Profiler::isEnabled())
+        stats->add(Profiler::ticks() - start);
+    return 0;
+}
+
+DFHACK_PLUGIN_LUA_COMMANDS {
+    DFHACK_LUA_COMMAND(overlay_invalidateSchedules),
+    DFHACK_LUA_COMMAND(overlay_isProfiling),
+    DFHACK_LUA_COMMAND(overlay_getWidgetStats),
+    DFHACK_LUA_COMMAND(overlay_timerStart),
+    DFHACK_LUA_COMMAND(overlay_timerStop),
+    DFHACK_LUA_END
+};
@@ -35,8 +35,7 @@ REQUIRE_GLOBAL(world);
 static const std::string CONFIG_KEY = std::string(plugin_name) + "/config";
 static PersistentDataItem config;
 
-static int32_t cycle_timestamp;
-static constexpr int32_t cycle_freq = 100;
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 100, 200);
 
 enum ConfigValues {
     CONFIG_IS_ENABLED = 0,
@@ -150,7 +149,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -179,9 +177,8 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= cycle_freq)
-        update_tomb_assignments(out);
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    update_tomb_assignments(out);
     return CR_OK;
 }
 // </BOILERPLATE>
@@ -217,7 +214,6 @@ void onUnitDeath(color_ostream& out, void* ptr) {
 //
 //
 static void update_tomb_assignments(color_ostream &out) {
-    cycle_timestamp = world->frame_counter;
     // check tomb civzones for assigned units
     for (auto* bld : world->buildings.other.ZONE_TOMB) {
 
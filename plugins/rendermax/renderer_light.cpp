@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <math.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -21,6 +22,7 @@
 #include "df/flow_info.h"
 #include "df/graphic.h"
 #include "df/item.h"
+#include "df/map_block.h"
 #include "df/items_other_id.h"
 #include "df/plant.h"
 #include "df/plant_raw.h"
@@ -35,6 +37,7 @@ using df::coord2d;
 using namespace tthread;
 
 const float RootTwo = 1.4142135623730950488016887242097f;
+const size_t maxCachedBlocks = 1024;
 
 
 bool isInRect(const coord2d& pos,const rect2d& rect)
@@ -104,8 +107,9 @@ rect2d getMapViewport()
     }
     return mkrect_wh(1,1,view_rb,view_height+1);
 }
-lightingEngineViewscreen::lightingEngineViewscreen(renderer_light* target):lightingEngine(target),threading(this),doDebug(false)
+lightingEngineViewscreen::lightingEngineViewscreen(renderer_light* target):lightingEngine(target),defsGeneration(0),threading(this),doDebug(false)
 {
+    clearCaches();
     reinit();
     defaultSettings();
     int numTreads=tthread::thread::hardware_concurrency();
@@ -609,6 +613,132 @@ rgbf lightingEngineViewscreen::getSkyColor(float v)
         return dayColors[pre]*(1-pos)+dayColors[pre+1]*pos;
     }
 }
+bool lightingEngineViewscreen::isBlockCacheValid(const blockLightCache& bc,df::map_block* block,df::map_block* below)
+{
+    if(bc.block!=block || bc.defsGeneration!=defsGeneration || bc.hasBelow!=(below!=NULL))
+        return false;
+    if(memcmp(bc.tiletype,block->tiletype,sizeof(bc.tiletype))!=0)
+        return false;
+    if(memcmp(bc.designation,block->designation,sizeof(bc.designation))!=0)
+        return false;
+    if(below && memcmp(bc.designationBelow,below->designation,sizeof(bc.designationBelow))!=0)
+        return false;
+    return true;
+}
+void lightingEngineViewscreen::applyMaterial(blockLightCache& bc,int x,int y,const matLightDef& mat,float size, float thickness)
+{
+    rgbf& cell=bc.occlusion[x][y];
+    if(mat.isTransparent)
+    {
+        if(thickness > 0.999 && thickness < 1.001)
+            cell*=mat.transparency;
+        else
+            cell*=mat.transparency.pow(thickness);
+    }
+    else
+        cell=rgbf(0,0,0);
+    if(mat.isEmiting)
+        bc.lights.push_back(std::make_pair(df::coord2d(x,y),mat.makeSource(size)));
+}
+void lightingEngineViewscreen::rebuildBlockCache(blockLightCache& bc,df::map_block* block,df::map_block* below,MapExtras::MapCache& map)
+{
+    bc.block=block;
+    bc.defsGeneration=defsGeneration;
+    bc.hasBelow=(below!=NULL);
+    memcpy(bc.tiletype,block->tiletype,sizeof(bc.tiletype));
+    memcpy(bc.designation,block->designation,sizeof(bc.designation));
+    if(below)
+        memcpy(bc.designationBelow,below->designation,sizeof(bc.designationBelow));
+    bc.lights.clear();
+
+    MapExtras::Block* b=map.BlockAt(DFCoord(block->map_pos.x/16,block->map_pos.y/16,block->map_pos.z));
+    for(int block_x = 0; block_x < 16; block_x++)
+    for(int block_y = 0; block_y < 16; block_y++)
+    {
+        rgbf& curCell=bc.occlusion[block_x][block_y];
+        curCell=matAmbience.transparency;
+
+        df::tiletype type = bc.tiletype[block_x][block_y];
+        df::tile_designation d = bc.designation[block_x][block_y];
+        if(d.bits.hidden )
+        {
+            curCell=rgbf(0,0,0);
+            continue; // do not process hidden stuff, TODO other hidden stuff
+        }
+        df::tiletype_shape shape = ENUM_ATTR(tiletype,shape,type);
+        bool is_wall=!ENUM_ATTR(tiletype_shape,passable_high,shape);
+        bool is_floor=!ENUM_ATTR(tiletype_shape,passable_low,shape);
+        df::tiletype_material tileMat= ENUM_ATTR(tiletype,material,type);
+
+        matLightDef* lightDef=NULL;
+        if(b)
+        {
+            DFHack::t_matpair mat=b->staticMaterialAt(df::coord2d(block_x,block_y));
+            lightDef=getMaterialDef(mat.mat_type,mat.mat_index);
+        }
+        if(!lightDef || !lightDef->isTransparent)
+            lightDef=&matWall;
+        if(shape==df::tiletype_shape::BROOK_BED )
+        {
+            curCell=rgbf(0,0,0);
+        }
+        else if(is_wall)
+        {
+            if(tileMat==df::tiletype_material::FROZEN_LIQUID)
+                applyMaterial(bc,block_x,block_y,matIce);
+            else
+                applyMaterial(bc,block_x,block_y,*lightDef);
+        }
+        else if(!d.bits.liquid_type && d.bits.flow_size>0 )
+        {
+            applyMaterial(bc,block_x,block_y,matWater, (float)d.bits.flow_size/7.0f, (float)d.bits.flow_size/7.0f);
+        }
+        if(d.bits.liquid_type && d.bits.flow_size>0)
+        {
+            applyMaterial(bc,block_x,block_y,matLava,(float)d.bits.flow_size/7.0f,(float)d.bits.flow_size/7.0f);
+        }
+        else if(!is_floor)
+        {
+            if(below)
+            {
+               df::tile_designation d2=bc.designationBelow[block_x][block_y];
+               if(d2.bits.liquid_type && d2.bits.flow_size>0)
+               {
+                   applyMaterial(bc,block_x,block_y,matLava);
+               }
+            }
+        }
+    }
+}
+void lightingEngineViewscreen::updateBuildingCache(int window_z)
+{
+    int32_t nextId=df::global::building_next_id ? *df::global::building_next_id : -1;
+    size_t count=df::global::world->buildings.all.size();
+    if(nextId!=-1 && buildingCacheZ==window_z && buildingCacheNextId==nextId && buildingCacheCount==count)
+        return;
+    buildingCacheZ=window_z;
+    buildingCacheNextId=nextId;
+    buildingCacheCount=count;
+    buildingCache.clear();
+    for(size_t i = 0; i < count; i++)
+    {
+        df::building *bld = df::global::world->buildings.all[i];
+        if(window_z!=bld->z)
+            continue;
+        buildingLightDef* def=getBuildingDef(bld);
+        if(def)
+            buildingCache.push_back(std::make_pair(bld,def));
+    }
+}
+void lightingEngineViewscreen::clearCaches()
+{
+    defsGeneration++;
+    blockCache.clear();
+    buildingCache.clear();
+    buildingCacheZ=-1;
+    buildingCacheNextId=-1;
+    buildingCacheCount=0;
+}
 void lightingEngineViewscreen::doOcupancyAndLights()
 {
     float daycol;
@@ -638,13 +768,20 @@ void lightingEngineViewscreen::doOcupancyAndLights()
     blockVp.second.x=std::min(blockVp.second.x,(int16_t)df::global::world->map.x_count_block);
     blockVp.second.y=std::min(blockVp.second.y,(int16_t)df::global::world->map.y_count_block);
 
+    if(blockCache.size()>maxCachedBlocks)
+        blockCache.clear();
+
     for(int blockX=blockVp.first.x;blockX<=blockVp.second.x;blockX++)
     for(int blockY=blockVp.first.y;blockY<=blockVp.second.y;blockY++)
     {
-        MapExtras::Block* b=cache.BlockAt(DFCoord(blockX,blockY,window_z));
-        MapExtras::Block* bDown=cache.BlockAt(DFCoord(blockX,blockY,window_z-1));
-        if(!b)
+        df::map_block* block=Maps::getBlock(blockX,blockY,window_z);
+        if(!block)
             continue; //empty blocks fixed by sun propagation
+        df::map_block* blockDown=Maps::getBlock(blockX,blockY,window_z-1);
+
+        blockLightCache& bc=blockCache[std::make_tuple(blockX,blockY,window_z)];
+        if(!isBlockCacheValid(bc,block,blockDown))
+            rebuildBlockCache(bc,block,blockDown,cache);
 
         for(int block_x = 0; block_x < 16; block_x++)
         for(int block_y = 0; block_y < 16; block_y++)
@@ -652,71 +789,20 @@ void lightingEngineViewscreen::doOcupancyAndLights()
             df::coord2d pos;
             pos.x = blockX*16+block_x;
             pos.y = blockY*16+block_y;
-            df::coord2d gpos=pos;
             pos=worldToViewportCoord(pos,vp,window2d);
-            if(!isInRect(pos,vp))
-                continue;
-            int tile=getIndex(pos.x,pos.y);
-            rgbf& curCell=ocupancy[tile];
-            curCell=matAmbience.transparency;
-
-
-            df::tiletype type = b->tiletypeAt(gpos);
-            df::tile_designation d = b->DesignationAt(gpos);
-            if(d.bits.hidden )
-            {
-                curCell=rgbf(0,0,0);
-                continue; // do not process hidden stuff, TODO other hidden stuff
-            }
-            //df::tile_occupancy o = b->OccupancyAt(gpos);
-            df::tiletype_shape shape = ENUM_ATTR(tiletype,shape,type);
-            bool is_wall=!ENUM_ATTR(tiletype_shape,passable_high,shape);
-            bool is_floor=!ENUM_ATTR(tiletype_shape,passable_low,shape);
-            // df::tiletype_shape_basic basic_shape = ENUM_ATTR(tiletype_shape, basic_shape, shape);
-            df::tiletype_material tileMat= ENUM_ATTR(tiletype,material,type);
-
-            DFHack::t_matpair mat=b->staticMaterialAt(gpos);
-
-            matLightDef* lightDef=getMaterialDef(mat.mat_type,mat.mat_index);
-            if(!lightDef || !lightDef->isTransparent)
-                lightDef=&matWall;
-            if(shape==df::tiletype_shape::BROOK_BED )
-            {
-                curCell=rgbf(0,0,0);
-            }
-            else if(is_wall)
-            {
-                if(tileMat==df::tiletype_material::FROZEN_LIQUID)
-                    applyMaterial(tile,matIce);
-                else
-                    applyMaterial(tile,*lightDef);
-            }
-            else if(!d.bits.liquid_type && d.bits.flow_size>0 )
-            {
-                applyMaterial(tile,matWater, (float)d.bits.flow_size/7.0f, (float)d.bits.flow_size/7.0f);
-            }
-            if(d.bits.liquid_type && d.bits.flow_size>0)
-            {
-                applyMaterial(tile,matLava,(float)d.bits.flow_size/7.0f,(float)d.bits.flow_size/7.0f);
-            }
-            else if(!is_floor)
-            {
-                if(bDown)
-                {
-                   df::tile_designation d2=bDown->DesignationAt(gpos);
-                   if(d2.bits.liquid_type && d2.bits.flow_size>0)
-                   {
-                       applyMaterial(tile,matLava);
-                   }
-                }
-            }
-
-
+            if(isInRect(pos,vp))
+                ocupancy[getIndex(pos.x,pos.y)]=bc.occlusion[block_x][block_y];
+        }
+        for(size_t i=0;i<bc.lights.size();i++)
+        {
+            df::coord2d pos;
+            pos.x = blockX*16+bc.lights[i].first.x;
+            pos.y = blockY*16+bc.lights[i].first.y;
+            pos=worldToViewportCoord(pos,vp,window2d);
+            if(isInRect(pos,vp))
+                addLight(getIndex(pos.x,pos.y),bc.lights[i].second);
         }
 
-        df::map_block* block=b->getRaw();
-        if(!block)
-            continue;
         //flows
         for(size_t i=0;i<block->flows.size();i++)
         {
@@ -828,12 +914,12 @@ void lightingEngineViewscreen::doOcupancyAndLights()
     }
 
     //buildings
-    for(size_t i = 0; i < df::global::world->buildings.all.size(); i++)
+    updateBuildingCache(window_z);
+    for(size_t i = 0; i < buildingCache.size(); i++)
     {
-        df::building *bld = df::global::world->buildings.all[i];
+        df::building *bld = buildingCache[i].first;
+        buildingLightDef* def = buildingCache[i].second;
 
-        if(window_z!=bld->z)
-            continue;
         if(bld->getBuildStage()<bld->getMaxBuildStage()) //only work if fully built
             continue;
 
@@ -850,9 +936,6 @@ void lightingEngineViewscreen::doOcupancyAndLights()
             else
                 tile=getIndex(p2.x,p2.y);
             df::building_type type = bld->getType();
-            buildingLightDef* def=getBuildingDef(bld);
-            if(!def)
-                continue;
             if(type==df::enums::building_type::Door)
             {
                 df::building_doorst* door=static_cast<df::building_doorst*>(bld);
@@ -1168,6 +1251,7 @@ void lightingEngineViewscreen::defaultSettings()
 }
 void lightingEngineViewscreen::loadSettings()
 {
+    clearCaches();
     std::string rawFolder;
     if(df::global::world->cur_savegame.save_dir!="")
     {
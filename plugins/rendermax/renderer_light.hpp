@@ -220,6 +220,20 @@ struct creatureLightDef
     matLightDef light;
 
 };
+//per map block occlusion and static lights, reused while the block stays unchanged
+struct blockLightCache
+{
+    df::map_block* block;
+    uint32_t defsGeneration;
+    bool hasBelow;
+    df::tiletype tiletype[16][16];
+    df::tile_designation designation[16][16];
+    df::tile_designation designationBelow[16][16];
+
+    rgbf occlusion[16][16];
+    std::vector<std::pair<df::coord2d,lightSource> > lights; //block local coordinates
+    blockLightCache():block(NULL),defsGeneration(0),hasBelow(false){}
+};
 class lightThread;
 class lightingEngineViewscreen;
 class lightThreadDispatch
@@ -302,6 +316,13 @@ private:
     bool addLight(int tileId,const lightSource& light);
     void addOclusion(int tileId,const rgbf& c,float thickness);
 
+    //block cache
+    bool isBlockCacheValid(const blockLightCache& bc,df::map_block* block,df::map_block* below);
+    void rebuildBlockCache(blockLightCache& bc,df::map_block* block,df::map_block* below,MapExtras::MapCache& map);
+    void applyMaterial(blockLightCache& bc,int x,int y,const matLightDef& mat,float size=1, float thickness = 1);
+    void updateBuildingCache(int window_z);
+    void clearCaches();
+
     matLightDef* getMaterialDef(int matType,int matIndex);
     buildingLightDef* getBuildingDef(df::building* bld);
     creatureLightDef* getCreatureDef(df::unit* u);
@@ -325,6 +346,14 @@ private:
     std::vector<rgbf> ocupancy;
     std::vector<lightSource> lights;
 
+    //caches
+    std::unordered_map<std::tuple<int,int,int>,blockLightCache> blockCache;
+    uint32_t defsGeneration; //bumped when light definitions are reloaded
+    std::vector<std::pair<df::building*,buildingLightDef*> > buildingCache;
+    int buildingCacheZ;
+    int32_t buildingCacheNextId;
+    size_t buildingCacheCount;
+
     //Threading stuff
     int num_diffuse; //under same lock as ocupancy
     lightThreadDispatch threading;
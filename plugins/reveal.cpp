@@ -1,6 +1,9 @@
 #include <stdint.h>
+#include <array>
+#include <cstdio>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <vector>
 
 #include "Core.h"
@@ -12,6 +15,7 @@
 #include "modules/World.h"
 #include "modules/MapCache.h"
 #include "modules/Gui.h"
+#include "modules/Persistence.h"
 #include "modules/Units.h"
 #include "modules/Screen.h"
 
@@ -54,15 +58,22 @@ bool isSafe(df::coord c)
     return true;
 }
 
+// bit y of row x is set if tile (x,y) of the block was hidden
+typedef std::array<uint16_t, 16> hidemask;
+
+// a block that had hidden tiles when the map was revealed. Blocks without
+// hidden tiles are not recorded, and blocks that were entirely hidden (most
+// of the underground) do not need a mask.
 struct hideblock
 {
     df::coord c;
-    uint8_t hiddens [16][16];
+    int32_t mask; // index into hidemasks, or -1 if all tiles were hidden
 };
 
 // the saved data. we keep map size to check if things still match
 uint32_t x_max, y_max, z_max;
 vector <hideblock> hidesaved;
+vector <hidemask> hidemasks;
 bool nopause_state = false;
 
 enum revealstate
@@ -75,6 +86,17 @@ enum revealstate
 
 revealstate revealed = NOT_REVEALED;
 
+static const string SNAPSHOT_KEY = "reveal";
+static const int SNAPSHOT_VERSION = 1;
+
+static void forget_snapshot()
+{
+    hidesaved.clear();
+    hidemasks.clear();
+    revealed = NOT_REVEALED;
+    is_active = nopause_state || (revealed == REVEALED);
+}
+
 command_result reveal(color_ostream &out, vector<string> & params);
 command_result unreveal(color_ostream &out, vector<string> & params);
 command_result revtoggle(color_ostream &out, vector<string> & params);
@@ -135,6 +157,111 @@ DFhackCExport command_result plugin_shutdown ( color_ostream &out )
     return CR_OK;
 }
 
+static void write_snapshot(std::ostream &file)
+{
+    file << SNAPSHOT_VERSION << " " << int(revealed) << " "
+         << x_max << " " << y_max << " " << z_max << " " << hidesaved.size() << "\n";
+    if (revealed == NOT_REVEALED)
+        return;
+
+    char hex[16 * 4 + 1];
+    for (auto &hb : hidesaved)
+    {
+        file << hb.c.x << " " << hb.c.y << " " << hb.c.z << " ";
+        if (hb.mask < 0)
+        {
+            file << "all\n";
+            continue;
+        }
+        auto &mask = hidemasks[hb.mask];
+        for (size_t x = 0; x < 16; x++)
+            snprintf(hex + x * 4, 5, "%04x", unsigned(mask[x]));
+        file << hex << "\n";
+    }
+}
+
+static void read_snapshot(color_ostream &out, std::istream &file)
+{
+    forget_snapshot();
+
+    int version = 0, state = NOT_REVEALED;
+    size_t count = 0;
+    if (!(file >> version >> state >> x_max >> y_max >> z_max >> count) ||
+            version != SNAPSHOT_VERSION || state <= NOT_REVEALED || state > DEMON_REVEALED)
+        return;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        hideblock hb;
+        string mask;
+        if (!(file >> hb.c.x >> hb.c.y >> hb.c.z >> mask))
+            break;
+        hb.mask = -1;
+        if (mask != "all")
+        {
+            if (mask.size() != 16 * 4)
+                break;
+            hidemask m;
+            for (size_t x = 0; x < 16; x++)
+                m[x] = uint16_t(strtoul(mask.substr(x * 4, 4).c_str(), NULL, 16));
+            hb.mask = int32_t(hidemasks.size());
+            hidemasks.push_back(m);
+        }
+        hidesaved.push_back(hb);
+    }
+    if (hidesaved.size() != count)
+    {
+        out.printerr("reveal: ignoring damaged reveal data.\n");
+        forget_snapshot();
+        return;
+    }
+
+    revealed = revealstate(state);
+    is_active = nopause_state || (revealed == REVEALED);
+}
+
+// the snapshot is kept with the save, so a map that was saved while revealed
+// can still be unrevealed after it is loaded again
+DFhackCExport command_result plugin_save_data (color_ostream &out)
+{
+    auto file = Persistence::writeSaveData(SNAPSHOT_KEY);
+    // rewritten even when there is no snapshot, so a stale one is not kept
+    if (file.good())
+        write_snapshot(file);
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_load_data (color_ostream &out)
+{
+    auto file = Persistence::readSaveData(SNAPSHOT_KEY);
+    read_snapshot(out, file);
+    return CR_OK;
+}
+
+// the save data is only written to disk when the game saves, so a reload
+// takes the snapshot (and the nopause setting) from the old instance instead
+DFhackCExport command_result plugin_export_state (color_ostream &out, int32_t &version, string &data)
+{
+    std::ostringstream ss;
+    ss << int(nopause_state) << "\n";
+    write_snapshot(ss);
+    version = SNAPSHOT_VERSION;
+    data = ss.str();
+    return CR_OK;
+}
+
+DFhackCExport command_result plugin_import_state (color_ostream &out, int32_t version, const string &data)
+{
+    if (version != SNAPSHOT_VERSION)
+        return CR_FAILURE;
+    std::istringstream ss(data);
+    int nopause = 0;
+    ss >> nopause;
+    nopause_state = nopause != 0;
+    read_snapshot(out, ss);
+    return CR_OK;
+}
+
 command_result nopause (color_ostream &out, vector <string> & parameters)
 {
     if (parameters.size() == 1 && (parameters[0] == "0" || parameters[0] == "1"))
@@ -225,23 +352,40 @@ command_result reveal(color_ostream &out, vector<string> & params)
     }
 
     Maps::getSize(x_max,y_max,z_max);
-    hidesaved.reserve(world->map.map_blocks.size());
     for (size_t i = 0; i < world->map.map_blocks.size(); i++)
     {
         df::map_block *block = world->map.map_blocks[i];
         // in 'no-hell'/'safe' mode, don't reveal blocks with hell and adamantine
         if (no_hell && !isSafe(block->map_pos))
             continue;
-        hideblock hb;
-        hb.c = block->map_pos;
         designations40d & designations = block->designation;
+        hidemask mask;
+        bool any_hidden = false, all_hidden = true;
         // for each tile in block
-        for (uint32_t x = 0; x < 16; x++) for (uint32_t y = 0; y < 16; y++)
+        for (uint32_t x = 0; x < 16; x++)
         {
-            // save hidden state of tile
-            hb.hiddens[x][y] = designations[x][y].bits.hidden;
-            // set to revealed
-            designations[x][y].bits.hidden = 0;
+            uint16_t row = 0;
+            for (uint32_t y = 0; y < 16; y++)
+            {
+                if (!designations[x][y].bits.hidden)
+                    continue;
+                // save hidden state of tile and set to revealed
+                row |= 1 << y;
+                designations[x][y].bits.hidden = 0;
+            }
+            mask[x] = row;
+            any_hidden |= row != 0;
+            all_hidden &= row == 0xffff;
+        }
+        if (!any_hidden)
+            continue;
+        hideblock hb;
+        hb.c = block->map_pos;
+        hb.mask = -1;
+        if (!all_hidden)
+        {
+            hb.mask = int32_t(hidemasks.size());
+            hidemasks.push_back(mask);
         }
         hidesaved.push_back(hb);
     }
@@ -311,19 +455,26 @@ command_result unreveal(color_ostream &out, vector<string> & params)
         return CR_FAILURE;
     }
 
+    // only tiles that were hidden before are touched; the rest were visible
+    // and still are
     for(size_t i = 0; i < hidesaved.size();i++)
     {
         hideblock & hb = hidesaved[i];
         df::map_block * b = Maps::getTileBlock(hb.c.x,hb.c.y,hb.c.z);
-        for (uint32_t x = 0; x < 16;x++) for (uint32_t y = 0; y < 16;y++)
+        if (!b)
+            continue;
+        for (uint32_t x = 0; x < 16;x++)
         {
-            b->designation[x][y].bits.hidden = hb.hiddens[x][y];
+            uint16_t row = hb.mask < 0 ? 0xffff : hidemasks[hb.mask][x];
+            for (uint32_t y = 0; row; y++, row >>= 1)
+            {
+                if (row & 1)
+                    b->designation[x][y].bits.hidden = 1;
+            }
         }
     }
     // give back memory.
-    hidesaved.clear();
-    revealed = NOT_REVEALED;
-    is_active = nopause_state || (revealed == REVEALED);
+    forget_snapshot();
     con.print("Map hidden!\n");
     return CR_OK;
 }
@@ -567,9 +718,7 @@ command_result revforget(color_ostream &out, vector<string> & params)
         return CR_FAILURE;
     }
     // give back memory.
-    hidesaved.clear();
-    revealed = NOT_REVEALED;
-    is_active = nopause_state || (revealed == REVEALED);
+    forget_snapshot();
     con.print("Reveal data forgotten!\n");
     return CR_OK;
 }
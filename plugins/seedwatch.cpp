@@ -13,7 +13,6 @@
 #include "modules/Kitchen.h"
 #include "modules/Maps.h"
 #include "modules/Persistence.h"
-#include "modules/Units.h"
 #include "modules/World.h"
 
 #include "df/item_flags.h"
@@ -114,8 +113,7 @@ static bool validate_seed_config(color_ostream& out, PersistentDataItem c)
     return valid;
 }
 
-static const int32_t CYCLE_TICKS = 1200;
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 300);
 
 static command_result do_command(color_ostream &out, vector<string> &parameters);
 static void do_cycle(color_ostream &out, int32_t *num_enabled_seeds = NULL, int32_t *num_disabled_seeds = NULL);
@@ -184,8 +182,6 @@ DFhackCExport command_result plugin_shutdown (color_ostream &out) {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
-
     world_plant_ids.clear();
     for (size_t i = 0; i < world->raws.plants.all.size(); ++i) {
         auto & plant = world->raws.plants.all[i];
@@ -230,17 +226,15 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int32_t num_enabled_seeds, num_disabled_seeds;
-        do_cycle(out, &num_enabled_seeds, &num_disabled_seeds);
-        if (0 < num_enabled_seeds)
-            out.print("%s: enabled %d seed types for cooking\n",
-                    plugin_name, num_enabled_seeds);
-        if (0 < num_disabled_seeds)
-            out.print("%s: protected %d seed types from cooking\n",
-                    plugin_name, num_disabled_seeds);
-    }
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    int32_t num_enabled_seeds, num_disabled_seeds;
+    do_cycle(out, &num_enabled_seeds, &num_disabled_seeds);
+    if (0 < num_enabled_seeds)
+        out.print("%s: enabled %d seed types for cooking\n",
+                plugin_name, num_enabled_seeds);
+    if (0 < num_disabled_seeds)
+        out.print("%s: protected %d seed types from cooking\n",
+                plugin_name, num_disabled_seeds);
     return CR_OK;
 }
 
@@ -307,27 +301,17 @@ struct BadFlags {
     }
 };
 
-static bool is_accessible_item(df::item *item, const vector<df::unit *> &citizens) {
-    const df::coord pos = Items::getPosition(item);
-    for (auto &unit : citizens) {
-        if (Maps::canWalkBetween(Units::getPosition(unit), pos))
-            return true;
-    }
-    return false;
-}
-
 static void scan_seeds(color_ostream &out, unordered_map<int32_t, int32_t> *accessible_counts,
         unordered_map<int32_t, int32_t> *inaccessible_counts = NULL) {
     static const BadFlags bad_flags;
 
-    vector<df::unit *> citizens;
-    Units::getCitizens(citizens);
+    const Maps::WalkableGroupSet &citizen_groups = Maps::getCitizenWalkableGroups();
 
     for (auto &item : world->items.other[items_other_id::SEEDS]) {
         MaterialInfo mat(item);
         if (mat.plant->index < 0 || !mat.isPlant())
             continue;
-        if ((bad_flags.whole & item->flags.whole) || !is_accessible_item(item, citizens)) {
+        if ((bad_flags.whole & item->flags.whole) || !citizen_groups.isReachableFromAny(Items::getPosition(item))) {
             if (inaccessible_counts)
                 ++(*inaccessible_counts)[mat.plant->index];
         } else {
@@ -340,9 +324,6 @@ static void scan_seeds(color_ostream &out, unordered_map<int32_t, int32_t> *acce
 static void do_cycle(color_ostream &out, int32_t *num_enabled_seed_types, int32_t *num_disabled_seed_types) {
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     if (num_enabled_seed_types)
         *num_enabled_seed_types = 0;
     if (num_disabled_seed_types)
@@ -75,8 +75,7 @@ static void set_config_bool(PersistentDataItem &c, int index, bool value) {
     set_config_val(c, index, value ? 1 : 0);
 }
 
-static const int32_t CYCLE_TICKS = 1200; // one day
-static int32_t cycle_timestamp = 0;  // world->frame_counter at last cycle
+DFHACK_PLUGIN_CYCLE(cycle_schedule, 1200, 1000); // one day
 
 // ah, if only STL had a bimap
 static const std::map<df::job_type, df::item_type> jobTypeMap = {
@@ -672,7 +671,6 @@ static void set_material_order() {
 }
 
 DFhackCExport command_result plugin_load_data (color_ostream &out) {
-    cycle_timestamp = 0;
     config = World::GetPersistentData(CONFIG_KEY);
 
     if (!config.isValid()) {
@@ -700,12 +698,10 @@ DFhackCExport command_result plugin_onstatechange(color_ostream &out, state_chan
     return CR_OK;
 }
 
-DFhackCExport command_result plugin_onupdate(color_ostream &out) {
-    if (is_enabled && world->frame_counter - cycle_timestamp >= CYCLE_TICKS) {
-        int ordered = do_cycle(out);
-        if (0 < ordered)
-            out.print("tailor: ordered %d items of clothing\n", ordered);
-    }
+DFhackCExport command_result plugin_oncycle(color_ostream &out) {
+    int ordered = do_cycle(out);
+    if (0 < ordered)
+        out.print("tailor: ordered %d items of clothing\n", ordered);
     return CR_OK;
 }
 
@@ -757,9 +753,6 @@ static command_result do_command(color_ostream &out, vector<string> &parameters)
 //
 
 static int do_cycle(color_ostream &out) {
-    // mark that we have recently run
-    cycle_timestamp = world->frame_counter;
-
     DEBUG(cycle,out).print("running %s cycle\n", plugin_name);
 
     return tailor_instance->do_cycle();
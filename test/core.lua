@@ -38,3 +38,29 @@ function test.getHackPath_chdir()
         expect.eq(clean_path(dfhack.getHackPath()), clean_path(fs.getcwd()))
     end)
 end
+
+local function with_temp_file(name, contents, fn)
+    local f = io.open(name, 'wb')
+    f:write(contents)
+    f:close()
+    dfhack.with_finalize(function() os.remove(name) end, fn)
+end
+
+function test.loadfile_text_only_repeated()
+    with_temp_file('test_loadfile_text.lua', 'return 42, ...', function()
+        -- the second load may come from the bytecode cache
+        for _=1,2 do
+            local fn, err = loadfile('test_loadfile_text.lua', 't', {})
+            expect.ne(nil, fn, err)
+            expect.table_eq({42, 'x'}, {fn('x')})
+        end
+    end)
+end
+
+function test.loadfile_text_only_rejects_bytecode()
+    local code = string.dump(function() return 42 end)
+    with_temp_file('test_loadfile_binary.lua', code, function()
+        expect.nil_(loadfile('test_loadfile_binary.lua', 't'))
+        expect.eq(42, loadfile('test_loadfile_binary.lua', 'b')())
+    end)
+end
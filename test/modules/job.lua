@@ -17,3 +17,22 @@ function test.removeJob()
     expect.true_(dfhack.job.removeJob(job))
     expect.nil_(df.global.world.jobs.list.next, 'job list is not empty after removeJob()')
 end
+
+function test.getJobs_countJobs()
+    expect.nil_(df.global.world.jobs.list.next, 'job list is not empty')
+    expect.eq(0, #dfhack.job.getJobs())
+    expect.eq(0, dfhack.job.countJobs(df.job_type.BringItemToDepot))
+
+    local job = df.job:new()  -- will be deleted by removeJob() if the test passes
+    job.job_type = df.job_type.BringItemToDepot
+    dfhack.job.linkIntoWorld(job)
+    local jobs = dfhack.job.getJobs()
+    expect.eq(1, #jobs)
+    expect.eq(job, jobs[1])
+    expect.eq(1, dfhack.job.countJobs(df.job_type.BringItemToDepot))
+    expect.eq(0, dfhack.job.countJobs(df.job_type.StoreItemInStockpile))
+
+    expect.true_(dfhack.job.removeJob(job))
+    expect.eq(0, #dfhack.job.getJobs())
+    expect.eq(0, dfhack.job.countJobs(df.job_type.BringItemToDepot))
+end
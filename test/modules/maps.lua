@@ -0,0 +1,80 @@
+config.target = 'core'
+config.mode = 'fortress'
+
+local function get_citizen_groups()
+    local groups = {}
+    for _,unit in ipairs(dfhack.units.getCitizens()) do
+        local group = dfhack.maps.getWalkableGroup(xyz2pos(dfhack.units.getPosition(unit)))
+        if group ~= 0 then groups[group] = true end
+    end
+    return groups
+end
+
+-- returns a walkable tile whose group no citizen is in, or nil
+local function find_unreached_tile(groups)
+    for _,block in ipairs(df.global.world.map.map_blocks) do
+        for x=0,15 do
+            for y=0,15 do
+                local group = block.walkable[x][y]
+                if group ~= 0 and not groups[group] then
+                    return xyz2pos(block.map_pos.x + x, block.map_pos.y + y, block.map_pos.z)
+                end
+            end
+        end
+    end
+end
+
+function test.isReachableByCitizens()
+    local groups = get_citizen_groups()
+    for _,unit in ipairs(dfhack.units.getCitizens()) do
+        local pos = xyz2pos(dfhack.units.getPosition(unit))
+        expect.eq(dfhack.maps.getWalkableGroup(pos) ~= 0,
+                  dfhack.maps.isReachableByCitizens(pos))
+    end
+
+    local pos = find_unreached_tile(groups)
+    if pos then
+        expect.false_(dfhack.maps.isReachableByCitizens(pos))
+    end
+end
+
+function test.isAdjacentReachableByCitizens()
+    local groups = get_citizen_groups()
+    for _,unit in ipairs(dfhack.units.getCitizens()) do
+        local x, y, z = dfhack.units.getPosition(unit)
+        local expected = false
+        for dx=-1,1 do
+            for dy=-1,1 do
+                if (dx ~= 0 or dy ~= 0) and
+                        groups[dfhack.maps.getWalkableGroup(xyz2pos(x+dx, y+dy, z))] then
+                    expected = true
+                end
+            end
+        end
+        expect.eq(expected, dfhack.maps.isAdjacentReachableByCitizens(xyz2pos(x, y, z)))
+    end
+end
+
+-- map edits made while the game is paused must be seen after the next update
+function test.walkable_groups_refresh_while_paused()
+    local groups = get_citizen_groups()
+    local citizen_group = next(groups)
+    local pos = find_unreached_tile(groups)
+    if not citizen_group or not pos then return end
+
+    local was_paused = df.global.pause_state
+    df.global.pause_state = true
+    local block = dfhack.maps.getTileBlock(pos)
+    local old_group = block.walkable[pos.x % 16][pos.y % 16]
+    dfhack.with_finalize(
+        function()
+            block.walkable[pos.x % 16][pos.y % 16] = old_group
+            df.global.pause_state = was_paused
+        end,
+        function()
+            expect.false_(dfhack.maps.isReachableByCitizens(pos))
+            block.walkable[pos.x % 16][pos.y % 16] = citizen_group
+            delay()
+            expect.true_(dfhack.maps.isReachableByCitizens(pos))
+        end)
+end
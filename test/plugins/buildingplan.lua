@@ -0,0 +1,23 @@
+config.mode = 'fortress'
+config.target = 'buildingplan'
+
+local buildingplan = require('plugins.buildingplan')
+
+-- items offered for planned buildings must be reachable by a citizen, or at
+-- least lie on a walkable tile when there are no citizens to check against
+function test.available_items_are_accessible()
+    local have_citizens = #dfhack.units.getCitizens() > 0
+    for _,type in ipairs{df.building_type.Chair, df.building_type.Table, df.building_type.Door} do
+        for _,id in ipairs(buildingplan.getAvailableItems(type, -1, -1, 0)) do
+            local item = df.item.find(id)
+            local pos = xyz2pos(dfhack.items.getPosition(item))
+            if have_citizens then
+                expect.true_(dfhack.maps.isReachableByCitizens(pos),
+                             ('item %d is not reachable by citizens'):format(id))
+            else
+                expect.ne(0, dfhack.maps.getWalkableGroup(pos),
+                          ('item %d is not on a walkable tile'):format(id))
+            end
+        end
+    end
+end